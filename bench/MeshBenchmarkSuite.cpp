@@ -0,0 +1,284 @@
+/**
+ * @file    MeshBenchmarkSuite.cpp
+ * @brief   Microbenchmarks of SimplexNoise and of the height generation loop of the app, with JSON output.
+ *
+ * Standalone, no Cinder/GL dependency:
+ *   c++ -O2 -std=c++11 -pthread -I../xcode -I../include MeshBenchmarkSuite.cpp ../xcode/SimplexNoise.cpp
+ *       ../xcode/SimplexNoiseSimd.cpp ../src/HeightFieldGenerator.cpp ../src/ThreadPool.cpp -o MeshBenchmarkSuite
+ *
+ * Usage: MeshBenchmarkSuite [--json <file>] [--label <text>] [--quick] [--max-grid <size>]
+ *   --json      also writes every result to <file> (- for stdout), to diff runs across commits
+ *   --label     free text stored in the JSON, typically the commit being measured
+ *   --quick     fewer points and repeats, for a smoke run
+ *   --max-grid  skips the grid fills larger than <size> x <size>
+ */
+
+#include "SimplexNoise.h"
+#include "HeightFieldGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/// Keeps the scalar loops from being optimized away
+static volatile float sSink;
+
+static size_t sNumPoints = 1 << 20;
+static int    sRepeats   = 5;
+
+/**
+ * One measurement, as written to the JSON output
+ */
+struct Result {
+    string  mName;      ///< what is measured, e.g. "noise2/batch"
+    string  mHash;      ///< hashing backend
+    int     mOctaves;   ///< fBm octaves, 0 when not a fractal
+    int     mGridSize;  ///< side of the grid for the grid fills, 0 otherwise
+    int     mThreads;   ///< threads generating, 1 for the single threaded benchmarks
+    double  mNsPerSample;
+    double  mSpeedup;   ///< time with 1 thread over this time, for the grid fills
+};
+
+static vector<Result> sResults;
+
+/**
+ * Best time over sRepeats runs of fn, in nanoseconds per sample
+ */
+template <typename Fn>
+static double timePerSample( size_t numSamples, Fn fn )
+{
+    double best = 1e30;
+    for( int r = 0; r < sRepeats; ++r ) {
+        const auto start = chrono::steady_clock::now();
+        fn();
+        const auto end = chrono::steady_clock::now();
+        best = min( best, chrono::duration<double, nano>( end - start ).count() / numSamples );
+    }
+    return best;
+}
+
+static void report( const Result &result )
+{
+    sResults.push_back( result );
+    printf( "%-24s %-12s", result.mName.c_str(), result.mHash.c_str() );
+    if( result.mOctaves )
+        printf( " octaves %2d", result.mOctaves );
+    if( result.mGridSize )
+        printf( " grid %4d^2 threads %3d", result.mGridSize, result.mThreads );
+    printf( "  %8.2f ns/sample  %10.3f Msamples/s", result.mNsPerSample, 1e3 / result.mNsPerSample );
+    if( result.mGridSize )
+        printf( "  x%.2f", result.mSpeedup );
+    printf( "\n" );
+}
+
+static Result makeResult( const string &name, const string &hash, double ns )
+{
+    Result result = { name, hash, 0, 0, 1, ns, 1.0 };
+    return result;
+}
+
+template <typename Hash>
+static void benchmarkNoise( const char *hash, const BasicSimplexNoise<Hash> &noise,
+                            const vector<float> &x, const vector<float> &y, const vector<float> &z )
+{
+    const size_t count = sNumPoints;
+    vector<float> out( count ), dx( count ), dy( count );
+
+    report( makeResult( "noise1/scalar", hash, timePerSample( count, [&] {
+        float sum = 0;
+        for( size_t n = 0; n < count; ++n )
+            sum += noise.noise( x[n] );
+        sSink = sum;
+    } ) ) );
+    report( makeResult( "noise2/scalar", hash, timePerSample( count, [&] {
+        float sum = 0;
+        for( size_t n = 0; n < count; ++n )
+            sum += noise.noise( x[n], y[n] );
+        sSink = sum;
+    } ) ) );
+    report( makeResult( "noise3/scalar", hash, timePerSample( count, [&] {
+        float sum = 0;
+        for( size_t n = 0; n < count; ++n )
+            sum += noise.noise( x[n], y[n], z[n] );
+        sSink = sum;
+    } ) ) );
+    report( makeResult( "noise2/batch", hash, timePerSample( count, [&] { noise.noise( x.data(), y.data(), out.data(), count ); } ) ) );
+    report( makeResult( "noise3/batch", hash, timePerSample( count, [&] { noise.noise( x.data(), y.data(), z.data(), out.data(), count ); } ) ) );
+    report( makeResult( "noise2/batch+derivatives", hash, timePerSample( count, [&] {
+        noise.noise( x.data(), y.data(), out.data(), dx.data(), dy.data(), count );
+    } ) ) );
+}
+
+template <typename Hash>
+static void benchmarkFractal( const char *hash, const BasicSimplexNoise<Hash> &noise,
+                              const vector<float> &x, const vector<float> &y )
+{
+    // every octave costs about one noise evaluation, fewer points keep the 20 octaves runs short
+    const size_t count = sNumPoints / 4;
+    vector<float> out( count );
+
+    for( int octaves = 1; octaves <= 20; ++octaves ) {
+        Result scalar = makeResult( "fractal2/scalar", hash, timePerSample( count, [&] {
+            float sum = 0;
+            for( size_t n = 0; n < count; ++n )
+                sum += noise.fractal( octaves, x[n], y[n] );
+            sSink = sum;
+        } ) );
+        scalar.mOctaves = octaves;
+        report( scalar );
+
+        Result batch = makeResult( "fractal2/batch", hash, timePerSample( count, [&] {
+            noise.fractal( octaves, x.data(), y.data(), out.data(), count );
+        } ) );
+        batch.mOctaves = octaves;
+        report( batch );
+
+        const BasicPreparedFractal<Hash> prepared( noise, octaves );
+        Result preparedBatch = makeResult( "fractal2/prepared", hash, timePerSample( count, [&] {
+            prepared( x.data(), y.data(), out.data(), count );
+        } ) );
+        preparedBatch.mOctaves = octaves;
+        report( preparedBatch );
+    }
+}
+
+/**
+ * Full grid fills as done by the app: rows of a size x size grid evaluated by the prepared fBm,
+ * one batch per row, scaled by the height multiplier, in bands spread over the generator threads.
+ */
+template <typename Hash>
+static void benchmarkGridFills( const char *hash, const BasicSimplexNoise<Hash> &noise, int octaves, int maxGridSize )
+{
+    static const int kGridSizes[] = { 54, 512, 2048, 4096 };
+    static const float kPlaneSize = 26.0f;
+    static const float kHeightMult = 3.9f;
+    const BasicPreparedFractal<Hash> prepared( noise, octaves );
+
+    vector<size_t> threadCounts;
+    const size_t hardwareThreads = max( 1u, thread::hardware_concurrency() );
+    for( size_t threads = 1; threads < hardwareThreads; threads *= 2 )
+        threadCounts.push_back( threads );
+    threadCounts.push_back( hardwareThreads );
+
+    for( int size : kGridSizes ) {
+        if( size > maxGridSize )
+            continue;
+        const size_t columns = size + 1;
+        const size_t rows = size + 1;
+        const float spacing = kPlaneSize / size;
+        vector<float> gridX( columns );
+        for( size_t column = 0; column < columns; ++column )
+            gridX[column] = -0.5f * kPlaneSize + column * spacing;
+        vector<float> heights( columns * rows );
+
+        double singleThreaded = 0;
+        for( size_t threads : threadCounts ) {
+            auto generator = HeightFieldGenerator::create( threads );
+            const double ns = timePerSample( heights.size(), [&] {
+                generator->generateRows( rows, [&]( size_t rowBegin, size_t rowEnd ) {
+                    vector<float> z( columns );
+                    for( size_t row = rowBegin; row < rowEnd; ++row ) {
+                        float *rowHeights = &heights[row * columns];
+                        fill( z.begin(), z.end(), -0.5f * kPlaneSize + row * spacing );
+                        prepared( gridX.data(), z.data(), rowHeights, columns );
+                        for( size_t column = 0; column < columns; ++column )
+                            rowHeights[column] *= kHeightMult;
+                    }
+                } );
+            } );
+            if( threads == 1 )
+                singleThreaded = ns;
+
+            Result result = makeResult( "grid_fill/fractal", hash, ns );
+            result.mOctaves = octaves;
+            result.mGridSize = size;
+            result.mThreads = (int)generator->getNumWorkers();
+            result.mSpeedup = singleThreaded / ns;
+            report( result );
+        }
+    }
+}
+
+static void writeJson( FILE *file, const string &label )
+{
+    static const char *levelNames[] = { "scalar", "sse4.1", "avx2" };
+    fprintf( file, "{\n" );
+    fprintf( file, "  \"suite\": \"MeshBenchmarkSuite\",\n" );
+    fprintf( file, "  \"label\": \"%s\",\n", label.c_str() );
+    fprintf( file, "  \"simd\": \"%s\",\n", levelNames[SimplexNoiseBase::getSimdLevel()] );
+    fprintf( file, "  \"hardware_threads\": %u,\n", thread::hardware_concurrency() );
+    fprintf( file, "  \"points\": %zu,\n", sNumPoints );
+    fprintf( file, "  \"repeats\": %d,\n", sRepeats );
+    fprintf( file, "  \"results\": [\n" );
+    for( size_t i = 0; i < sResults.size(); ++i ) {
+        const Result &r = sResults[i];
+        fprintf( file, "    { \"name\": \"%s\", \"hash\": \"%s\", \"octaves\": %d, \"grid\": %d, \"threads\": %d, "
+                       "\"ns_per_sample\": %.4f, \"samples_per_sec\": %.1f, \"speedup\": %.3f }%s\n",
+                 r.mName.c_str(), r.mHash.c_str(), r.mOctaves, r.mGridSize, r.mThreads,
+                 r.mNsPerSample, 1e9 / r.mNsPerSample, r.mSpeedup, ( i + 1 < sResults.size() ) ? "," : "" );
+    }
+    fprintf( file, "  ]\n}\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *jsonPath = nullptr;
+    string label;
+    int maxGridSize = 4096;
+    for( int i = 1; i < argc; ++i ) {
+        if( ! strcmp( argv[i], "--json" ) && i + 1 < argc )
+            jsonPath = argv[++i];
+        else if( ! strcmp( argv[i], "--label" ) && i + 1 < argc )
+            label = argv[++i];
+        else if( ! strcmp( argv[i], "--max-grid" ) && i + 1 < argc )
+            maxGridSize = atoi( argv[++i] );
+        else if( ! strcmp( argv[i], "--quick" ) ) {
+            sNumPoints = 1 << 16;
+            sRepeats = 2;
+        }
+        else {
+            fprintf( stderr, "usage: %s [--json <file>] [--label <text>] [--quick] [--max-grid <size>]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    mt19937 rng( 42 );
+    uniform_real_distribution<float> dist( -1000.0f, 1000.0f );
+    vector<float> x( sNumPoints ), y( sNumPoints ), z( sNumPoints );
+    for( size_t n = 0; n < sNumPoints; ++n ) {
+        x[n] = dist( rng );
+        y[n] = dist( rng );
+        z[n] = dist( rng );
+    }
+
+    // the app defaults
+    const SimplexNoise noise( 2.08f, 0.64f, 0.65f, 1.4f );
+    const SeededSimplexNoise seededNoise( 2.08f, 0.64f, 0.65f, 1.4f, SimplexIntegerHash( 1234 ) );
+
+    printf( "%zu points, best of %d runs\n", sNumPoints, sRepeats );
+    benchmarkNoise( "permutation", noise, x, y, z );
+    benchmarkNoise( "integer", seededNoise, x, y, z );
+    benchmarkFractal( "permutation", noise, x, y );
+    benchmarkFractal( "integer", seededNoise, x, y );
+    benchmarkGridFills( "permutation", noise, 7, maxGridSize );
+    benchmarkGridFills( "integer", seededNoise, 7, maxGridSize );
+
+    if( jsonPath ) {
+        FILE *file = strcmp( jsonPath, "-" ) ? fopen( jsonPath, "w" ) : stdout;
+        if( ! file ) {
+            fprintf( stderr, "can't write %s\n", jsonPath );
+            return 1;
+        }
+        writeJson( file, label );
+        if( file != stdout )
+            fclose( file );
+    }
+    return 0;
+}
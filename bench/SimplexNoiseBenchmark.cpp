@@ -0,0 +1,93 @@
+/**
+ * @file    SimplexNoiseBenchmark.cpp
+ * @brief   Compares the hashing backends of SimplexNoise on 1D/2D/3D noise, scalar and batched.
+ *
+ * Standalone, no Cinder dependency:
+ *   c++ -O2 -std=c++11 -I../xcode SimplexNoiseBenchmark.cpp ../xcode/SimplexNoise.cpp ../xcode/SimplexNoiseSimd.cpp
+ */
+
+#include "SimplexNoise.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+static const size_t kNumPoints = 1 << 20;
+static const int    kRepeats   = 5;
+
+/**
+ * Best time over kRepeats runs of fn, in nanoseconds per point
+ */
+template <typename Fn>
+static double timePerPoint( Fn fn )
+{
+    double best = 1e30;
+    for( int r = 0; r < kRepeats; ++r ) {
+        const auto start = chrono::steady_clock::now();
+        fn();
+        const auto end = chrono::steady_clock::now();
+        const double ns = chrono::duration<double, nano>( end - start ).count() / kNumPoints;
+        if( ns < best )
+            best = ns;
+    }
+    return best;
+}
+
+/// Keeps the scalar loops from being optimized away
+static volatile float sSink;
+
+template <typename NoiseT>
+static void benchmarkBackend( const char *name, const NoiseT &noise,
+                              const vector<float> &x, const vector<float> &y, const vector<float> &z )
+{
+    vector<float> out( kNumPoints );
+
+    const double scalar1 = timePerPoint( [&] {
+        float sum = 0;
+        for( size_t n = 0; n < kNumPoints; ++n )
+            sum += noise.noise( x[n] );
+        sSink = sum;
+    } );
+    const double scalar2 = timePerPoint( [&] {
+        float sum = 0;
+        for( size_t n = 0; n < kNumPoints; ++n )
+            sum += noise.noise( x[n], y[n] );
+        sSink = sum;
+    } );
+    const double scalar3 = timePerPoint( [&] {
+        float sum = 0;
+        for( size_t n = 0; n < kNumPoints; ++n )
+            sum += noise.noise( x[n], y[n], z[n] );
+        sSink = sum;
+    } );
+    printf( "%-12s scalar      1D %6.2f ns   2D %6.2f ns   3D %6.2f ns\n", name, scalar1, scalar2, scalar3 );
+
+    static const char *levelNames[] = { "batch/scalar", "batch/sse4.1", "batch/avx2" };
+    for( int level = SimplexNoiseBase::SimdScalar; level <= SimplexNoiseBase::getSupportedSimdLevel(); ++level ) {
+        SimplexNoiseBase::setSimdLevel( SimplexNoiseBase::SimdLevel( level ) );
+        const double batch2 = timePerPoint( [&] { noise.noise( x.data(), y.data(), out.data(), kNumPoints ); } );
+        const double batch3 = timePerPoint( [&] { noise.noise( x.data(), y.data(), z.data(), out.data(), kNumPoints ); } );
+        printf( "%-12s %-12s             2D %6.2f ns   3D %6.2f ns\n", name, levelNames[level], batch2, batch3 );
+    }
+    SimplexNoiseBase::setSimdLevel( SimplexNoiseBase::getSupportedSimdLevel() );
+}
+
+int main()
+{
+    mt19937 rng( 42 );
+    uniform_real_distribution<float> dist( -1000.0f, 1000.0f );
+    vector<float> x( kNumPoints ), y( kNumPoints ), z( kNumPoints );
+    for( size_t n = 0; n < kNumPoints; ++n ) {
+        x[n] = dist( rng );
+        y[n] = dist( rng );
+        z[n] = dist( rng );
+    }
+
+    printf( "%zu points, best of %d runs, time per point\n", kNumPoints, kRepeats );
+    benchmarkBackend( "permutation", SimplexNoise(), x, y, z );
+    benchmarkBackend( "integer", SeededSimplexNoise( 1.0f, 1.0f, 2.0f, 0.5f, SimplexIntegerHash( 1234 ) ), x, y, z );
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file    HeadlessGl.cpp
+ * @brief   GL without a window nor a display, shared by the command line tools that draw.
+ */
+
+#include "HeadlessGl.h"
+
+#include <cstdio>
+
+using namespace std;
+
+bool createHeadlessContext( EGLDisplay &display, EGLContext &context )
+{
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+    auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress( "eglQueryDevicesEXT" );
+    if( ! getPlatformDisplay ) {
+        fprintf( stderr, "EGL has no platform displays\n" );
+        return false;
+    }
+    display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr );
+    if( ( display == EGL_NO_DISPLAY || ! eglInitialize( display, nullptr, nullptr ) ) && queryDevices ) {
+        EGLDeviceEXT device;
+        EGLint numDevices = 0;
+        if( queryDevices( 1, &device, &numDevices ) && numDevices > 0 ) {
+            display = getPlatformDisplay( EGL_PLATFORM_DEVICE_EXT, device, nullptr );
+            if( display != EGL_NO_DISPLAY && ! eglInitialize( display, nullptr, nullptr ) )
+                display = EGL_NO_DISPLAY;
+        }
+        else {
+            display = EGL_NO_DISPLAY;
+        }
+    }
+    if( display == EGL_NO_DISPLAY ) {
+        fprintf( stderr, "no surfaceless EGL display nor EGL device\n" );
+        return false;
+    }
+
+    const EGLint attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2,
+                               EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+    if( ! eglBindAPI( EGL_OPENGL_API ) ) {
+        fprintf( stderr, "EGL has no OpenGL\n" );
+        return false;
+    }
+    context = eglCreateContext( display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs );
+    if( context == EGL_NO_CONTEXT || ! eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) ) {
+        fprintf( stderr, "can't make a GL 3.2 core context current without a surface (EGL error 0x%x)\n", eglGetError() );
+        return false;
+    }
+    return true;
+}
+
+static bool readText( const string &path, string &text )
+{
+    FILE *file = fopen( path.c_str(), "rb" );
+    if( ! file )
+        return false;
+    char buffer[4096];
+    size_t read;
+    text.clear();
+    while( ( read = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+        text.append( buffer, read );
+    fclose( file );
+    return true;
+}
+
+GLuint compileShader( GLenum type, const string &path )
+{
+    string source;
+    if( ! readText( path, source ) ) {
+        fprintf( stderr, "can't read %s\n", path.c_str() );
+        return 0;
+    }
+    const GLuint shader = glCreateShader( type );
+    const char *text = source.c_str();
+    glShaderSource( shader, 1, &text, nullptr );
+    glCompileShader( shader );
+    GLint compiled;
+    glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
+    if( ! compiled ) {
+        char log[4096];
+        glGetShaderInfoLog( shader, sizeof( log ), nullptr, log );
+        fprintf( stderr, "%s: %s\n", path.c_str(), log );
+        glDeleteShader( shader );
+        return 0;
+    }
+    return shader;
+}
+
+void destroyHeadlessContext( EGLDisplay display, EGLContext context )
+{
+    eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+    eglDestroyContext( display, context );
+    eglTerminate( display );
+}
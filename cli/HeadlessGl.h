@@ -0,0 +1,30 @@
+/**
+ * @file    HeadlessGl.h
+ * @brief   GL without a window nor a display, shared by the command line tools that draw.
+ */
+
+#pragma once
+
+#define EGL_EGLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+
+#include <string>
+
+/**
+ * Makes a GL 3.2 core context current, without any surface, on the surfaceless platform of Mesa (llvmpipe on a
+ * machine without a GPU) or else on the first EGL device. The errors are printed.
+ */
+bool createHeadlessContext( EGLDisplay &display, EGLContext &context );
+
+/**
+ * Releases and destroys the context of createHeadlessContext(), and terminates its display
+ */
+void destroyHeadlessContext( EGLDisplay display, EGLContext context );
+
+/**
+ * Compiles the shader of \a type in the file \a path, 0 if it can't be read or doesn't compile, the log printed
+ */
+GLuint compileShader( GLenum type, const std::string &path );
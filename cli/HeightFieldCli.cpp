@@ -0,0 +1,207 @@
+/**
+ * @file    HeightFieldCli.cpp
+ * @brief   Generates a heightfield with the app's height functions, without a window nor GL, and writes it to disk.
+ *
+ * The generation library is include/TerrainGenerator.h and its dependencies, all plain C++:
+ *   c++ -O2 -std=c++11 -pthread -I../xcode -I../include HeightFieldCli.cpp HeightFieldOptions.cpp ../src/TerrainGenerator.cpp
+ *       ../src/HeightFieldFile.cpp ../src/BakedAnimation.cpp ../src/HeightGraph.cpp ../src/HeightFieldGenerator.cpp ../src/ThreadPool.cpp ../src/HeightTileCache.cpp ../src/FrameProfiler.cpp
+ *       ../xcode/SimplexNoise.cpp ../xcode/SimplexNoiseSimd.cpp -o heightfield
+ *
+ * Usage: heightfield [options] -o <file>
+ *   --subdivisions <n>  quads along each side, the field has (n + 1) x (n + 1) samples (54)
+ *   --plane-size <s>    side of the plane, centered on the origin (26)
+ *   --function <name>   sine, uniform, randnoise, fractal, simplex or graph (fractal)
+ *   --graph-base <name> base source of the graph function: constant, sine, simplex, fractal or random (fractal)
+ *   --graph-warp <s>    domain warp of the base by simplex noise, 0 for none (0)
+ *   --graph-ridge       ridges the base, 1 - |base|
+ *   --graph-detail <name>
+ *                       source added to the base, weighted by --graph-weight (none)
+ *   --graph-multiply    the detail multiplies the base instead
+ *   --graph-weight <w>  weight of the detail (0.25)
+ *   --graph-clamp <low>,<high>
+ *                       clamps the graph heights, before the height multiplier
+ *   --octaves <n>       fBm octaves (7)
+ *   --frequency <f>, --amplitude <a>, --lacunarity <l>, --persistence <p>
+ *                       noise params (2.08, 0.64, 0.65, 1.4)
+ *   --hash <name>       permutation or seeded (permutation)
+ *   --seed <n>          seed of the seeded hash and of randnoise (0)
+ *   --height-mult <m>   height multiplier (3.9)
+ *   --time <t>          time offset in seconds: phase of sine, and the scrolling of the other functions
+ *                       as the app does it, one unit along z per 0.1 s (0)
+ *   --normals           also writes the unit normals, to <file>.normals as 3 float32 per sample
+ *   --workers <n>       generation threads, 0 for one per hardware thread (0)
+ *   --format <name>     raw: float32 samples row by row, pgm: 16 bit grayscale from min to max, csv,
+ *                       tiled: the mappable format of HeightFieldFile.h, with the params in its header,
+ *                       baked: an animation of BakedAnimation.h, from --time on (raw)
+ *   --element <type>    samples of the tiled format: float32, float16 or uint16 (float32)
+ *   --tile-size <n>     tile side of the tiled format (64)
+ *   --frames <n>        frames of the baked format (300)
+ *   --fps <f>           frames per second of the baked format (60)
+ *   -o, --output <file> file written, - for stdout
+ */
+
+#include "HeightFieldOptions.h"
+#include "HeightFieldFile.h"
+#include "BakedAnimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static void usage( const char *program )
+{
+    fprintf( stderr, "usage: %s%s\n"
+                     "       [--format raw|pgm|csv|tiled|baked] [--element float32|float16|uint16] [--tile-size n] [--frames n] [--fps f]\n"
+                     "       -o <file>\n", program, HeightFieldOptions::kUsage );
+}
+
+static FILE *openOutput( const string &path, const char *mode )
+{
+    return ( path == "-" ) ? stdout : fopen( path.c_str(), mode );
+}
+
+static bool closeOutput( FILE *file )
+{
+    return ( file == stdout ) ? fflush( file ) == 0 : fclose( file ) == 0;
+}
+
+static bool writeRaw( const string &path, const void *data, size_t bytes )
+{
+    FILE *file = openOutput( path, "wb" );
+    if( ! file )
+        return false;
+    const bool written = fwrite( data, 1, bytes, file ) == bytes;
+    return closeOutput( file ) && written;
+}
+
+/**
+ * Binary 16 bit PGM, the heights mapped from [min, max] to [0, 65535]
+ */
+static bool writePgm( const string &path, const vector<float> &heights, size_t numColumns, size_t numRows )
+{
+    FILE *file = openOutput( path, "wb" );
+    if( ! file )
+        return false;
+    const auto range = minmax_element( heights.begin(), heights.end() );
+    const float low = *range.first;
+    const float scale = ( *range.second > low ) ? 65535.0f / ( *range.second - low ) : 0.0f;
+    fprintf( file, "P5\n%zu %zu\n65535\n", numColumns, numRows );
+    vector<unsigned char> row( 2 * numColumns );
+    bool written = true;
+    for( size_t z = 0; z < numRows; ++z ) {
+        for( size_t x = 0; x < numColumns; ++x ) {
+            const unsigned value = (unsigned)lroundf( ( heights[z * numColumns + x] - low ) * scale );
+            row[2 * x] = (unsigned char)( value >> 8 );
+            row[2 * x + 1] = (unsigned char)( value & 0xff );
+        }
+        written = written && fwrite( row.data(), 1, row.size(), file ) == row.size();
+    }
+    return closeOutput( file ) && written;
+}
+
+static bool writeCsv( const string &path, const vector<float> &heights, size_t numColumns, size_t numRows )
+{
+    FILE *file = openOutput( path, "w" );
+    if( ! file )
+        return false;
+    for( size_t z = 0; z < numRows; ++z ) {
+        for( size_t x = 0; x < numColumns; ++x )
+            fprintf( file, "%.9g%c", heights[z * numColumns + x], ( x + 1 < numColumns ) ? ',' : '\n' );
+    }
+    return closeOutput( file );
+}
+
+int main( int argc, char *argv[] )
+{
+    HeightFieldOptions options;
+    string format = "raw";
+    HeightElementType elementType = HEIGHT_FLOAT32;
+    int tileSize = HeightFieldFile::kDefaultTileSize;
+    int frames = 300;
+    float framesPerSecond = 60.0f;
+    string output;
+
+    for( int i = 1; i < argc; ++i ) {
+        const int parsed = options.parse( argc, argv, i );
+        if( parsed < 0 )
+            return 1;
+        if( parsed > 0 )
+            continue;
+        const string option = argv[i];
+        if( i + 1 >= argc ) {
+            usage( argv[0] );
+            return 1;
+        }
+        const char *value = argv[++i];
+        if( option == "--format" )
+            format = value;
+        else if( option == "--element" ) {
+            const int type = findName( { "float32", "float16", "uint16" }, value );
+            if( type < 0 ) {
+                fprintf( stderr, "unknown element type %s\n", value );
+                return 1;
+            }
+            elementType = HeightElementType( type );
+        }
+        else if( option == "--tile-size" )
+            tileSize = atoi( value );
+        else if( option == "--frames" )
+            frames = atoi( value );
+        else if( option == "--fps" )
+            framesPerSecond = (float)atof( value );
+        else if( option == "-o" || option == "--output" )
+            output = value;
+        else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+    const bool baked = ( format == "baked" );
+    if( output.empty() || ! options.valid() || tileSize < 1 || frames < 1 || ! ( framesPerSecond > 0.0f )
+        || ( format != "raw" && format != "pgm" && format != "csv" && format != "tiled" && ! baked ) || ( ( format == "tiled" || baked ) && output == "-" ) ) {
+        usage( argv[0] );
+        return 1;
+    }
+
+    const vector<float> grid = options.prepare();
+    const size_t numColumns = grid.size();
+    HeightParams &params = options.mParams;
+
+    // The baked frames are generated one after the other into the same field
+    if( baked ) {
+        HeightFieldRef field = HeightField::create( grid, grid, false );
+        if( ! BakedAnimationWriter::bake( output, params, field, size_t( frames ), framesPerSecond, HeightFieldGenerator::create( options.mWorkers ) ) ) {
+            fprintf( stderr, "can't write %s\n", output.c_str() );
+            return 1;
+        }
+        return 0;
+    }
+
+    HeightFieldRef field = HeightField::create( grid, grid, params.mNormals );
+    TerrainGeneratorRef generator = TerrainGenerator::create();
+    params.mGenerationId = generator->getGenerationId();
+    generator->run( params, field, HeightFieldGenerator::create( options.mWorkers ) );
+
+    bool written;
+    if( format == "pgm" )
+        written = writePgm( output, field->mHeights, numColumns, numColumns );
+    else if( format == "csv" )
+        written = writeCsv( output, field->mHeights, numColumns, numColumns );
+    else if( format == "tiled" )
+        written = HeightFieldFile::write( output, HeightFieldFile::makeHeader( params, *field, elementType, tileSize ), *field );
+    else
+        written = writeRaw( output, field->mHeights.data(), field->mHeights.size() * sizeof( float ) );
+    if( written && params.mNormals && output != "-" )
+        written = writeRaw( output + ".normals", field->mNormals.data(), field->mNormals.size() * sizeof( HeightNormal ) );
+    if( ! written ) {
+        fprintf( stderr, "can't write %s\n", output.c_str() );
+        return 1;
+    }
+    return 0;
+}
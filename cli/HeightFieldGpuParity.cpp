@@ -0,0 +1,195 @@
+/**
+ * @file    HeightFieldGpuParity.cpp
+ * @brief   Checks the heights of the app's GPU noise mode against those generated on the CPU.
+ *
+ * The vertex shader of the GPU noise mode, wireframe-noise.vert, evaluates the height of every vertex of the plane;
+ * the heights are captured by transform feedback with the rasterizer off, in a GL context without any surface (see
+ * HeadlessGl.h), and compared with the heights TerrainGenerator::run() generates for the same plane and params, at
+ * the x and z of the generated field. It runs under Mesa llvmpipe on a machine without a GPU.
+ *
+ *   c++ -O2 -std=c++11 -pthread -I../xcode -I../include HeightFieldGpuParity.cpp HeadlessGl.cpp HeightFieldOptions.cpp
+ *       ../src/TerrainGenerator.cpp ../src/HeightGraph.cpp ../src/HeightFieldGenerator.cpp ../src/ThreadPool.cpp
+ *       ../src/HeightTileCache.cpp ../src/FrameProfiler.cpp ../xcode/SimplexNoise.cpp ../xcode/SimplexNoiseSimd.cpp
+ *       -lEGL -lOpenGL -o heightfield-gpu-parity
+ *
+ * Usage: heightfield-gpu-parity [heightfield options] [options]
+ *   The options of the heightfield, --subdivisions to --workers, are those of HeightFieldCli.cpp; --function is
+ *   fractal or simplex, the height functions of the GPU noise mode.
+ *   --scroll-row <n>    rows of the scroll mode the plane is at, the rows of the ring instead of those at the time
+ *                       offset of --time
+ *   --tolerance <t>     largest error allowed, relative to the height multiplier when it is over 1 (1e-3)
+ *   --assets <dir>      directory of the shaders (../xcode/assets)
+ *
+ * Prints the largest error over the vertices, and exits with 0 if it is within the tolerance, 1 otherwise.
+ */
+
+#include "HeadlessGl.h"
+#include "HeightFieldOptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static void usage( const char *program )
+{
+    fprintf( stderr, "usage: %s%s\n"
+                     "       [--scroll-row n] [--tolerance t] [--assets dir]\n", program, HeightFieldOptions::kUsage );
+}
+
+/**
+ * The GPU noise program of the app, its heights captured by transform feedback
+ */
+static GLuint createProgram( const string &assets )
+{
+    const GLuint vertex = compileShader( GL_VERTEX_SHADER, assets + "/wireframe-noise.vert" );
+    if( ! vertex )
+        return 0;
+    const GLuint program = glCreateProgram();
+    glAttachShader( program, vertex );
+    const char *varyings[] = { "vHeight" };
+    glTransformFeedbackVaryings( program, 1, varyings, GL_INTERLEAVED_ATTRIBS );
+    glLinkProgram( program );
+    glDeleteShader( vertex );
+    GLint linked;
+    glGetProgramiv( program, GL_LINK_STATUS, &linked );
+    if( ! linked ) {
+        char log[4096];
+        glGetProgramInfoLog( program, sizeof( log ), nullptr, log );
+        fprintf( stderr, "GPU noise program: %s\n", log );
+        return 0;
+    }
+    return program;
+}
+
+int main( int argc, char *argv[] )
+{
+    HeightFieldOptions options;
+    bool scrollMode = false;
+    long long scrollRow = 0;
+    float tolerance = 1e-3f;
+    string assets = "../xcode/assets";
+
+    for( int i = 1; i < argc; ++i ) {
+        const int parsed = options.parse( argc, argv, i );
+        if( parsed < 0 )
+            return 1;
+        if( parsed > 0 )
+            continue;
+        const string option = argv[i];
+        if( i + 1 >= argc ) {
+            usage( argv[0] );
+            return 1;
+        }
+        const char *value = argv[++i];
+        if( option == "--scroll-row" ) {
+            scrollMode = true;
+            scrollRow = atoll( value );
+        }
+        else if( option == "--tolerance" )
+            tolerance = (float)atof( value );
+        else if( option == "--assets" )
+            assets = value;
+        else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+    HeightParams &params = options.mParams;
+    if( ! options.valid() || ! ( tolerance >= 0.0f ) ) {
+        usage( argv[0] );
+        return 1;
+    }
+    if( params.mHeightFunction != fractal && params.mHeightFunction != simplex ) {
+        fprintf( stderr, "the GPU noise mode only has the fractal and simplex height functions\n" );
+        return 1;
+    }
+
+    // CPU reference: the heights of the generator, as the app presents them
+    const vector<float> grid = options.prepare();
+    params.mScrollMode = scrollMode;
+    params.mScrollRow = scrollRow;
+    HeightFieldRef field = HeightField::create( grid, grid, params.mNormals );
+    TerrainGeneratorRef terrainGenerator = TerrainGenerator::create();
+    params.mGenerationId = terrainGenerator->getGenerationId();
+    terrainGenerator->run( params, field, HeightFieldGenerator::create( options.mWorkers ) );
+
+    EGLDisplay display;
+    EGLContext context;
+    if( ! createHeadlessContext( display, context ) )
+        return 1;
+    fprintf( stderr, "%s, %s\n", glGetString( GL_RENDERER ), glGetString( GL_VERSION ) );
+    const GLuint program = createProgram( assets );
+    if( ! program )
+        return 1;
+
+    // The shader rebuilds x and z from gl_VertexID and the grid of the field; the z of its rows are offset as
+    // MeshParamTestApp::noiseOffsetZ() does, by the scrolled rows or by the terrain offset
+    const size_t numColumns = field->mGridX.size();
+    const size_t numRows = field->mGridZ.size();
+    const size_t numVertices = numColumns * numRows;
+    const float offsetZ = scrollMode ? float( scrollRow ) * params.mSpacing : float( params.mTerrainOffset );
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    glUseProgram( program );
+    glUniformMatrix4fv( glGetUniformLocation( program, "ciModelViewProjection" ), 1, GL_FALSE, identity );
+    glUniform2f( glGetUniformLocation( program, "uGridOrigin" ), field->mGridX[0], field->mGridZ[0] );
+    glUniform1f( glGetUniformLocation( program, "uGridSpacing" ), params.mSpacing );
+    glUniform1i( glGetUniformLocation( program, "uNumColumns" ), (GLint)numColumns );
+    glUniform1i( glGetUniformLocation( program, "uNumRows" ), (GLint)numRows );
+    glUniform1f( glGetUniformLocation( program, "uNoiseOffsetZ" ), offsetZ );
+    glUniform1i( glGetUniformLocation( program, "uFractal" ), params.mHeightFunction == fractal );
+    glUniform1i( glGetUniformLocation( program, "uOctaves" ), params.mOctaves );
+    glUniform1f( glGetUniformLocation( program, "uFrequency" ), params.mNoiseFrequency );
+    glUniform1f( glGetUniformLocation( program, "uAmplitude" ), params.mNoiseAmplitude );
+    glUniform1f( glGetUniformLocation( program, "uLacunarity" ), params.mNoiseLacunarity );
+    glUniform1f( glGetUniformLocation( program, "uPersistence" ), params.mNoisePersistence );
+    glUniform1i( glGetUniformLocation( program, "uSeededHash" ), params.mNoiseHash == seededHash );
+    glUniform1ui( glGetUniformLocation( program, "uSeed" ), params.mNoiseSeed );
+    glUniform1f( glGetUniformLocation( program, "uHeightMult" ), params.mHeightMult );
+    glUniform1i( glGetUniformLocation( program, "uLighting" ), 0 );
+
+    // The height of every vertex, nothing is drawn; the vertices have no attributes. Without a surface there is no
+    // default framebuffer, and draws need a complete one even with the rasterizer off.
+    GLuint framebuffer, renderbuffer;
+    glGenFramebuffers( 1, &framebuffer );
+    glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+    glGenRenderbuffers( 1, &renderbuffer );
+    glBindRenderbuffer( GL_RENDERBUFFER, renderbuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, 1, 1 );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer );
+    GLuint vao, feedback;
+    glGenVertexArrays( 1, &vao );
+    glBindVertexArray( vao );
+    glGenBuffers( 1, &feedback );
+    glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, feedback );
+    glBufferData( GL_TRANSFORM_FEEDBACK_BUFFER, numVertices * sizeof( float ), nullptr, GL_STATIC_READ );
+    glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedback );
+    glEnable( GL_RASTERIZER_DISCARD );
+    glBeginTransformFeedback( GL_POINTS );
+    glDrawArrays( GL_POINTS, 0, (GLsizei)numVertices );
+    glEndTransformFeedback();
+    glDisable( GL_RASTERIZER_DISCARD );
+
+    const float *gpuHeights = static_cast<const float *>( glMapBufferRange( GL_TRANSFORM_FEEDBACK_BUFFER, 0, numVertices * sizeof( float ), GL_MAP_READ_BIT ) );
+    if( ! gpuHeights ) {
+        fprintf( stderr, "can't read the heights back (GL error 0x%x)\n", glGetError() );
+        return 1;
+    }
+    // row of the plane, wherever the ring of the scroll mode keeps it in the field
+    float maxError = 0.0f;
+    for( size_t row = 0; row < numRows; ++row ) {
+        const float *heights = &field->mHeights[field->rowSlot( row ) * numColumns];
+        for( size_t column = 0; column < numColumns; ++column )
+            maxError = max( maxError, fabsf( heights[column] - gpuHeights[row * numColumns + column] ) );
+    }
+    glUnmapBuffer( GL_TRANSFORM_FEEDBACK_BUFFER );
+    destroyHeadlessContext( display, context );
+
+    const bool pass = maxError <= tolerance * max( 1.0f, fabsf( params.mHeightMult ) );
+    printf( "GPU noise parity over %zu vertices: max error %g (%s)\n", numVertices, maxError, pass ? "pass" : "FAIL" );
+    return pass ? 0 : 1;
+}
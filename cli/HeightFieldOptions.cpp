@@ -0,0 +1,155 @@
+/**
+ * @file    HeightFieldOptions.cpp
+ * @brief   Command line options of the height params, shared by the command line tools.
+ */
+
+#include "HeightFieldOptions.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+const char * const HeightFieldOptions::kUsage =
+    " [--subdivisions n] [--plane-size s] [--function sine|uniform|randnoise|fractal|simplex|graph] [--octaves n]\n"
+    "       [--graph-base name] [--graph-warp s] [--graph-ridge] [--graph-detail name] [--graph-multiply] [--graph-weight w]\n"
+    "       [--graph-clamp low,high]\n"
+    "       [--frequency f] [--amplitude a] [--lacunarity l] [--persistence p] [--hash permutation|seeded] [--seed n]\n"
+    "       [--height-mult m] [--time t] [--normals] [--workers n]";
+
+int findName( const vector<string> &names, const string &name )
+{
+    for( size_t i = 0; i < names.size(); ++i ) {
+        if( names[i] == name || names[i].compare( 0, name.size(), name ) == 0 )
+            return (int)i;
+    }
+    return -1;
+}
+
+HeightFieldOptions::HeightFieldOptions()
+{
+    // the defaults of the app
+    mSubdivisions = 54;
+    mPlaneSize = 26.0f;
+    mTime = 0.0f;
+    mWorkers = 0;
+
+    mParams.mGenerationId = 1;
+    mParams.mNoiseVersion = 0;
+    mParams.mHeightFunction = fractal;
+    mParams.mNoiseHash = permutationHash;
+    mParams.mNoiseSeed = 0;
+    mParams.mOctaves = 7;
+    mParams.mNoiseFrequency = 2.08f;
+    mParams.mNoiseAmplitude = 0.64f;
+    mParams.mNoiseLacunarity = 0.65f;
+    mParams.mNoisePersistence = 1.4f;
+    mParams.mHeightMult = 3.9f;
+    mParams.mNormals = false;
+    mParams.mScrollMode = false;
+    mParams.mTileCache = false;
+    mParams.mScrollRow = 0;
+}
+
+int HeightFieldOptions::parse( int argc, char *argv[], int &i )
+{
+    const string option = argv[i];
+    if( option == "--normals" ) {
+        mParams.mNormals = true;
+        return 1;
+    }
+    if( option == "--graph-ridge" || option == "--graph-multiply" ) {
+        ( option == "--graph-ridge" ? mLayers.mRidge : mLayers.mMultiplyDetail ) = true;
+        return 1;
+    }
+    static const vector<string> valueOptions = { "--subdivisions", "--plane-size", "--function", "--graph-base", "--graph-detail",
+                                                 "--graph-warp", "--graph-weight", "--graph-clamp", "--octaves", "--frequency",
+                                                 "--amplitude", "--lacunarity", "--persistence", "--hash", "--seed", "--height-mult",
+                                                 "--time", "--workers" };
+    bool known = false;
+    for( const auto &valueOption : valueOptions )
+        known = known || option == valueOption;
+    if( ! known )
+        return 0;
+    if( i + 1 >= argc ) {
+        fprintf( stderr, "missing value of %s\n", option.c_str() );
+        return -1;
+    }
+
+    const char *value = argv[++i];
+    if( option == "--subdivisions" )
+        mSubdivisions = atoi( value );
+    else if( option == "--plane-size" )
+        mPlaneSize = (float)atof( value );
+    else if( option == "--function" ) {
+        const int function = findName( heightFunctionNames, value );
+        if( function < 0 ) {
+            fprintf( stderr, "unknown height function %s\n", value );
+            return -1;
+        }
+        mParams.mHeightFunction = HeightFunction( function );
+    }
+    else if( option == "--graph-base" || option == "--graph-detail" ) {
+        const int source = findName( HeightGraph::kSourceNames, value );
+        if( source < 0 ) {
+            fprintf( stderr, "unknown graph source %s\n", value );
+            return -1;
+        }
+        ( option == "--graph-base" ? mLayers.mBase : mLayers.mDetail ) = source;
+    }
+    else if( option == "--graph-warp" )
+        mLayers.mWarp = (float)atof( value );
+    else if( option == "--graph-weight" )
+        mLayers.mDetailWeight = (float)atof( value );
+    else if( option == "--graph-clamp" ) {
+        mLayers.mClamp = sscanf( value, "%f,%f", &mLayers.mClampLow, &mLayers.mClampHigh ) == 2;
+        if( ! mLayers.mClamp ) {
+            fprintf( stderr, "bad clamp range %s\n", value );
+            return -1;
+        }
+    }
+    else if( option == "--octaves" )
+        mParams.mOctaves = atoi( value );
+    else if( option == "--frequency" )
+        mParams.mNoiseFrequency = (float)atof( value );
+    else if( option == "--amplitude" )
+        mParams.mNoiseAmplitude = (float)atof( value );
+    else if( option == "--lacunarity" )
+        mParams.mNoiseLacunarity = (float)atof( value );
+    else if( option == "--persistence" )
+        mParams.mNoisePersistence = (float)atof( value );
+    else if( option == "--hash" ) {
+        const int hash = findName( noiseHashNames, value );
+        if( hash < 0 ) {
+            fprintf( stderr, "unknown hash %s\n", value );
+            return -1;
+        }
+        mParams.mNoiseHash = hash;
+    }
+    else if( option == "--seed" )
+        mParams.mNoiseSeed = atoi( value );
+    else if( option == "--height-mult" )
+        mParams.mHeightMult = (float)atof( value );
+    else if( option == "--time" )
+        mTime = (float)atof( value );
+    else
+        mWorkers = atoi( value );
+    return 1;
+}
+
+vector<float> HeightFieldOptions::prepare()
+{
+    // Same grid as the plane of the app, and the same time offsets
+    const size_t numColumns = size_t( mSubdivisions ) + 1;
+    vector<float> grid( numColumns );
+    for( size_t i = 0; i < numColumns; ++i )
+        grid[i] = mPlaneSize * ( float( i ) / float( mSubdivisions ) - 0.5f );
+    mParams.mSpacing = mPlaneSize / float( mSubdivisions );
+    mParams.mOffset = mTime * 4.0f;
+    mParams.mTerrainOffset = (int)floorf( mTime * 10.0f );
+    mParams.prepareNoise();
+    mParams.mGraph = HeightGraph::makeLayers( mLayers );
+    mParams.prepareKernel();
+    return grid;
+}
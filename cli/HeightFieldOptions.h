@@ -0,0 +1,51 @@
+/**
+ * @file    HeightFieldOptions.h
+ * @brief   Command line options of the height params, shared by the command line tools.
+ */
+
+#pragma once
+
+#include "TerrainGenerator.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Index of \a name, or of the first name it is a prefix of, in \a names; -1 if none
+ */
+int findName( const std::vector<std::string> &names, const std::string &name );
+
+/**
+ * The plane and the height params of the app, with its defaults, set from the command line
+ */
+struct HeightFieldOptions {
+    static const char * const kUsage;   // usage lines of the options, to print after the program name
+
+    HeightFieldOptions();
+
+    /**
+     * Parses argv[i] if it is one of the options, moving i to its value if it has one. Returns 1 if it was
+     * parsed, 0 if it is not one of the options, -1 if its value is missing or bad, the error printed.
+     */
+    int parse( int argc, char *argv[], int &i );
+
+    bool valid() const { return mSubdivisions >= 1 && validParams( mParams ); }
+
+    /**
+     * Whether \a params can be generated: the checks of valid() that only depend on the height params
+     */
+    static bool validParams( const HeightParams &params ) { return params.mOctaves >= 1; }
+
+    /**
+     * Readies mParams for the generation and returns the x of the columns of the plane, which are also the z
+     * of its rows: the grid of the app, centered on the origin, at the time offsets of mTime
+     */
+    std::vector<float> prepare();
+
+    int                 mSubdivisions;
+    float               mPlaneSize;
+    float               mTime;      // seconds: phase of sine, and the scrolling of the other functions
+    int                 mWorkers;   // generation threads, 0 for one per hardware thread
+    HeightGraph::Layers mLayers;
+    HeightParams        mParams;
+};
@@ -0,0 +1,637 @@
+/**
+ * @file    HeightFieldRender.cpp
+ * @brief   Renders frames of the app's wireframe terrain offscreen, without a window nor a display, and writes them to disk.
+ *
+ * The GL context is an EGL one without any surface, see HeadlessGl.h: on Mesa's surfaceless platform (llvmpipe on a
+ * machine without a GPU), else on the first EGL device. The frames are drawn into a framebuffer object with the
+ * shaders of the app, wireframe.vert and wireframe-grid.frag, seen from the camera defaults of
+ * MeshParamTestApp::setupParams(), their heights generated as in the app with the time advancing by 1 / fps every frame.
+ *
+ * The stages overlap: the heights of the next frame are generated while the current one is drawn, the pixels of the
+ * frames drawn are read back asynchronously through a ring of pixel buffers, and a writer thread encodes the frames
+ * read back. At most --readback frames are in the ring and as many wait for the writer, whatever the frame count.
+ *
+ *   c++ -O2 -std=c++11 -pthread -I../xcode -I../include HeightFieldRender.cpp HeadlessGl.cpp HeightFieldOptions.cpp
+ *       ../src/TerrainGenerator.cpp ../src/HeightGraph.cpp ../src/HeightFieldGenerator.cpp ../src/ThreadPool.cpp
+ *       ../src/HeightTileCache.cpp ../src/FrameProfiler.cpp ../xcode/SimplexNoise.cpp ../xcode/SimplexNoiseSimd.cpp
+ *       -lEGL -lOpenGL -lpng -o heightfield-render
+ *
+ * Usage: heightfield-render [heightfield options] [options] -o <output>
+ *   The options of the heightfield, --subdivisions to --workers, are those of HeightFieldCli.cpp; --time is that
+ *   of the first frame.
+ *   --width <w>, --height <h>
+ *                       size of the frames (1280 x 720)
+ *   --frames <n>        frames rendered (300)
+ *   --fps <f>           frames per second of the time offsets (60)
+ *   --format <name>     png or ppm: one image per frame, the output being a printf pattern of the frame number such
+ *                       as frames/%05d.png; raw: the RGB frames one after the other in a single file, - for stdout,
+ *                       for instance piped into ffmpeg -f rawvideo -pix_fmt rgb24 -s 1280x720 -r 60 -i - (png)
+ *   --readback <n>      frames in flight between the draw and the writer (3)
+ *   --assets <dir>      directory of the shaders and of cinder_logo.png (../xcode/assets)
+ *   -o, --output <name> image pattern or raw file
+ *
+ * The frames per second of every stage, from the time spent in it, are printed at the end: generate, draw (height
+ * upload and draw calls, which a software renderer runs right away), gpu (timer queries around the draw and the copy
+ * of its pixels), readback (waits for the pixels and their copy) and write (conversion, encoding and writing). The
+ * slowest stage bounds the frame rate.
+ */
+
+#include "HeightFieldOptions.h"
+
+#include "HeadlessGl.h"
+
+#include <png.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Camera of MeshParamTestApp::setupParams(), and the defaults of its CameraPersp
+static const float kEyePoint[3] = { 23.84f, 22.67f, 34.78f };
+static const float kTarget[3] = { 3.09f, 4.70f, 4.58f };
+static const float kOrientation[4] = { -0.309f, -0.016f, 0.949f, -0.061f };    // w, x, y, z, rotates the plane
+static const float kFieldOfView = 35.0f;    // vertical, in degrees
+static const float kNearClip = 0.1f;
+static const float kFarClip = 1000.0f;
+static const float kClearGray = 0.1f;
+
+// Attribute locations of the shaders
+static const GLuint kHeightAttrib = 0;
+static const GLuint kTexCoordAttrib = 1;
+static const GLuint kNormalAttrib = 2;
+static const GLuint kColorAttrib = 3;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince( Clock::time_point start )
+{
+    return chrono::duration<double>( Clock::now() - start ).count();
+}
+
+static void usage( const char *program )
+{
+    fprintf( stderr, "usage: %s%s\n"
+                     "       [--width w] [--height h] [--frames n] [--fps f] [--format png|ppm|raw] [--readback n] [--assets dir]\n"
+                     "       -o <output>\n", program, HeightFieldOptions::kUsage );
+}
+
+/**
+ * Column-major 4x4 matrices, as GL takes them
+ */
+typedef array<float, 16> Matrix;
+
+static Matrix multiply( const Matrix &a, const Matrix &b )
+{
+    Matrix result;
+    for( int column = 0; column < 4; ++column ) {
+        for( int row = 0; row < 4; ++row ) {
+            float sum = 0.0f;
+            for( int k = 0; k < 4; ++k )
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            result[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+static Matrix perspective( float fieldOfView, float aspectRatio, float nearClip, float farClip )
+{
+    const float f = 1.0f / tanf( 0.5f * fieldOfView * float( M_PI ) / 180.0f );
+    Matrix result = {};
+    result[0] = f / aspectRatio;
+    result[5] = f;
+    result[10] = ( farClip + nearClip ) / ( nearClip - farClip );
+    result[11] = -1.0f;
+    result[14] = 2.0f * farClip * nearClip / ( nearClip - farClip );
+    return result;
+}
+
+static Matrix lookAt( const float *eye, const float *target )
+{
+    // forward, right and up axes, the world up being y
+    float f[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+    const float fLength = sqrtf( f[0] * f[0] + f[1] * f[1] + f[2] * f[2] );
+    for( float &c : f )
+        c /= fLength;
+    float s[3] = { -f[2], 0.0f, f[0] };
+    const float sLength = sqrtf( s[0] * s[0] + s[2] * s[2] );
+    for( float &c : s )
+        c /= sLength;
+    const float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+
+    Matrix result = {};
+    for( int i = 0; i < 3; ++i ) {
+        result[i * 4] = s[i];
+        result[i * 4 + 1] = u[i];
+        result[i * 4 + 2] = -f[i];
+    }
+    result[12] = -( s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2] );
+    result[13] = -( u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2] );
+    result[14] = f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2];
+    result[15] = 1.0f;
+    return result;
+}
+
+/**
+ * Rotation of the unit quaternion \a q, w first, as glm::mat4_cast
+ */
+static Matrix rotation( const float *q )
+{
+    const float w = q[0], x = q[1], y = q[2], z = q[3];
+    Matrix result = {};
+    result[0] = 1.0f - 2.0f * ( y * y + z * z );
+    result[1] = 2.0f * ( x * y + w * z );
+    result[2] = 2.0f * ( x * z - w * y );
+    result[4] = 2.0f * ( x * y - w * z );
+    result[5] = 1.0f - 2.0f * ( x * x + z * z );
+    result[6] = 2.0f * ( y * z + w * x );
+    result[8] = 2.0f * ( x * z + w * y );
+    result[9] = 2.0f * ( y * z - w * x );
+    result[10] = 1.0f - 2.0f * ( x * x + y * y );
+    result[15] = 1.0f;
+    return result;
+}
+
+/**
+ * The wireframe program of the app, without geometry shader
+ */
+static GLuint createProgram( const string &assets )
+{
+    const GLuint vertex = compileShader( GL_VERTEX_SHADER, assets + "/wireframe.vert" );
+    const GLuint fragment = compileShader( GL_FRAGMENT_SHADER, assets + "/wireframe-grid.frag" );
+    if( ! vertex || ! fragment )
+        return 0;
+    const GLuint program = glCreateProgram();
+    glAttachShader( program, vertex );
+    glAttachShader( program, fragment );
+    glBindAttribLocation( program, kHeightAttrib, "aHeight" );
+    glBindAttribLocation( program, kTexCoordAttrib, "ciTexCoord0" );
+    glBindAttribLocation( program, kNormalAttrib, "ciNormal" );
+    glBindAttribLocation( program, kColorAttrib, "ciColor" );
+    glBindFragDataLocation( program, 0, "oColor" );
+    glLinkProgram( program );
+    glDeleteShader( vertex );
+    glDeleteShader( fragment );
+    GLint linked;
+    glGetProgramiv( program, GL_LINK_STATUS, &linked );
+    if( ! linked ) {
+        char log[4096];
+        glGetProgramInfoLog( program, sizeof( log ), nullptr, log );
+        fprintf( stderr, "wireframe program: %s\n", log );
+        return 0;
+    }
+    return program;
+}
+
+/**
+ * The texture of the plane, cinder_logo.png, its top row first as the app loads it; white if it can't be read
+ */
+static GLuint createTexture( const string &assets )
+{
+    const string path = assets + "/cinder_logo.png";
+    png_image image;
+    memset( &image, 0, sizeof( image ) );
+    image.version = PNG_IMAGE_VERSION;
+    vector<uint8_t> pixels;
+    if( png_image_begin_read_from_file( &image, path.c_str() ) ) {
+        image.format = PNG_FORMAT_RGBA;
+        pixels.resize( PNG_IMAGE_SIZE( image ) );
+        if( ! png_image_finish_read( &image, nullptr, pixels.data(), 0, nullptr ) )
+            pixels.clear();
+    }
+    if( pixels.empty() ) {
+        fprintf( stderr, "can't read %s, the plane is white\n", path.c_str() );
+        image.width = image.height = 1;
+        pixels.assign( 4, 255 );
+    }
+
+    GLuint texture;
+    glGenTextures( 1, &texture );
+    glBindTexture( GL_TEXTURE_2D, texture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei)image.width, (GLsizei)image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data() );
+    glGenerateMipmap( GL_TEXTURE_2D );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    return texture;
+}
+
+/**
+ * Encodes and writes the frames read back, on a thread of its own. Its frame buffers are few: acquire() waits for
+ * one when they are all queued, which bounds the memory and slows the render down to the writing.
+ */
+class FrameWriter {
+  public:
+    FrameWriter( const string &format, const string &output, int width, int height, size_t numBuffers )
+        : mFormat( format ), mOutput( output ), mWidth( width ), mHeight( height ), mFile( nullptr ),
+          mFailed( false ), mStop( false ), mSeconds( 0.0 )
+    {
+        mBuffers.resize( numBuffers );
+        for( auto &buffer : mBuffers ) {
+            buffer.resize( size_t( width ) * size_t( height ) * 4 );
+            mFree.push_back( &buffer );
+        }
+        if( mFormat == "raw" ) {
+            mFile = ( mOutput == "-" ) ? stdout : fopen( mOutput.c_str(), "wb" );
+            mFailed = ! mFile;
+        }
+        mThread = thread( &FrameWriter::run, this );
+    }
+
+    ~FrameWriter()
+    {
+        finish();
+    }
+
+    /**
+     * A buffer for the RGBA pixels of a frame, bottom row first as GL reads them
+     */
+    vector<uint8_t>* acquire()
+    {
+        unique_lock<mutex> lock( mMutex );
+        mCondition.wait( lock, [this] { return ! mFree.empty(); } );
+        vector<uint8_t> *buffer = mFree.front();
+        mFree.pop_front();
+        return buffer;
+    }
+
+    void push( int frame, vector<uint8_t> *pixels )
+    {
+        lock_guard<mutex> lock( mMutex );
+        mQueue.push_back( make_pair( frame, pixels ) );
+        mCondition.notify_all();
+    }
+
+    /**
+     * Waits for the frames queued to be written, returns false if one of them couldn't be
+     */
+    bool finish()
+    {
+        {
+            lock_guard<mutex> lock( mMutex );
+            mStop = true;
+            mCondition.notify_all();
+        }
+        if( mThread.joinable() )
+            mThread.join();
+        if( mFile ) {
+            mFailed = ( ( mFile == stdout ) ? fflush( mFile ) : fclose( mFile ) ) != 0 || mFailed;
+            mFile = nullptr;
+        }
+        return ! mFailed;
+    }
+
+    double getSeconds() const { return mSeconds; }
+
+  private:
+    void run()
+    {
+        vector<uint8_t> rgb( size_t( mWidth ) * size_t( mHeight ) * 3 );
+        for( ;; ) {
+            pair<int, vector<uint8_t> *> frame;
+            {
+                unique_lock<mutex> lock( mMutex );
+                mCondition.wait( lock, [this] { return mStop || ! mQueue.empty(); } );
+                if( mQueue.empty() )
+                    return;
+                frame = mQueue.front();
+                mQueue.pop_front();
+            }
+
+            // flipped to the top row first, without the alpha of the wireframe
+            const auto start = Clock::now();
+            const size_t rowBytes = size_t( mWidth ) * 3;
+            const uint8_t *pixels = frame.second->data();
+            for( int y = 0; y < mHeight; ++y ) {
+                const uint8_t *source = pixels + size_t( mHeight - 1 - y ) * size_t( mWidth ) * 4;
+                uint8_t *destination = &rgb[size_t( y ) * rowBytes];
+                for( int x = 0; x < mWidth; ++x ) {
+                    destination[3 * x] = source[4 * x];
+                    destination[3 * x + 1] = source[4 * x + 1];
+                    destination[3 * x + 2] = source[4 * x + 2];
+                }
+            }
+            {
+                lock_guard<mutex> lock( mMutex );
+                mFree.push_back( frame.second );
+                mCondition.notify_all();
+            }
+            if( ! mFailed && ! write( frame.first, rgb ) ) {
+                fprintf( stderr, "can't write frame %d\n", frame.first );
+                mFailed = true;
+            }
+            mSeconds += secondsSince( start );
+        }
+    }
+
+    bool write( int frame, const vector<uint8_t> &rgb )
+    {
+        if( mFormat == "raw" )
+            return fwrite( rgb.data(), 1, rgb.size(), mFile ) == rgb.size();
+
+        char path[4096];
+        snprintf( path, sizeof( path ), mOutput.c_str(), frame );
+        if( mFormat == "png" ) {
+            png_image image;
+            memset( &image, 0, sizeof( image ) );
+            image.version = PNG_IMAGE_VERSION;
+            image.width = (png_uint_32)mWidth;
+            image.height = (png_uint_32)mHeight;
+            image.format = PNG_FORMAT_RGB;
+            return png_image_write_to_file( &image, path, 0, rgb.data(), 0, nullptr ) != 0;
+        }
+        FILE *file = fopen( path, "wb" );
+        if( ! file )
+            return false;
+        fprintf( file, "P6\n%d %d\n255\n", mWidth, mHeight );
+        const bool written = fwrite( rgb.data(), 1, rgb.size(), file ) == rgb.size();
+        return ( fclose( file ) == 0 ) && written;
+    }
+
+    string                  mFormat, mOutput;
+    int                     mWidth, mHeight;
+    FILE                    *mFile;     // of the raw format
+    bool                    mFailed;
+
+    mutex                   mMutex;
+    condition_variable      mCondition;
+    vector<vector<uint8_t>> mBuffers;
+    deque<vector<uint8_t> *> mFree;
+    deque<pair<int, vector<uint8_t> *>> mQueue;
+    bool                    mStop;
+    double                  mSeconds;   // only touched by the writer thread until finish()
+    thread                  mThread;
+};
+
+/**
+ * A frame drawn whose pixels are read back into mPixelBuffer, ready once mFence is signaled
+ */
+struct Readback {
+    GLuint      mPixelBuffer;
+    GLuint      mQuery;     // GL_TIME_ELAPSED of the draw
+    GLsync      mFence;
+    int         mFrame;
+};
+
+int main( int argc, char *argv[] )
+{
+    HeightFieldOptions options;
+    int width = 1280;
+    int height = 720;
+    int frames = 300;
+    float framesPerSecond = 60.0f;
+    string format = "png";
+    int numReadbacks = 3;
+    string assets = "../xcode/assets";
+    string output;
+
+    for( int i = 1; i < argc; ++i ) {
+        const int parsed = options.parse( argc, argv, i );
+        if( parsed < 0 )
+            return 1;
+        if( parsed > 0 )
+            continue;
+        const string option = argv[i];
+        if( i + 1 >= argc ) {
+            usage( argv[0] );
+            return 1;
+        }
+        const char *value = argv[++i];
+        if( option == "--width" )
+            width = atoi( value );
+        else if( option == "--height" )
+            height = atoi( value );
+        else if( option == "--frames" )
+            frames = atoi( value );
+        else if( option == "--fps" )
+            framesPerSecond = (float)atof( value );
+        else if( option == "--format" )
+            format = value;
+        else if( option == "--readback" )
+            numReadbacks = atoi( value );
+        else if( option == "--assets" )
+            assets = value;
+        else if( option == "-o" || option == "--output" )
+            output = value;
+        else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+    const bool raw = ( format == "raw" );
+    if( output.empty() || ! options.valid() || width < 1 || height < 1 || frames < 1 || ! ( framesPerSecond > 0.0f ) || numReadbacks < 1
+        || ( format != "png" && format != "ppm" && ! raw ) || ( ! raw && output.find( '%' ) == string::npos ) ) {
+        usage( argv[0] );
+        return 1;
+    }
+
+    EGLDisplay display;
+    EGLContext context;
+    if( ! createHeadlessContext( display, context ) )
+        return 1;
+    fprintf( stderr, "%s, %s\n", glGetString( GL_RENDERER ), glGetString( GL_VERSION ) );
+    const GLuint program = createProgram( assets );
+    if( ! program )
+        return 1;
+    const GLuint texture = createTexture( assets );
+
+    // The plane of the app: its heights, and normals, are streamed every frame, x and z are rebuilt by the
+    // vertex shader from gl_VertexID; the quad row closing the ring of the scroll mode isn't needed
+    const vector<float> grid = options.prepare();
+    HeightParams &params = options.mParams;
+    const int subdivisions = options.mSubdivisions;
+    const size_t numColumns = grid.size();
+    const size_t numVertices = numColumns * numColumns;
+    vector<float> texCoords( 2 * numVertices );
+    vector<uint32_t> indices;
+    indices.reserve( size_t( 6 ) * size_t( subdivisions ) * size_t( subdivisions ) );
+    for( size_t row = 0; row < numColumns; ++row ) {
+        for( size_t column = 0; column < numColumns; ++column ) {
+            texCoords[2 * ( row * numColumns + column )] = float( column ) / float( subdivisions );
+            texCoords[2 * ( row * numColumns + column ) + 1] = float( row ) / float( subdivisions );
+            if( row < size_t( subdivisions ) && column < size_t( subdivisions ) ) {
+                const uint32_t i = uint32_t( row * numColumns + column );
+                const uint32_t j = i + uint32_t( numColumns );
+                indices.insert( indices.end(), { i, i + 1, j, j, i + 1, j + 1 } );
+            }
+        }
+    }
+
+    GLuint vao, buffers[4];
+    glGenVertexArrays( 1, &vao );
+    glBindVertexArray( vao );
+    glGenBuffers( 4, buffers );
+    const GLuint heightBuffer = buffers[0], normalBuffer = buffers[1];
+    glBindBuffer( GL_ARRAY_BUFFER, heightBuffer );
+    glBufferData( GL_ARRAY_BUFFER, numVertices * sizeof( float ), nullptr, GL_STREAM_DRAW );
+    glVertexAttribPointer( kHeightAttrib, 1, GL_FLOAT, GL_FALSE, 0, nullptr );
+    glEnableVertexAttribArray( kHeightAttrib );
+    if( params.mNormals ) {
+        glBindBuffer( GL_ARRAY_BUFFER, normalBuffer );
+        glBufferData( GL_ARRAY_BUFFER, numVertices * sizeof( HeightNormal ), nullptr, GL_STREAM_DRAW );
+        glVertexAttribPointer( kNormalAttrib, 3, GL_FLOAT, GL_FALSE, 0, nullptr );
+        glEnableVertexAttribArray( kNormalAttrib );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, buffers[2] );
+    glBufferData( GL_ARRAY_BUFFER, texCoords.size() * sizeof( float ), texCoords.data(), GL_STATIC_DRAW );
+    glVertexAttribPointer( kTexCoordAttrib, 2, GL_FLOAT, GL_FALSE, 0, nullptr );
+    glEnableVertexAttribArray( kTexCoordAttrib );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, buffers[3] );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW );
+    // the app has no COLOR stream either, ciColor is the current color
+    glVertexAttrib4f( kColorAttrib, 1.0f, 1.0f, 1.0f, 1.0f );
+
+    glUseProgram( program );
+    const Matrix modelViewProjection = multiply( multiply( perspective( kFieldOfView, float( width ) / float( height ), kNearClip, kFarClip ),
+                                                           lookAt( kEyePoint, kTarget ) ), rotation( kOrientation ) );
+    glUniformMatrix4fv( glGetUniformLocation( program, "ciModelViewProjection" ), 1, GL_FALSE, modelViewProjection.data() );
+    glUniform2f( glGetUniformLocation( program, "uGridOrigin" ), grid[0], grid[0] );
+    glUniform1f( glGetUniformLocation( program, "uGridSpacing" ), params.mSpacing );
+    glUniform1i( glGetUniformLocation( program, "uNumColumns" ), (GLint)numColumns );
+    glUniform1i( glGetUniformLocation( program, "uNumRows" ), (GLint)numColumns );
+    glUniform1i( glGetUniformLocation( program, "uRingBaseRow" ), 0 );
+    glUniform1i( glGetUniformLocation( program, "uLighting" ), params.mNormals );
+    glUniform1i( glGetUniformLocation( program, "uHeightsInTexture" ), 0 );
+    glUniform1i( glGetUniformLocation( program, "uHeightTexture" ), 1 );
+    glUniform1i( glGetUniformLocation( program, "uHeightOffset" ), 0 );
+    glUniform1i( glGetUniformLocation( program, "uTexture" ), 0 );
+    glActiveTexture( GL_TEXTURE0 );
+    glBindTexture( GL_TEXTURE_2D, texture );
+
+    GLuint framebuffer, renderbuffers[2];
+    glGenFramebuffers( 1, &framebuffer );
+    glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+    glGenRenderbuffers( 2, renderbuffers );
+    glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[0] );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0] );
+    glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[1] );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1] );
+    if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+        fprintf( stderr, "can't render to a %dx%d framebuffer\n", width, height );
+        return 1;
+    }
+    glViewport( 0, 0, width, height );
+    glEnable( GL_DEPTH_TEST );
+    glClearColor( kClearGray, kClearGray, kClearGray, 1.0f );
+    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+
+    const size_t frameBytes = size_t( width ) * size_t( height ) * 4;
+    vector<Readback> readbacks( (size_t)numReadbacks );
+    for( auto &readback : readbacks ) {
+        glGenBuffers( 1, &readback.mPixelBuffer );
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, readback.mPixelBuffer );
+        glBufferData( GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ );
+        glGenQueries( 1, &readback.mQuery );
+        readback.mFence = nullptr;
+        readback.mFrame = -1;
+    }
+    FrameWriter writer( format, output, width, height, size_t( numReadbacks ) );
+
+    // Heights of the next frame, generated into the other field while the current one is drawn
+    HeightFieldRef fields[2] = { HeightField::create( grid, grid, params.mNormals ), HeightField::create( grid, grid, params.mNormals ) };
+    TerrainGeneratorRef terrainGenerator = TerrainGenerator::create();
+    HeightFieldGeneratorRef generator = HeightFieldGenerator::create( options.mWorkers );
+    const float startTime = options.mTime;
+    auto generate = [&]( int frame ) {
+        const auto start = Clock::now();
+        // the app moves the sine phase by 4 and the terrain by one unit every 0.1 s
+        const float time = startTime + float( frame ) / framesPerSecond;
+        params.mOffset = time * 4.0f;
+        params.mTerrainOffset = (int)floorf( time * 10.0f );
+        params.mGenerationId = terrainGenerator->getGenerationId();
+        terrainGenerator->run( params, fields[frame & 1], generator );
+        return secondsSince( start );
+    };
+
+    double generateSeconds = 0.0, drawSeconds = 0.0, gpuSeconds = 0.0, readbackSeconds = 0.0;
+    // Waits for the pixels of the frame in \a readback and hands them to the writer
+    auto retire = [&]( Readback &readback ) {
+        const auto start = Clock::now();
+        while( glClientWaitSync( readback.mFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) == GL_TIMEOUT_EXPIRED )
+            ;
+        glDeleteSync( readback.mFence );
+        readback.mFence = nullptr;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v( readback.mQuery, GL_QUERY_RESULT, &elapsed );
+        gpuSeconds += double( elapsed ) * 1e-9;
+        readbackSeconds += secondsSince( start );
+
+        // the wait for a free buffer is the writer's time, not the readback's
+        vector<uint8_t> *pixels = writer.acquire();
+        const auto copyStart = Clock::now();
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, readback.mPixelBuffer );
+        const void *mapped = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT );
+        if( mapped )
+            memcpy( pixels->data(), mapped, frameBytes );
+        glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+        writer.push( readback.mFrame, pixels );
+        readbackSeconds += secondsSince( copyStart );
+    };
+
+    const auto start = Clock::now();
+    future<double> generation = async( launch::async, generate, 0 );
+    for( int frame = 0; frame < frames; ++frame ) {
+        generateSeconds += generation.get();
+        const HeightField &field = *fields[frame & 1];
+        Readback &readback = readbacks[size_t( frame ) % readbacks.size()];
+        if( readback.mFence )
+            retire( readback );
+
+        const auto drawStart = Clock::now();
+        glBindBuffer( GL_ARRAY_BUFFER, heightBuffer );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, numVertices * sizeof( float ), field.mHeights.data() );
+        if( params.mNormals ) {
+            glBindBuffer( GL_ARRAY_BUFFER, normalBuffer );
+            glBufferSubData( GL_ARRAY_BUFFER, 0, numVertices * sizeof( HeightNormal ), field.mNormals.data() );
+        }
+        // the heights are copied, the field is free for the frame after the next one
+        if( frame + 1 < frames )
+            generation = async( launch::async, generate, frame + 1 );
+
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+        glBeginQuery( GL_TIME_ELAPSED, readback.mQuery );
+        glDrawElements( GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, nullptr );
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, readback.mPixelBuffer );
+        glReadPixels( 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+        glEndQuery( GL_TIME_ELAPSED );
+        readback.mFence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+        readback.mFrame = frame;
+        glFlush();
+        drawSeconds += secondsSince( drawStart );
+    }
+    for( int frame = max( frames - numReadbacks, 0 ); frame < frames; ++frame )
+        retire( readbacks[size_t( frame ) % readbacks.size()] );
+    const bool written = writer.finish();
+    const double seconds = secondsSince( start );
+
+    fprintf( stderr, "%d frames of %dx%d, %zu x %zu vertices, in %.2f s: %.1f fps\n", frames, width, height, numColumns, numColumns,
+             seconds, double( frames ) / seconds );
+    const char * const stageNames[] = { "generate", "draw", "gpu", "readback", "write" };
+    const double stageSeconds[] = { generateSeconds, drawSeconds, gpuSeconds, readbackSeconds, writer.getSeconds() };
+    for( size_t i = 0; i < 5; ++i ) {
+        fprintf( stderr, "  %-9s %9.1f fps %8.2f ms/frame\n", stageNames[i], stageSeconds[i] > 0.0 ? double( frames ) / stageSeconds[i] : 0.0,
+                 1000.0 * stageSeconds[i] / double( frames ) );
+    }
+
+    destroyHeadlessContext( display, context );
+    if( ! written ) {
+        fprintf( stderr, "can't write %s\n", output.c_str() );
+        return 1;
+    }
+    return 0;
+}
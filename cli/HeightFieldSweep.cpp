@@ -0,0 +1,436 @@
+/**
+ * @file    HeightFieldSweep.cpp
+ * @brief   Generates a heightfield for every set of a sweep of the noise params, in parallel, and writes the statistics of each to CSV.
+ *
+ * The sets are the product of the values of every --sweep, applied to each line of the --sets list, or to the
+ * heightfield options alone without a list. Every worker thread generates one heightfield at a time on its own, into
+ * a field of its own with a SimplexNoise of its own, rather than splitting each heightfield over the threads, which
+ * small ones don't keep busy. The memory doesn't depend on the number of sets: the sets are enumerated, and the list
+ * read, as the workers take them, and each row is written as soon as the rows of the sets before it are.
+ *
+ *   c++ -O2 -std=c++11 -pthread -I../xcode -I../include HeightFieldSweep.cpp HeightFieldOptions.cpp ../src/TerrainGenerator.cpp
+ *       ../src/HeightGraph.cpp ../src/HeightFieldGenerator.cpp ../src/ThreadPool.cpp ../src/HeightTileCache.cpp ../src/FrameProfiler.cpp
+ *       ../xcode/SimplexNoise.cpp ../xcode/SimplexNoiseSimd.cpp -o heightfield-sweep
+ *
+ * Usage: heightfield-sweep [heightfield options] [--sweep name=values]... [--sets file] [-o file]
+ *   The options of the heightfield, --subdivisions to --workers, are those of HeightFieldCli.cpp and give the params
+ *   that aren't swept; --workers is the number of heightfields generated at once.
+ *   --sweep <name>=<values>
+ *                       values of a param, <first>:<last>:<count> evenly spaced or <v1>,<v2>,... The params are
+ *                       frequency, amplitude, lacunarity, persistence, octaves, height-mult and seed.
+ *   --sets <file>       CSV list of sets: a header naming the params of its columns, then a set per line
+ *   -o, --output <file> CSV written, - for stdout (-)
+ *
+ * Every set is checked as the heightfield options are, at least one octave for instance: an invalid value of a
+ * --sweep is rejected before anything is generated, and an invalid set of the list stops the sweep as a bad line does.
+ *
+ * Columns written: the index of the set, its params, then the min, max, mean and standard deviation of its heights,
+ * their roughness, the root mean square of the slopes between neighbor samples, and the generation time in ms.
+ */
+
+#include "HeightFieldOptions.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Params that can be swept, as named on the command line and in the lists
+enum SweepParam { FREQUENCY, AMPLITUDE, LACUNARITY, PERSISTENCE, OCTAVES, HEIGHT_MULT, SEED, NUM_SWEEP_PARAMS };
+static const vector<string> kParamNames = { "frequency", "amplitude", "lacunarity", "persistence", "octaves", "height-mult", "seed" };
+
+// Sets taken by the workers ahead of the first one not written yet, per worker
+static const size_t kSetsAheadPerWorker = 4;
+
+typedef array<double, NUM_SWEEP_PARAMS> SweepSet;
+
+struct SweepAxis {
+    int             mParam;
+    vector<double>  mValues;
+};
+
+static void usage( const char *program )
+{
+    fprintf( stderr, "usage: %s%s\n"
+                     "       [--sweep name=first:last:count|name=v1,v2,...]... [--sets file] [-o file]\n", program, HeightFieldOptions::kUsage );
+}
+
+static SweepSet getSet( const HeightParams &params )
+{
+    SweepSet set;
+    set[FREQUENCY] = params.mNoiseFrequency;
+    set[AMPLITUDE] = params.mNoiseAmplitude;
+    set[LACUNARITY] = params.mNoiseLacunarity;
+    set[PERSISTENCE] = params.mNoisePersistence;
+    set[OCTAVES] = params.mOctaves;
+    set[HEIGHT_MULT] = params.mHeightMult;
+    set[SEED] = params.mNoiseSeed;
+    return set;
+}
+
+static void setParams( const SweepSet &set, HeightParams &params )
+{
+    params.mNoiseFrequency = (float)set[FREQUENCY];
+    params.mNoiseAmplitude = (float)set[AMPLITUDE];
+    params.mNoiseLacunarity = (float)set[LACUNARITY];
+    params.mNoisePersistence = (float)set[PERSISTENCE];
+    params.mOctaves = (int)lround( set[OCTAVES] );
+    params.mHeightMult = (float)set[HEIGHT_MULT];
+    params.mNoiseSeed = (int)lround( set[SEED] );
+}
+
+/**
+ * Whether \a set, over the params that aren't swept, passes the checks of the heightfield options
+ */
+static bool validSet( const SweepSet &set, const HeightParams &params )
+{
+    HeightParams checked = params;
+    setParams( set, checked );
+    return HeightFieldOptions::validParams( checked );
+}
+
+/**
+ * Sets the params of \a set and prepares the noise and the kernel for them
+ */
+static void applySet( const SweepSet &set, HeightParams &params )
+{
+    setParams( set, params );
+    params.prepareNoise();
+    params.prepareKernel();
+}
+
+/**
+ * Parses <name>=<first>:<last>:<count> or <name>=<v1>,<v2>,...
+ */
+static bool parseAxis( const string &text, SweepAxis &axis )
+{
+    const size_t equal = text.find( '=' );
+    if( equal == string::npos )
+        return false;
+    axis.mParam = findName( kParamNames, text.substr( 0, equal ) );
+    if( axis.mParam < 0 || equal == 0 )
+        return false;
+    const string values = text.substr( equal + 1 );
+    double first, last;
+    int count;
+    char end;
+    if( sscanf( values.c_str(), "%lf:%lf:%d%c", &first, &last, &count, &end ) == 3 ) {
+        if( count < 1 )
+            return false;
+        for( int i = 0; i < count; ++i )
+            axis.mValues.push_back( count > 1 ? first + ( last - first ) * double( i ) / double( count - 1 ) : first );
+        return true;
+    }
+    const char *value = values.c_str();
+    for( ;; ) {
+        char *next;
+        axis.mValues.push_back( strtod( value, &next ) );
+        if( next == value || ( *next != ',' && *next != '\0' ) )
+            return false;
+        if( *next == '\0' )
+            return true;
+        value = next + 1;
+    }
+}
+
+/**
+ * The sets of the sweep in order, the grid of the axes over each line of the list, read as they are taken, over
+ * the swept params of \a params. A set the heightfield options would reject stops the sweep, as a bad line does.
+ */
+class SweepSets {
+  public:
+    SweepSets( const HeightParams &params, const vector<SweepAxis> &axes )
+        : mParams( params ), mBase( getSet( params ) ), mAxes( axes ), mList( nullptr ), mLine( 0 ), mNext( 0 ), mFailed( false )
+    {
+        mGridSize = 1;
+        for( const auto &axis : mAxes )
+            mGridSize *= axis.mValues.size();
+    }
+
+    ~SweepSets()
+    {
+        if( mList )
+            fclose( mList );
+    }
+
+    /**
+     * Opens the list at \a path and reads its header, returns false if it can't
+     */
+    bool openList( const string &path )
+    {
+        mList = fopen( path.c_str(), "r" );
+        string header;
+        if( ! mList || ! readLine( header ) ) {
+            fprintf( stderr, "can't read %s\n", path.c_str() );
+            return false;
+        }
+        size_t begin = 0;
+        for( ;; ) {
+            const size_t comma = header.find( ',', begin );
+            string name = header.substr( begin, comma == string::npos ? string::npos : comma - begin );
+            name.erase( 0, name.find_first_not_of( " \t" ) );
+            name.erase( name.find_last_not_of( " \t\r" ) + 1 );
+            const int param = findName( kParamNames, name );
+            if( param < 0 || name.empty() ) {
+                fprintf( stderr, "%s: unknown param %s\n", path.c_str(), name.c_str() );
+                return false;
+            }
+            mColumns.push_back( param );
+            if( comma == string::npos )
+                return true;
+            begin = comma + 1;
+        }
+    }
+
+    /**
+     * Next set and its index, false once they are all taken or if the list has a bad line. Not thread-safe.
+     */
+    bool next( SweepSet &set, uint64_t &index )
+    {
+        if( mFailed )
+            return false;
+        const uint64_t gridIndex = mNext % mGridSize;
+        if( gridIndex == 0 ) {
+            // a new line of the list, or the only pass over the grid without one
+            if( mList ) {
+                if( ! readSet( mLineSet ) )
+                    return false;
+            }
+            else if( mNext > 0 ) {
+                return false;
+            }
+            else {
+                mLineSet = mBase;
+            }
+        }
+
+        // the last axis varies fastest
+        set = mLineSet;
+        uint64_t remainder = gridIndex;
+        for( size_t i = mAxes.size(); i-- > 0; ) {
+            set[mAxes[i].mParam] = mAxes[i].mValues[remainder % mAxes[i].mValues.size()];
+            remainder /= mAxes[i].mValues.size();
+        }
+        if( ! validSet( set, mParams ) ) {
+            if( mList )
+                fprintf( stderr, "invalid set %llu, on line %zu\n", (unsigned long long)mNext, mLine );
+            else
+                fprintf( stderr, "invalid set %llu\n", (unsigned long long)mNext );
+            mFailed = true;
+            return false;
+        }
+        index = mNext++;
+        return true;
+    }
+
+    bool failed() const { return mFailed; }
+
+  private:
+    bool readLine( string &line )
+    {
+        line.clear();
+        int c;
+        while( ( c = fgetc( mList ) ) != EOF && c != '\n' )
+            line.push_back( (char)c );
+        mLine++;
+        return c != EOF || ! line.empty();
+    }
+
+    bool readSet( SweepSet &set )
+    {
+        string line;
+        do {
+            if( ! readLine( line ) )
+                return false;
+        } while( line.find_first_not_of( " \t\r" ) == string::npos );
+
+        set = mBase;
+        const char *value = line.c_str();
+        for( size_t i = 0; i < mColumns.size(); ++i ) {
+            char *next;
+            set[mColumns[i]] = strtod( value, &next );
+            const bool last = ( i + 1 == mColumns.size() );
+            while( *next == ' ' || *next == '\t' || *next == '\r' )
+                ++next;
+            if( next == value || ( last ? *next != '\0' : *next != ',' ) ) {
+                fprintf( stderr, "bad set on line %zu: %s\n", mLine, line.c_str() );
+                mFailed = true;
+                return false;
+            }
+            value = next + 1;
+        }
+        return true;
+    }
+
+    HeightParams        mParams;
+    SweepSet            mBase;
+    vector<SweepAxis>   mAxes;
+    uint64_t            mGridSize;
+    FILE                *mList;
+    vector<int>         mColumns;   // param of each column of the list
+    size_t              mLine;
+    SweepSet            mLineSet;   // set of the current line of the list
+    uint64_t            mNext;
+    bool                mFailed;
+};
+
+int main( int argc, char *argv[] )
+{
+    HeightFieldOptions options;
+    vector<SweepAxis> axes;
+    string listPath;
+    string output = "-";
+
+    for( int i = 1; i < argc; ++i ) {
+        const int parsed = options.parse( argc, argv, i );
+        if( parsed < 0 )
+            return 1;
+        if( parsed > 0 )
+            continue;
+        const string option = argv[i];
+        if( i + 1 >= argc ) {
+            usage( argv[0] );
+            return 1;
+        }
+        const char *value = argv[++i];
+        if( option == "--sweep" ) {
+            SweepAxis axis;
+            if( ! parseAxis( value, axis ) ) {
+                fprintf( stderr, "bad sweep %s\n", value );
+                return 1;
+            }
+            axes.push_back( axis );
+        }
+        else if( option == "--sets" )
+            listPath = value;
+        else if( option == "-o" || option == "--output" )
+            output = value;
+        else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ! options.valid() ) {
+        usage( argv[0] );
+        return 1;
+    }
+    // the values of the axes are checked before anything is generated, the lines of the list as they are read
+    for( const auto &axis : axes ) {
+        for( double value : axis.mValues ) {
+            SweepSet set = getSet( options.mParams );
+            set[axis.mParam] = value;
+            if( ! validSet( set, options.mParams ) ) {
+                fprintf( stderr, "invalid %s %g in the sweep\n", kParamNames[axis.mParam].c_str(), value );
+                return 1;
+            }
+        }
+    }
+
+    const vector<float> grid = options.prepare();
+    SweepSets sets( options.mParams, axes );
+    if( ! listPath.empty() && ! sets.openList( listPath ) )
+        return 1;
+    FILE *file = ( output == "-" ) ? stdout : fopen( output.c_str(), "w" );
+    if( ! file ) {
+        fprintf( stderr, "can't write %s\n", output.c_str() );
+        return 1;
+    }
+    fprintf( file, "set" );
+    for( const auto &name : kParamNames )
+        fprintf( file, ",%s", name.c_str() );
+    fprintf( file, ",min,max,mean,stddev,roughness,generate_ms\n" );
+
+    // The rows done before those of earlier sets wait in pending; the workers don't take a set more than
+    // setsAhead after the first one not written, which bounds them
+    ThreadPoolRef pool = ThreadPool::create( size_t( max( options.mWorkers, 0 ) ) );
+    const size_t numWorkers = pool->getNumThreads();
+    const uint64_t setsAhead = kSetsAheadPerWorker * numWorkers;
+    TerrainGeneratorRef terrainGenerator = TerrainGenerator::create();
+    mutex setsMutex;
+    condition_variable written;
+    map<uint64_t, string> pending;
+    uint64_t numWritten = 0, numTaken = 0;
+    bool failedWrite = false;
+
+    const auto start = chrono::steady_clock::now();
+    pool->parallelFor( numWorkers, [&]( size_t ) {
+        // a field, noise and kernel of its own, the heights generated on this thread alone
+        HeightParams params = options.mParams;
+        HeightFieldRef field = HeightField::create( grid, grid, false );
+        HeightFieldGeneratorRef generator = HeightFieldGenerator::create( 1 );
+        const size_t numColumns = grid.size();
+        for( ;; ) {
+            SweepSet set;
+            uint64_t index;
+            {
+                unique_lock<mutex> lock( setsMutex );
+                written.wait( lock, [&] { return numTaken < numWritten + setsAhead; } );
+                if( failedWrite || ! sets.next( set, index ) )
+                    return;
+                numTaken++;
+            }
+
+            const auto generateStart = chrono::steady_clock::now();
+            applySet( set, params );
+            params.mGenerationId = terrainGenerator->getGenerationId();
+            terrainGenerator->run( params, field, generator );
+            const double generateMs = chrono::duration<double, milli>( chrono::steady_clock::now() - generateStart ).count();
+
+            // the slopes between the neighbors along x, then along z
+            const vector<float> &heights = field->mHeights;
+            float low = heights[0], high = heights[0];
+            double sum = 0.0, sumSquares = 0.0, slopeSquares = 0.0;
+            for( size_t i = 0; i < heights.size(); ++i ) {
+                low = min( low, heights[i] );
+                high = max( high, heights[i] );
+                sum += heights[i];
+                sumSquares += double( heights[i] ) * heights[i];
+                const double dx = ( i % numColumns + 1 < numColumns ) ? heights[i + 1] - heights[i] : 0.0;
+                const double dz = ( i + numColumns < heights.size() ) ? heights[i + numColumns] - heights[i] : 0.0;
+                slopeSquares += dx * dx + dz * dz;
+            }
+            const double count = double( heights.size() );
+            const double mean = sum / count;
+            const double variance = max( sumSquares / count - mean * mean, 0.0 );
+            const double numSlopes = 2.0 * double( numColumns ) * double( numColumns - 1 );
+            const double roughness = sqrt( slopeSquares / numSlopes ) / params.mSpacing;
+
+            char row[512];
+            int length = snprintf( row, sizeof( row ), "%llu", (unsigned long long)index );
+            for( double value : set )
+                length += snprintf( row + length, sizeof( row ) - length, ",%.7g", value );
+            snprintf( row + length, sizeof( row ) - length, ",%.9g,%.9g,%.9g,%.9g,%.9g,%.3f\n", low, high, mean, sqrt( variance ),
+                      roughness, generateMs );
+
+            lock_guard<mutex> lock( setsMutex );
+            pending[index] = row;
+            for( auto it = pending.begin(); it != pending.end() && it->first == numWritten; it = pending.erase( it ) ) {
+                failedWrite = failedWrite || fputs( it->second.c_str(), file ) < 0;
+                numWritten++;
+            }
+            written.notify_all();
+        }
+    } );
+    const double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+    const bool closed = ( file == stdout ) ? fflush( file ) == 0 : fclose( file ) == 0;
+    if( sets.failed() )
+        return 1;
+    if( failedWrite || ! closed ) {
+        fprintf( stderr, "can't write %s\n", output.c_str() );
+        return 1;
+    }
+    fprintf( stderr, "%llu sets of %zu x %zu samples on %zu threads in %.2f s: %.1f sets/s\n", (unsigned long long)numWritten, grid.size(),
+             grid.size(), numWorkers, seconds, double( numWritten ) / seconds );
+    return 0;
+}
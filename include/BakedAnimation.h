@@ -0,0 +1,135 @@
+#pragma once
+
+#include "TerrainGenerator.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Header at the start of a baked animation file, little-endian. A table of mNumFrames BakedFrameEntry
+//! follows it, then the frames. Every frame is compressed on its own: its heights are quantized to 16 bits
+//! over the range of the frame, predicted from their left, upper and upper left neighbors, and the residuals
+//! stored as zigzag varints. Identical consecutive frames share their data.
+struct BakedAnimationHeader {
+    char        mMagic[8];      // "MPTANIM", nul terminated
+    uint32_t    mVersion;
+    uint32_t    mNumColumns;
+    uint32_t    mNumRows;
+    uint32_t    mNumFrames;
+    float       mFramesPerSecond;
+    float       mOriginX;       // x of the first column, z of the first row at the first frame
+    float       mOriginZ;
+    float       mSpacing;
+    // Params the frames were generated with, see HeightParams
+    int32_t     mHeightFunction;
+    int32_t     mNoiseHash;
+    int32_t     mNoiseSeed;
+    int32_t     mOctaves;
+    float       mNoiseFrequency;
+    float       mNoiseAmplitude;
+    float       mNoiseLacunarity;
+    float       mNoisePersistence;
+    float       mHeightMult;
+    uint32_t    mReserved;
+};
+
+//! Where the data of a frame is in the file: the height range, then the residuals
+struct BakedFrameEntry {
+    uint64_t    mOffset;
+    uint64_t    mBytes;
+};
+
+typedef std::shared_ptr<class BakedAnimationWriter> BakedAnimationWriterRef;
+
+//! Writes the frames of a baked animation one at a time
+class BakedAnimationWriter {
+  public:
+    //! Header of an animation of \a numFrames frames of \a field at \a framesPerSecond, generated from \a params
+    static BakedAnimationHeader makeHeader( const HeightParams &params, const HeightField &field, size_t numFrames, float framesPerSecond );
+    //! Creates the file at \a path, returns null if it can't be written
+    static BakedAnimationWriterRef create( const std::string &path, const BakedAnimationHeader &header );
+    ~BakedAnimationWriter();
+    
+    //! Generates \a numFrames frames of \a field at \a framesPerSecond and writes them to \a path. The offsets of
+    //! \a params advance from frame to frame as the app advances them over time, without scrolling nor normals.
+    //! \a progressFn, when set, is called after each frame with the frames done and stops the bake if it returns
+    //! false. Returns false if the file can't be written or the bake is stopped.
+    static bool bake( const std::string &path, HeightParams params, const HeightFieldRef &field, size_t numFrames, float framesPerSecond,
+                      const HeightFieldGeneratorRef &generator, const std::function<bool( size_t )> &progressFn = nullptr );
+    
+    //! Appends the next frame, mNumColumns x mNumRows heights row by row; returns false on a write error
+    bool        addFrame( const float *heights );
+    //! Writes the frame table once every frame is added, returns false if a frame is missing or on a write error
+    bool        finish();
+    
+    size_t      getNumFramesAdded() const { return mEntries.size(); }
+    //! Frames stored, those equal to their previous frame share its data
+    size_t      getNumFramesStored() const { return mNumStored; }
+    uint64_t    getBytesWritten() const { return mOffset; }
+    
+  private:
+    BakedAnimationWriter( FILE *file, const BakedAnimationHeader &header );
+    
+    FILE                            *mFile;
+    BakedAnimationHeader            mHeader;
+    std::vector<BakedFrameEntry>    mEntries;
+    std::vector<uint8_t>            mData, mLastData;
+    uint64_t                        mOffset;
+    size_t                          mNumStored;
+    bool                            mFailed;
+};
+
+typedef std::shared_ptr<class BakedAnimationPlayer> BakedAnimationPlayerRef;
+
+//! Plays a baked animation back: a background I/O thread reads and decodes the frames ahead of the one
+//! asked for, into a few slots, so that the caller only copies decoded heights. Frames are numbered from
+//! the start of the playback and loop over the animation.
+class BakedAnimationPlayer {
+  public:
+    //! Opens the animation at \a path and starts decoding its first \a readAhead frames, returns null if it
+    //! can't be read or isn't a baked animation
+    static BakedAnimationPlayerRef open( const std::string &path, size_t readAhead = 4 );
+    ~BakedAnimationPlayer();
+    
+    const BakedAnimationHeader &getHeader() const { return mHeader; }
+    
+    //! Returns the heights of frame \a frame, or null when it isn't decoded yet. The heights stay valid until the
+    //! next call; the frames after it are decoded meanwhile. Asking for an earlier frame, or one far ahead, seeks.
+    const float*    getFrame( uint64_t frame );
+    
+    //! Calls to getFrame() for a frame not decoded yet; only getFrame() changes it, call it from the same thread
+    uint64_t    getNumLateFrames() const { return mNumLateFrames; }
+    
+  private:
+    BakedAnimationPlayer( FILE *file, const BakedAnimationHeader &header, std::vector<BakedFrameEntry> entries, size_t readAhead );
+    
+    enum SlotState { FREE, DECODING, READY, IN_USE };
+    struct Slot {
+        SlotState           mState;
+        uint64_t            mFrame;
+        std::vector<float>  mHeights;
+    };
+    
+    void        decodeFrames();
+    bool        decodeFrame( uint64_t frame, std::vector<uint8_t> &data, std::vector<float> &heights );
+    
+    FILE                            *mFile;     // only read by the I/O thread
+    BakedAnimationHeader            mHeader;
+    std::vector<BakedFrameEntry>    mEntries;
+    size_t                          mReadAhead;
+    
+    std::mutex                      mMutex;
+    std::condition_variable         mCondition;
+    std::vector<Slot>               mSlots;
+    uint64_t                        mWanted;        // frame asked for last
+    uint64_t                        mNextDecode;    // next frame for the I/O thread
+    uint64_t                        mNumLateFrames;
+    bool                            mStop;
+    std::thread                     mThread;
+};
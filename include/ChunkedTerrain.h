@@ -0,0 +1,97 @@
+#pragma once
+
+#include "HeightFieldGenerator.h"
+
+#include "cinder/gl/Batch.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/Vbo.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+typedef std::shared_ptr<class ChunkedTerrain> ChunkedTerrainRef;
+
+//! Square terrain split into chunks along a quadtree. Every chunk, whatever its level, is a grid of
+//! kChunkQuads x kChunkQuads quads, so the resolution doubles with each level: the chunks drawn are
+//! picked from their distance to the eye, and those outside of the view frustum are neither generated
+//! nor drawn. Chunks of different levels meet with T-junctions, the cracks are hidden by skirts hanging
+//! from the chunk edges. Heights are generated on the CPU by a HeightFn, and kept in a LRU of chunks.
+//!
+//! The vertex shader rebuilds x and z from gl_VertexID, see terrain-chunk.vert: grid vertices first, row
+//! by row, then the skirt vertices along the edges z min, z max, x min and x max.
+class ChunkedTerrain {
+  public:
+    //! Quads along each side of a chunk
+    static const int kChunkQuads = 64;
+    
+    //! Evaluates the \a count heights at (\a x[n], \a z[n]), \a spacing being the distance between the vertices of the chunk
+    typedef std::function<void( const float *x, const float *z, float *heights, size_t count, float spacing )> HeightFn;
+    
+    //! Creates a terrain drawn with \a shader, which must be a terrain-chunk.vert program
+    static ChunkedTerrainRef create( const ci::gl::GlslProgRef &shader ) { return ChunkedTerrainRef( new ChunkedTerrain( shader ) ); }
+    
+    //! Side of the terrain, centered on the origin
+    void        setSize( float size );
+    float       getSize() const { return mSize; }
+    //! Deepest level of the quadtree: the finest resolution is kChunkQuads << maxDepth quads along a side
+    void        setMaxDepth( int maxDepth );
+    int         getMaxDepth() const { return mMaxDepth; }
+    //! A chunk is split when the eye is closer than \a lodFactor times its size
+    void        setLodFactor( float lodFactor ) { mLodFactor = lodFactor; }
+    //! Largest absolute height, bounds the chunks for the culling and sizes the skirts
+    void        setHeightBound( float heightBound );
+    
+    //! Drops every chunk, to call when the heights change
+    void        clear();
+    //! Draws with \a shader from now on, also a terrain-chunk.vert program
+    void        setShader( const ci::gl::GlslProgRef &shader );
+    
+    //! Selects the chunks to draw for the eye at \a eye (object space) and the \a viewProjection matrix (object space to clip space),
+    //! then generates the missing ones on \a generator
+    void        update( const ci::mat4 &viewProjection, const ci::vec3 &eye, const HeightFieldGeneratorRef &generator, const HeightFn &heightFn );
+    //! Draws the chunks selected by the last update()
+    void        draw();
+    
+    size_t      getNumDrawn() const { return mSelected.size(); }
+    size_t      getNumCulled() const { return mNumCulled; }
+    size_t      getNumGenerated() const { return mNumGenerated; }
+    size_t      getNumCached() const { return mChunks.size(); }
+    
+  private:
+    explicit ChunkedTerrain( const ci::gl::GlslProgRef &shader );
+    
+    struct Node {
+        int         mDepth;
+        int64_t     mX, mZ;     // position of the chunk among the 2^depth x 2^depth chunks of its level
+        uint64_t    getKey() const { return ( uint64_t( mDepth ) << 58 ) | ( uint64_t( mX ) << 29 ) | uint64_t( mZ ); }
+    };
+    
+    struct Chunk {
+        ci::gl::VboRef      mHeights;
+        ci::gl::BatchRef    mBatch;
+        uint64_t            mLastUsed;  // last update() that selected it
+    };
+    
+    void        select( const Node &node, const ci::vec4 *planes, const ci::vec3 &eye );
+    float       getChunkSize( int depth ) const { return mSize / float( int64_t( 1 ) << depth ); }
+    ci::vec2    getChunkOrigin( const Node &node ) const;
+    void        generateHeights( const Node &node, const HeightFn &heightFn, std::vector<float> &heights ) const;
+    void        evict();
+    
+    ci::gl::GlslProgRef     mShader;
+    ci::gl::VboRef          mIndices;   // shared by every chunk, grid then skirts
+    uint32_t                mNumIndices;
+    float                   mSize;
+    int                     mMaxDepth;
+    float                   mLodFactor;
+    float                   mHeightBound;
+    
+    std::unordered_map<uint64_t, Chunk> mChunks;
+    std::vector<Node>       mSelected;
+    uint64_t                mFrame;
+    size_t                  mNumCulled;
+    size_t                  mNumGenerated;
+};
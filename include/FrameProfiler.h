@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+//! Compile-time switch of the stage timers: with MESH_PROFILING defined to 0, PROFILE_STAGE expands to nothing
+#ifndef MESH_PROFILING
+#define MESH_PROFILING 1
+#endif
+
+#define PROFILE_STAGE_CONCAT_( a, b ) a##b
+#define PROFILE_STAGE_CONCAT( a, b ) PROFILE_STAGE_CONCAT_( a, b )
+
+#if MESH_PROFILING
+//! Times the rest of the enclosing scope as the stage \a name (a string literal) of \a profiler
+#define PROFILE_STAGE( profiler, name ) FrameProfiler::Scope PROFILE_STAGE_CONCAT( profileStage, __LINE__ )( profiler, name )
+#else
+#define PROFILE_STAGE( profiler, name )
+#endif
+
+typedef std::shared_ptr<class FrameProfiler> FrameProfilerRef;
+
+//! Records how long the stages of the frames take, from any thread, into a lock-free ring of the most
+//! recent samples. Writers claim a slot with one atomic increment and publish it with a sequence number,
+//! so recording never blocks; readers copy the ring and skip the slots being written meanwhile.
+//! Stages are named by string literals, which must outlive the profiler.
+class FrameProfiler {
+  public:
+    //! One timed stage: start and duration in nanoseconds since the profiler creation
+    struct Sample {
+        const char  *mStage;
+        uint32_t    mThread;    // small id of the recording thread, in order of their first sample
+        int64_t     mStartNs;
+        int64_t     mDurationNs;
+    };
+    
+    //! Duration percentiles of a stage over the samples in the ring, in milliseconds
+    struct Stats {
+        const char  *mStage;
+        size_t      mCount;
+        double      mP50, mP95, mP99;
+    };
+    
+    //! Times a scope, see PROFILE_STAGE
+    class Scope {
+      public:
+        Scope( const FrameProfilerRef &profiler, const char *stage )
+            : mProfiler( profiler.get() ), mStage( stage ), mStart( profiler ? profiler->now() : 0 ) {}
+        ~Scope() { if( mProfiler ) mProfiler->record( mStage, mStart, mProfiler->now() - mStart ); }
+    
+      private:
+        Scope( const Scope & ) = delete;
+        Scope &operator=( const Scope & ) = delete;
+    
+        FrameProfiler   *mProfiler;
+        const char      *mStage;
+        int64_t         mStart;
+    };
+    
+    //! Creates a profiler keeping the last \a capacity samples, rounded up to a power of two
+    static FrameProfilerRef create( size_t capacity = 8192 ) { return FrameProfilerRef( new FrameProfiler( capacity ) ); }
+    
+    //! Nanoseconds since the profiler creation
+    int64_t     now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - mEpoch ).count(); }
+    //! Adds a sample, lock-free and safe from any thread
+    void        record( const char *stage, int64_t startNs, int64_t durationNs );
+    
+    //! Copies the samples in the ring, oldest first
+    std::vector<Sample> getSamples() const;
+    //! Percentiles of \a stage over the samples in the ring
+    Stats       getStats( const char *stage ) const;
+    //! Percentiles of every stage of \a samples, in order of their first sample
+    static std::vector<Stats> computeStats( const std::vector<Sample> &samples );
+    
+    //! Writes the samples in the ring as a Chrome trace (chrome://tracing, Perfetto), returns false if the file can't be written
+    bool        writeChromeTrace( const std::string &path ) const;
+    //! Writes the samples in the ring as CSV: stage, thread, start and duration in microseconds
+    bool        writeCsv( const std::string &path ) const;
+    
+    size_t      getCapacity() const { return mSlots.size(); }
+    //! Samples recorded since the creation, including those overwritten since
+    uint64_t    getNumRecorded() const { return mHead.load( std::memory_order_relaxed ); }
+    
+  private:
+    explicit FrameProfiler( size_t capacity );
+    
+    // Sample fields are atomics so that a reader racing a writer is well defined; mSequence is 2 * index + 2
+    // once the sample of record index is complete, odd while it is written.
+    struct Slot {
+        std::atomic<uint64_t>       mSequence;
+        std::atomic<const char *>   mStage;
+        std::atomic<uint32_t>       mThread;
+        std::atomic<int64_t>        mStartNs;
+        std::atomic<int64_t>        mDurationNs;
+    };
+    
+    static uint32_t threadId();
+    
+    std::chrono::steady_clock::time_point   mEpoch;
+    std::vector<Slot>       mSlots;
+    size_t                  mMask;
+    std::atomic<uint64_t>   mHead;      // index of the next record
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "TerrainGenerator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+//! Type of the samples of a heightfield file. uint16 samples are quantized over [mHeightMin, mHeightMax].
+enum HeightElementType : uint32_t { HEIGHT_FLOAT32, HEIGHT_FLOAT16, HEIGHT_UINT16 };
+
+//! Header at the start of a heightfield file, little-endian. The samples follow at mDataOffset, page
+//! aligned, as mNumTilesX x mNumTilesZ square tiles of mTileSize x mTileSize samples, tile rows first;
+//! inside a tile the samples are row by row, and the tiles over the last columns or rows are padded.
+struct HeightFieldFileHeader {
+    char        mMagic[8];      // "MPTHFLD", nul terminated
+    uint32_t    mVersion;
+    uint32_t    mElementType;   // HeightElementType
+    uint32_t    mNumColumns;
+    uint32_t    mNumRows;
+    uint32_t    mTileSize;
+    uint32_t    mNumTilesX;
+    uint32_t    mNumTilesZ;
+    uint32_t    mReserved;
+    uint64_t    mDataOffset;
+    uint64_t    mTileBytes;
+    float       mOriginX;       // x of the first column, z of the first row
+    float       mOriginZ;
+    float       mSpacing;       // distance between two columns or rows
+    float       mHeightMin;     // range of the heights
+    float       mHeightMax;
+    // Params the heights were generated with, see HeightParams
+    int32_t     mHeightFunction;
+    int32_t     mNoiseHash;
+    int32_t     mNoiseSeed;
+    int32_t     mOctaves;
+    float       mNoiseFrequency;
+    float       mNoiseAmplitude;
+    float       mNoiseLacunarity;
+    float       mNoisePersistence;
+    float       mHeightMult;
+    float       mOffset;
+    int32_t     mTerrainOffset;
+    int64_t     mScrollRow;
+};
+
+typedef std::shared_ptr<class HeightFieldFile> HeightFieldFileRef;
+
+//! Tiled binary heightfield, written from the rows of a generated field and read back through a read-only
+//! memory mapping: opening only checks the header, the samples are paged in by the kernel as they are
+//! read, and getTile() points straight into the mapping.
+class HeightFieldFile {
+  public:
+    //! Returns the samples of row \a row of the field, row-major from the first column
+    typedef std::function<const float *( size_t row )> RowFn;
+    
+    static const uint32_t kVersion = 1;
+    static const uint32_t kDefaultTileSize = 64;
+    
+    //! Header of a \a numColumns x \a numRows field of \a type samples generated from \a params, the range of
+    //! the heights left to write()
+    static HeightFieldFileHeader makeHeader( const HeightParams &params, size_t numColumns, size_t numRows, float originX, float originZ,
+                                             HeightElementType type, uint32_t tileSize = kDefaultTileSize );
+    //! Header of \a field, generated from \a params
+    static HeightFieldFileHeader makeHeader( const HeightParams &params, const HeightField &field, HeightElementType type, uint32_t tileSize = kDefaultTileSize );
+    //! Writes the rows given by \a rowFn as a file of \a header, returns false if the file can't be written
+    static bool     write( const std::string &path, const HeightFieldFileHeader &header, const RowFn &rowFn );
+    //! Writes the displayed rows of \a field, in their displayed order when it is scrolled as a ring
+    static bool     write( const std::string &path, const HeightFieldFileHeader &header, const HeightField &field );
+    
+    //! Maps the file at \a path, returns null if it can't be opened or isn't a valid heightfield file
+    static HeightFieldFileRef open( const std::string &path );
+    ~HeightFieldFile();
+    
+    const HeightFieldFileHeader &getHeader() const { return *mHeader; }
+    size_t          getNumColumns() const { return mHeader->mNumColumns; }
+    size_t          getNumRows() const { return mHeader->mNumRows; }
+    //! Samples of tile (\a tileX, \a tileZ) in the mapping, mTileSize x mTileSize of getHeader().mElementType
+    const void*     getTile( size_t tileX, size_t tileZ ) const;
+    //! Copies rows [\a rowBegin, \a rowEnd) to \a dst, row-major with getNumColumns() samples per row, as
+    //! float32 or float16; \a dst can be a mapped GL buffer. Samples of the same type are copied as is.
+    void            readRows( size_t rowBegin, size_t rowEnd, void *dst, HeightElementType dstType ) const;
+    
+    static size_t   getElementSize( HeightElementType type ) { return ( type == HEIGHT_FLOAT32 ) ? 4 : 2; }
+    
+  private:
+    HeightFieldFile( void *data, size_t size );
+    
+    void                        *mData;
+    size_t                      mSize;
+    const HeightFieldFileHeader *mHeader;
+};
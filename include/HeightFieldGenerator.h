@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <functional>
+
+typedef std::shared_ptr<class HeightFieldGenerator> HeightFieldGeneratorRef;
+
+//! Splits the rows of a height field into bands and generates them in parallel on a ThreadPool.
+//! The generator only decides the partitioning: what a band computes, and where it writes, is up to
+//! the band function, which must only touch the rows it is given.
+class HeightFieldGenerator {
+  public:
+    //! Called with the half-open range of rows [rowBegin, rowEnd) of one band
+    typedef std::function<void( size_t rowBegin, size_t rowEnd )> BandFn;
+    
+    //! Creates a generator running on \a numWorkers threads, 0 means one per hardware thread
+    static HeightFieldGeneratorRef create( size_t numWorkers = 0 ) { return HeightFieldGeneratorRef( new HeightFieldGenerator( numWorkers ) ); }
+    
+    //! Number of threads generating the bands, the calling one included
+    size_t  getNumWorkers() const { return mPool->getNumThreads(); }
+    //! Restarts the worker threads, 0 means one per hardware thread
+    void    setNumWorkers( size_t numWorkers );
+    
+    //! Generates rows [0, \a numRows) by calling \a bandFn on bands of at least \a minRowsPerBand rows, returns once all are done.
+    void    generateRows( size_t numRows, const BandFn &bandFn, size_t minRowsPerBand = 4 );
+    
+  private:
+    explicit HeightFieldGenerator( size_t numWorkers );
+    
+    ThreadPoolRef   mPool;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HeightParams;
+
+//! One node of a HeightGraph. Sources read the position, scaled by mScale and shifted by mShift before they
+//! evaluate; operations read the nodes of mInputs, earlier in the graph.
+struct HeightNode {
+    enum Op {
+        CONSTANT,   // mValue
+        SINE,       // mValue * sin( mFrequencyX * x + offset ) + mValueZ * cos( mFrequencyZ * z + offset ), offset being HeightParams::mOffset
+        SIMPLEX,    // simplex noise of the params
+        FRACTAL,    // fBm of the params, over its octaves
+        RANDOM,     // uniform in [0, 1), hashed from the noise seed, the position and the terrain offset
+        ADD,        // input 0 + input 1
+        MUL,        // input 0 * input 1
+        WARP,       // input 0 evaluated at the position moved by mValue * input 1 along both axes
+        CLAMP,      // input 0 clamped to [mValue, mValueZ]
+        RIDGE       // 1 - | input 0 |
+    };
+    
+    Op      mOp;
+    int     mInputs[2];
+    float   mValue, mValueZ;
+    float   mFrequencyX, mFrequencyZ;
+    float   mScale, mShift;
+};
+
+//! Height function made of nodes: sources of heights, and operations combining them. Built by adding the
+//! nodes inputs first; the node added last is the output. Compiled into a HeightKernel to be evaluated.
+class HeightGraph {
+  public:
+    static const std::vector<std::string> kSourceNames;    // names of the sources, in HeightNode::Op order
+    
+    //! Layers of the graphs built from the params: a base source, domain warped by simplex noise at half its
+    //! frequency, ridged, combined with a weighted detail source, then clamped
+    struct Layers {
+        Layers() : mBase( HeightNode::FRACTAL ), mWarp( 0.0f ), mRidge( false ), mDetail( -1 ), mMultiplyDetail( false ),
+            mDetailWeight( 0.25f ), mClamp( false ), mClampLow( -1.0f ), mClampHigh( 1.0f ) {}
+    
+        int     mBase;          // kSourceNames index
+        float   mWarp;          // warp strength, 0 for none
+        bool    mRidge;
+        int     mDetail;        // kSourceNames index, -1 for none
+        bool    mMultiplyDetail;    // the detail multiplies the base instead of adding to it
+        float   mDetailWeight;
+        bool    mClamp;
+        float   mClampLow, mClampHigh;
+    };
+    static HeightGraph  makeLayers( const Layers &layers );
+    
+    int         constant( float value );
+    int         sine( float amplitudeX, float frequencyX, float amplitudeZ, float frequencyZ );
+    int         simplex( float scale = 1.0f, float shift = 0.0f );
+    int         fractal( float scale = 1.0f, float shift = 0.0f );
+    int         random();
+    //! Source of kSourceNames index \a source, the sine one with the waves of the sine height function and the
+    //! constant one at 1
+    int         source( int source );
+    int         add( int a, int b );
+    int         mul( int a, int b );
+    //! Domain warp: \a source evaluated at the position moved by \a strength times \a offset
+    int         warp( int source, int offset, float strength );
+    int         clamp( int a, float low, float high );
+    int         ridge( int a );
+    
+    const std::vector<HeightNode>&  getNodes() const { return mNodes; }
+    bool        empty() const { return mNodes.empty(); }
+    
+  private:
+    int         addNode( const HeightNode &node );
+    
+    std::vector<HeightNode> mNodes;
+};
+
+typedef std::shared_ptr<const class HeightKernel> HeightKernelRef;
+
+//! A HeightGraph compiled to a flat program over registers of kBlockSize samples. evaluate() runs the whole
+//! program on one block of samples before moving to the next, so that the intermediate values of the nodes
+//! stay in the cache and each height is written once, instead of a pass over the row per node. Immutable,
+//! shared by the generation threads.
+class HeightKernel {
+  public:
+    static const size_t kBlockSize = 128;
+    
+    //! Compiles \a graph, its output being the node added last. Nodes under a warp are compiled once per
+    //! position they are evaluated at.
+    static HeightKernelRef compile( const HeightGraph &graph );
+    
+    //! Evaluates the heights at (\a x[n], \a z[n]) with the noise and time offset of \a params, and their partial
+    //! derivatives when \a dx and \a dz aren't null
+    void        evaluate( const HeightParams &params, const float *x, const float *z, float *heights, float *dx, float *dz, size_t count ) const;
+    
+    size_t      getNumInstructions() const { return mInstructions.size(); }
+    
+  private:
+    HeightKernel() : mNumRegisters( 0 ), mNumPositions( 1 ) {}
+    
+    // Values go to register mOutput, read from mInputs; sources and warps read position mPosition, and a
+    // warp writes position mOutputPosition
+    struct Instruction {
+        HeightNode  mNode;
+        int         mOutput;
+        int         mInputs[2];
+        int         mPosition;
+        int         mOutputPosition;
+    };
+    
+    int         compileNode( const HeightGraph &graph, int node, int position, std::vector<std::vector<int>> &registers );
+    template <typename Noise, typename Fractal>
+    void        evaluateBlock( const HeightParams &params, const Noise &noise, const Fractal &fractalNoise, const float *x, const float *z,
+                               float *heights, float *dx, float *dz, size_t count, float *scratch ) const;
+    
+    std::vector<Instruction>    mInstructions;
+    int                         mNumRegisters;
+    int                         mNumPositions;
+    int                         mOutput;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//! Identifies a tile of height samples: everything the samples depend on, and the tile position.
+//! Samples are on a regular lattice, sample (i, j) of the tile being at
+//! x = mOriginX + ( mTileX * size + i ) * mSpacing, z = mOriginZ + ( mTileZ * size + j ) * mSpacing.
+//! With mDerivatives the tile holds the d/dx then the d/dz samples after the height samples.
+struct HeightTileKey {
+    int         mHeightFunction;
+    int         mOctaves;
+    bool        mDerivatives;
+    int         mHash;
+    uint32_t    mSeed;
+    float       mFrequency;
+    float       mAmplitude;
+    float       mLacunarity;
+    float       mPersistence;
+    float       mSpacing;
+    float       mOriginX;
+    float       mOriginZ;
+    int64_t     mTileX;
+    int64_t     mTileZ;
+    
+    bool operator==( const HeightTileKey &other ) const;
+};
+
+struct HeightTileKeyHasher {
+    size_t operator()( const HeightTileKey &key ) const;
+};
+
+typedef std::shared_ptr<class HeightTileCache> HeightTileCacheRef;
+
+//! Bounded LRU cache of square tiles of height samples. Tiles are shared and immutable once inserted,
+//! so a tile found by a caller stays valid even if the cache evicts it meanwhile. Thread-safe.
+class HeightTileCache {
+  public:
+    //! Samples per tile side
+    static const int kTileSize = 64;
+    
+    typedef std::shared_ptr<const std::vector<float>> TileRef;
+    
+    //! Creates a cache holding at most \a budgetBytes of samples
+    static HeightTileCacheRef create( size_t budgetBytes ) { return HeightTileCacheRef( new HeightTileCache( budgetBytes ) ); }
+    
+    //! Returns the tile for \a key and marks it as most recently used, or an empty TileRef on a miss
+    TileRef     find( const HeightTileKey &key );
+    //! Adds (or replaces) the tile for \a key, evicting the least recently used tiles beyond the budget
+    void        insert( const HeightTileKey &key, const TileRef &tile );
+    void        clear();
+    
+    size_t      getBudget() const { return mBudget; }
+    void        setBudget( size_t budgetBytes );
+    size_t      getMemoryUsage() const;
+    size_t      getNumTiles() const;
+    
+    uint64_t    getNumHits() const;
+    uint64_t    getNumMisses() const;
+    uint64_t    getNumEvictions() const;
+    void        resetStats();
+    
+  private:
+    explicit HeightTileCache( size_t budgetBytes );
+    
+    void        evict();
+    
+    typedef std::list<std::pair<HeightTileKey, TileRef>> TileList;
+    
+    mutable std::mutex  mMutex;
+    TileList            mTiles;     // most recently used first
+    std::unordered_map<HeightTileKey, TileList::iterator, HeightTileKeyHasher> mIndex;
+    size_t              mBudget;
+    size_t              mMemoryUsage;
+    uint64_t            mNumHits;
+    uint64_t            mNumMisses;
+    uint64_t            mNumEvictions;
+};
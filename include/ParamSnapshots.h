@@ -0,0 +1,88 @@
+#pragma once
+
+#include "TerrainGenerator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+typedef std::shared_ptr<class ParamSnapshots> ParamSnapshotsRef;
+
+//! Immutable, versioned copies of the height params, published by one thread (the params callbacks) and
+//! read by any number of others (the generation jobs) without locks. publish() swaps the current snapshot
+//! with an atomic exchange; the replaced one is retired, and deleted once no reader can still hold it.
+//!
+//! Reclamation is epoch based: a reader announces the epoch it started in, in one of kMaxReaders slots,
+//! before loading the current snapshot, and clears its slot when done. Each publish() advances the epoch,
+//! so a snapshot retired at epoch e can only be held by readers that announced an epoch up to e: once every
+//! announced epoch is past e, nobody holds it.
+class ParamSnapshots {
+  public:
+    static const size_t kMaxReaders = 64;
+    
+    //! A snapshot held by a reader: it stays valid, and unchanged, until the Reader is destroyed
+    class Reader {
+      public:
+        Reader( Reader &&other );
+        ~Reader();
+    
+        const HeightParams& operator*() const { return *mParams; }
+        const HeightParams* operator->() const { return mParams; }
+        //! Version of the snapshot, one more for every publish()
+        uint64_t            getVersion() const { return mVersion; }
+    
+      private:
+        friend class ParamSnapshots;
+        Reader( std::atomic<uint64_t> *slot, const HeightParams *params, uint64_t version ) : mSlot( slot ), mParams( params ), mVersion( version ) {}
+        Reader( const Reader & ) = delete;
+        Reader& operator=( const Reader & ) = delete;
+    
+        std::atomic<uint64_t>   *mSlot;
+        const HeightParams      *mParams;
+        uint64_t                mVersion;
+    };
+    
+    //! Creates the snapshots with \a params as version 1
+    static ParamSnapshotsRef create( const HeightParams &params ) { return ParamSnapshotsRef( new ParamSnapshots( params ) ); }
+    //! The readers must all be gone
+    ~ParamSnapshots();
+    
+    //! Makes \a params the current snapshot and returns its version. Only ever called from one thread;
+    //! it also deletes the retired snapshots no reader holds anymore.
+    uint64_t    publish( const HeightParams &params );
+    //! The current snapshot, from any thread, without locks. Only waits when kMaxReaders readers already hold one.
+    Reader      acquire();
+    
+    //! Version of the current snapshot
+    uint64_t    getVersion() const { return mVersion.load(); }
+    //! Replaced snapshots some reader may still hold, from the publishing thread
+    size_t      getNumRetired() const { return mRetired.size(); }
+    
+  private:
+    struct Snapshot {
+        HeightParams    mParams;
+        uint64_t        mVersion;
+        uint64_t        mRetiredEpoch;
+    };
+    
+    //! A reader slot: the epoch its reader started in, 0 when free. Padded to a cache line so that readers
+    //! on different threads don't write to the same line.
+    struct ReaderSlot {
+        std::atomic<uint64_t>   mEpoch;
+        char                    mPadding[64 - sizeof( std::atomic<uint64_t> )];
+    };
+    
+    explicit ParamSnapshots( const HeightParams &params );
+    ParamSnapshots( const ParamSnapshots & ) = delete;
+    ParamSnapshots& operator=( const ParamSnapshots & ) = delete;
+    
+    void                    reclaim();
+    
+    std::atomic<Snapshot*>  mCurrent;
+    std::atomic<uint64_t>   mVersion;
+    std::atomic<uint64_t>   mEpoch;
+    ReaderSlot              mSlots[kMaxReaders];
+    std::vector<Snapshot*>  mRetired;   // owned by the publishing thread
+};
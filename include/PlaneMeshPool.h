@@ -0,0 +1,58 @@
+#pragma once
+
+#include "cinder/gl/Vbo.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+typedef std::shared_ptr<class PlaneMeshPool> PlaneMeshPoolRef;
+
+//! Keeps the GL buffers of the plane across size changes. What only depends on the subdivision count
+//! (the indices, ring closing row included, and the tex coords) is built once per count and kept in a
+//! small LRU; the per-vertex dynamic buffers are recycled whenever a released one is large enough.
+class PlaneMeshPool {
+  public:
+    //! Static part of a plane of a given subdivision count, shared and immutable
+    struct Grid {
+        int                 mSubdivisions;
+        ci::gl::VboRef      mIndices;       // GL_UNSIGNED_INT triangles, followed by the quad row closing the ring
+        uint32_t            mNumIndices;
+        ci::gl::VboRef      mTexCoords;     // vec2 per vertex
+        std::vector<float>  mUnitX;         // x of each column of a plane of size 1
+        std::vector<float>  mUnitZ;         // z of each row of a plane of size 1
+    
+        uint32_t            getNumColumns() const { return (uint32_t)mUnitX.size(); }
+        uint32_t            getNumRows() const { return (uint32_t)mUnitZ.size(); }
+        uint32_t            getNumVertices() const { return getNumColumns() * getNumRows(); }
+    };
+    typedef std::shared_ptr<const Grid> GridRef;
+    
+    //! Creates a pool keeping the grids of at most \a maxGrids subdivision counts
+    static PlaneMeshPoolRef create( size_t maxGrids = 8 ) { return PlaneMeshPoolRef( new PlaneMeshPool( maxGrids ) ); }
+    
+    //! Returns the grid of \a subdivisions, built on the first request and marked as most recently used
+    GridRef         getGrid( int subdivisions );
+    
+    //! Returns a buffer for \a target of at least \a bytes, a released one when one is large enough
+    ci::gl::VboRef  acquireBuffer( GLenum target, size_t bytes, GLenum usage = GL_DYNAMIC_DRAW );
+    //! Gives a buffer back for later acquireBuffer() calls, null buffers are ignored
+    void            releaseBuffer( const ci::gl::VboRef &vbo );
+    
+    uint64_t        getNumGridBuilds() const { return mNumGridBuilds; }
+    uint64_t        getNumBufferAllocations() const { return mNumBufferAllocations; }
+    uint64_t        getNumBufferReuses() const { return mNumBufferReuses; }
+    
+  private:
+    explicit PlaneMeshPool( size_t maxGrids );
+    
+    GridRef         buildGrid( int subdivisions ) const;
+    
+    size_t                      mMaxGrids;
+    std::list<GridRef>          mGrids;         // most recently used first
+    std::vector<ci::gl::VboRef> mFreeBuffers;
+    uint64_t                    mNumGridBuilds;
+    uint64_t                    mNumBufferAllocations;
+    uint64_t                    mNumBufferReuses;
+};
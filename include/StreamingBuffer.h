@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cinder/gl/Vbo.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+typedef std::shared_ptr<class StreamingBuffer> StreamingBufferRef;
+
+//! GL buffer split into regions written in turn, so that the CPU fills the next regions while the GPU
+//! still reads the current one. Each region is protected by a fence inserted after the draws reading it,
+//! and map() only waits on that fence when the CPU gets a whole ring of regions ahead of the GPU.
+//! Uses one persistent, coherent mapping (GL 4.4 or ARB_buffer_storage) when available, otherwise maps
+//! each region unsynchronized with glMapBufferRange (GL 3.0), which also runs on Mesa llvmpipe.
+class StreamingBuffer {
+  public:
+    enum Mode { PERSISTENT_MAPPED, MAP_RANGE };
+    
+    //! Creates \a numRegions regions of \a regionBytes bound to \a target, persistently mapped if
+    //! \a persistent is set and the context supports it
+    static StreamingBufferRef create( GLenum target, size_t regionBytes, size_t numRegions = 3, bool persistent = true )
+    { return StreamingBufferRef( new StreamingBuffer( target, regionBytes, numRegions, persistent ) ); }
+    ~StreamingBuffer();
+    
+    //! Whether the context supports persistent mapping
+    static bool isPersistentMappingSupported();
+    
+    //! Waits until the GPU is done with the next region and returns it, mapped for writing only
+    void*       map();
+    //! Ends the write started by map(), the region becomes the current one
+    void        unmap();
+    //! Inserts the fence protecting the current region, to call after the draws reading it
+    void        fence();
+    
+    const ci::gl::VboRef&   getVbo() const { return mVbo; }
+    Mode        getMode() const { return mMode; }
+    size_t      getRegionBytes() const { return mRegionBytes; }
+    size_t      getNumRegions() const { return mFences.size(); }
+    //! Region holding the data of the last unmap()
+    size_t      getCurrentRegion() const { return mCurrent; }
+    
+    //! Number of map() calls, how many of them had to wait on a fence, and the total time waited
+    uint64_t    getNumMaps() const { return mNumMaps; }
+    uint64_t    getNumWaits() const { return mNumWaits; }
+    double      getWaitSeconds() const { return mWaitSeconds; }
+    void        resetStats();
+    
+  private:
+    StreamingBuffer( GLenum target, size_t regionBytes, size_t numRegions, bool persistent );
+    
+    void        waitFence( size_t region );
+    
+    GLenum              mTarget;
+    ci::gl::VboRef      mVbo;
+    Mode                mMode;
+    size_t              mRegionBytes;
+    std::vector<GLsync> mFences;        // one per region, null when the GPU is not reading it
+    size_t              mCurrent;
+    size_t              mWriting;       // region mapped by map(), until unmap()
+    uint8_t             *mPersistentData;
+    uint64_t            mNumMaps;
+    uint64_t            mNumWaits;
+    double              mWaitSeconds;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+typedef std::shared_ptr<class TaskQueue> TaskQueueRef;
+
+//! One long-lived worker thread running the tasks pushed to it, one at a time and in order. For the jobs
+//! started every frame, which would otherwise each start and join a thread of their own.
+class TaskQueue {
+  public:
+    static TaskQueueRef create() { return TaskQueueRef( new TaskQueue() ); }
+    //! Runs the tasks still queued, then joins the worker
+    ~TaskQueue();
+    
+    //! Queues \a fn, returns the future of its result
+    template<typename Fn>
+    std::future<typename std::result_of<Fn()>::type> push( Fn fn )
+    {
+        typedef typename std::result_of<Fn()>::type Result;
+        // std::function needs a copyable task, the packaged_task is shared
+        auto task = std::make_shared<std::packaged_task<Result()>>( std::move( fn ) );
+        std::future<Result> result = task->get_future();
+        pushTask( [task] { (*task)(); } );
+        return result;
+    }
+    
+  private:
+    TaskQueue();
+    TaskQueue( const TaskQueue & ) = delete;
+    TaskQueue& operator=( const TaskQueue & ) = delete;
+    
+    void    pushTask( std::function<void()> task );
+    void    workerLoop();
+    
+    std::mutex                          mMutex;
+    std::condition_variable             mCondition;
+    std::deque<std::function<void()>>   mTasks;
+    bool                                mQuit;
+    std::thread                         mThread;    // last, started once the rest is initialized
+};
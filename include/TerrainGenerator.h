@@ -0,0 +1,152 @@
+#pragma once
+
+#include "SimplexNoise.h"
+#include "HeightFieldGenerator.h"
+#include "HeightTileCache.h"
+#include "FrameProfiler.h"
+#include "HeightGraph.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Headless generation of the heights: plain C++ on top of SimplexNoise and the worker threads, no Cinder
+// nor GL, so that the app and the command line tool (see cli/HeightFieldCli.cpp) generate the same heights.
+
+enum HeightFunction { sine, uniform, randnoise, fractal, simplex, graph };
+extern const std::vector<std::string> heightFunctionNames;
+
+enum NoiseHash { permutationHash, seededHash };
+extern const std::vector<std::string> noiseHashNames;
+
+//! Everything the generation of the heights reads, copied from the params when a job starts, so that a job
+//! running in the background never sees (nor races with) the changes made by the params callbacks.
+struct HeightParams {
+    uint64_t                mGenerationId;  // params generation this copy was taken at
+    // Version of everything the unscaled heights depend on besides the position: every param but mHeightMult.
+    // 0 when unknown, the unscaled heights are then never reused from one job to the next.
+    uint64_t                mNoiseVersion;
+    HeightFunction          mHeightFunction;
+    int                     mNoiseHash;
+    int                     mNoiseSeed;
+    int                     mOctaves;
+    float                   mNoiseFrequency;
+    float                   mNoiseAmplitude;
+    float                   mNoiseLacunarity;
+    float                   mNoisePersistence;
+    SimplexNoise            mNoise;
+    SeededSimplexNoise      mSeededNoise;
+    PreparedFractal         mFractal;
+    SeededPreparedFractal   mSeededFractal;
+    float                   mHeightMult;
+    HeightGraph             mGraph;         // height function of the graph mode, before the height multiplier
+    HeightKernelRef         mKernel;        // compiled height function, see prepareKernel()
+    float                   mSpacing;       // distance between two rows (or columns) of the plane
+    bool                    mNormals;
+    bool                    mScrollMode;
+    bool                    mTileCache;
+    float                   mOffset;        // time offset of the sine height function
+    int                     mTerrainOffset;
+    int64_t                 mScrollRow;
+    
+    //! Sets up mNoise, mSeededNoise and their prepared fractals from the noise params and the octaves
+    void                    prepareNoise();
+    //! Compiles mKernel from the height function, and from mGraph in graph mode. The height multiplier is part of
+    //! it, except for the rescalable height functions: their kernel gives the unscaled heights.
+    void                    prepareKernel();
+    //! Whether the heights are mHeightMult times unscaled heights that only depend on the position and the
+    //! noise version, so that a change of mHeightMult alone only rescales them
+    bool                    isRescalable() const { return mHeightFunction == fractal || mHeightFunction == simplex; }
+};
+
+//! Unit normal of a vertex, laid out as the vec3 of a NORMAL attribute
+struct HeightNormal {
+    float x, y, z;
+};
+
+typedef std::shared_ptr<struct HeightField> HeightFieldRef;
+
+//! CPU side of the plane: staging copies of the vertex streams and the state of the scrolling ring.
+//! Owned by the main thread or by the generation job in flight, never both at once; a new one is made
+//! when the plane changes, so that a job still running on the old one can't touch the new one.
+struct HeightField {
+    //! Creates a field of gridX.size() columns by gridZ.size() rows, flat, with normals if \a normals
+    static HeightFieldRef   create( const std::vector<float> &gridX, const std::vector<float> &gridZ, bool normals );
+    
+    // Height-only vertex stream: x and z are reconstructed from gl_VertexID in wireframe.vert, so only
+    // one float (or half float) per vertex is ever uploaded, write-only, from this staging copy.
+    std::vector<float>          mHeights;       // staging copy of the height stream
+    std::vector<HeightNormal>   mNormals;       // staging copy of the NORMAL buffer, when enabled
+    std::vector<float>          mGridX;         // x coordinate of each column of the plane
+    std::vector<float>          mGridZ;         // z coordinate of each row of the plane
+    std::vector<float>          mRowZ;          // noise z coordinate of each row currently held
+    // Dependencies of the stages: rescalable height functions keep their unscaled heights (and derivatives, with
+    // the normals), which only depend on the noise version and the rows held, and mHeights and mNormals are
+    // mScale times them. A change of the noise regenerates them, a change of the multiplier only rescales.
+    std::vector<float>          mNoiseHeights;  // unscaled heights, for the rescalable height functions
+    std::vector<float>          mNoiseDx;       // their partial derivatives, with the normals
+    std::vector<float>          mNoiseDz;
+    uint64_t                    mNoiseVersion;  // noise version of the unscaled rows held, 0 when they have to be regenerated
+    float                       mNoiseRowZ;     // noise z coordinate of their first row, when not scrolling the ring
+    float                       mScale;         // multiplier mHeights was made with, NaN when it has to be remade
+    // Scrolling ring buffer: the rows of the VBO are used as a ring, the displayed row 0 being stored in
+    // row slot mRingBaseRow, so scrolling only generates and uploads the rows that come into view.
+    int64_t                 mRingScrollRow; // scroll row of the rows currently held by the ring
+    size_t                  mRingBaseRow;   // row slot holding the first displayed row
+    uint64_t                mGenerationId;  // params generation of the rows held, 0 when every row has to be regenerated
+    size_t                  rowSlot( size_t row ) const { return ( mRingBaseRow + row ) % mGridZ.size(); }
+};
+
+//! What a generation job had to redo: every row, the rows scrolled in, the scale of the rows (and the rows
+//! scrolled in), or nothing at all
+enum HeightUpdate { fullUpdate, scrollUpdate, rescaleUpdate, noUpdate };
+
+//! Outcome of a generation job: the displayed rows [mRowBegin, mRowEnd) of mField to upload
+struct HeightJob {
+    HeightFieldRef          mField;
+    size_t                  mRowBegin;
+    size_t                  mRowEnd;
+    bool                    mCancelled;     // the params changed meanwhile, the rows were left unfinished
+    HeightUpdate            mUpdate;
+};
+
+typedef std::shared_ptr<class TerrainGenerator> TerrainGeneratorRef;
+
+//! Generates the rows of a HeightField for a HeightParams, in bands over a HeightFieldGenerator, through an
+//! optional HeightTileCache. Every invalidate() bumps the generation id: jobs started from params of an older
+//! generation notice it between rows, and stop there instead of finishing rows nobody will use.
+class TerrainGenerator {
+  public:
+    //! Creates a generator filling rows from \a tileCache when the params enable it, it can be null
+    static TerrainGeneratorRef create( const HeightTileCacheRef &tileCache = HeightTileCacheRef() ) { return TerrainGeneratorRef( new TerrainGenerator( tileCache ) ); }
+    
+    //! Current generation id, to store in HeightParams::mGenerationId
+    uint64_t    getGenerationId() const { return mGenerationId.load(); }
+    //! Cancels the jobs in flight, their params are stale
+    void        invalidate() { mGenerationId++; }
+    bool        isCancelled( const HeightParams &params ) const { return mGenerationId.load( std::memory_order_relaxed ) != params.mGenerationId; }
+    
+    //! Times the generation stages into \a profiler, see FrameProfiler
+    void        setProfiler( const FrameProfilerRef &profiler ) { mProfiler = profiler; }
+    
+    //! Brings the rows of \a field up to date with \a params: all of them, only those scrolled in when the
+    //! scroll ring holds the others, or none when only the multiplier of rescalable heights changed (they are then
+    //! rescaled) or nothing did. Thread-safe as long as \a field isn't used by anything else meanwhile.
+    HeightJob   run( const HeightParams &params, const HeightFieldRef &field, const HeightFieldGeneratorRef &generator ) const;
+    
+  private:
+    explicit TerrainGenerator( const HeightTileCacheRef &tileCache );
+    
+    static void             setNormal( HeightNormal &normal, float dydx, float dydz );
+    void                    generateRows( const HeightParams &params, HeightField &field, size_t rowBegin, size_t rowEnd ) const;
+    void                    scaleRows( const HeightParams &params, HeightField &field, const HeightFieldGeneratorRef &generator, size_t rowBegin, size_t rowEnd ) const;
+    HeightTileKey           makeTileKey( const HeightParams &params, const HeightField &field ) const;
+    HeightTileCache::TileRef generateTile( const HeightParams &params, const HeightTileKey &key ) const;
+    bool                    fillRowsFromCache( const HeightParams &params, HeightField &field, const HeightFieldGeneratorRef &generator, size_t rowBegin, size_t rowEnd ) const;
+    
+    HeightTileCacheRef      mTileCache;
+    FrameProfilerRef        mProfiler;
+    std::atomic<uint64_t>   mGenerationId;
+};
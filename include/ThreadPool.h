@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr<class ThreadPool> ThreadPoolRef;
+
+//! A fixed set of worker threads running parallel loops. The calling thread takes part in every loop,
+//! and tasks are handed out one at a time from a shared counter, so that faster threads pick up the
+//! work left by slower ones instead of idling at the end of a statically split range.
+class ThreadPool {
+  public:
+    //! Creates a pool running loops on \a numThreads threads in total, the calling one included. 0 means one per hardware thread.
+    static ThreadPoolRef create( size_t numThreads = 0 ) { return ThreadPoolRef( new ThreadPool( numThreads ) ); }
+    ~ThreadPool();
+
+    //! Number of threads running each loop, the calling one included
+    size_t  getNumThreads() const { return mThreads.size() + 1; }
+
+    //! Runs \a fn( task ) for every task in [0, \a numTasks) and returns once they have all completed.
+    //! Calls from several threads are serialized.
+    void    parallelFor( size_t numTasks, const std::function<void( size_t )> &fn );
+
+  private:
+    explicit ThreadPool( size_t numThreads );
+    ThreadPool( const ThreadPool & ) = delete;
+    ThreadPool& operator=( const ThreadPool & ) = delete;
+
+    void    workerLoop();
+    void    runTasks();
+
+    std::vector<std::thread>            mThreads;
+    std::mutex                          mLoopMutex;     // serializes parallelFor() callers
+    std::mutex                          mMutex;
+    std::condition_variable             mWakeCondition;
+    std::condition_variable             mDoneCondition;
+    const std::function<void( size_t )> *mTaskFn;
+    size_t                              mNumTasks;
+    std::atomic<size_t>                 mNextTask;
+    size_t                              mNumBusyWorkers;
+    uint64_t                            mLoopId;
+    bool                                mQuit;
+};
@@ -0,0 +1,321 @@
+#include "BakedAnimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+static const char kMagic[8] = "MPTANIM";
+static const uint32_t kVersion = 1;
+// zigzag residuals of 16 bit heights fit 18 bits
+static const size_t kMaxResidualBytes = 3;
+
+// Prediction of a quantized height from its left, upper and upper left neighbors: exact on planes, so the
+// residuals of a smooth terrain stay small. The first row and column only have one neighbor.
+static inline int32_t predict( const uint16_t *row, const uint16_t *previousRow, size_t column )
+{
+    if( ! previousRow )
+        return column ? row[column - 1] : 0;
+    if( ! column )
+        return previousRow[0];
+    return int32_t( row[column - 1] ) + int32_t( previousRow[column] ) - int32_t( previousRow[column - 1] );
+}
+
+// Frame data: the height min and the quantization step as floats, then one zigzag varint residual per height
+static void encodeFrame( const float *heights, size_t numColumns, size_t numRows, vector<uint8_t> &data )
+{
+    const size_t count = numColumns * numRows;
+    const auto range = minmax_element( heights, heights + count );
+    const float low = *range.first;
+    const float step = ( *range.second - low ) / 65535.0f;
+    const float invStep = ( step > 0.0f ) ? 1.0f / step : 0.0f;
+    
+    data.resize( 2 * sizeof( float ) );
+    memcpy( &data[0], &low, sizeof( float ) );
+    memcpy( &data[sizeof( float )], &step, sizeof( float ) );
+    vector<uint16_t> rows( 2 * numColumns );
+    for( size_t row = 0; row < numRows; row++ ) {
+        uint16_t *quantized = &rows[( row & 1 ) * numColumns];
+        const uint16_t *previous = row ? &rows[( ~row & 1 ) * numColumns] : nullptr;
+        for( size_t column = 0; column < numColumns; column++ ) {
+            const float q = ( heights[row * numColumns + column] - low ) * invStep;
+            quantized[column] = uint16_t( min( 65535.0f, max( 0.0f, q + 0.5f ) ) );
+            const int32_t residual = int32_t( quantized[column] ) - predict( quantized, previous, column );
+            uint32_t value = ( uint32_t( residual ) << 1 ) ^ uint32_t( residual >> 31 );
+            while( value >= 0x80 ) {
+                data.push_back( uint8_t( value | 0x80 ) );
+                value >>= 7;
+            }
+            data.push_back( uint8_t( value ) );
+        }
+    }
+}
+
+// Returns false if the data is truncated
+static bool decodeFrameData( const uint8_t *data, size_t bytes, size_t numColumns, size_t numRows, float *heights )
+{
+    if( bytes < 2 * sizeof( float ) )
+        return false;
+    float low, step;
+    memcpy( &low, data, sizeof( float ) );
+    memcpy( &step, data + sizeof( float ), sizeof( float ) );
+    const uint8_t *in = data + 2 * sizeof( float );
+    const uint8_t *end = data + bytes;
+    
+    // Most residuals of a smooth terrain fit one byte, the rows are decoded without bound checks when the
+    // data left is enough for the longest residuals
+    vector<uint16_t> rows( 2 * numColumns );
+    for( size_t row = 0; row < numRows; row++ ) {
+        uint16_t *quantized = &rows[( row & 1 ) * numColumns];
+        const uint16_t *previous = row ? &rows[( ~row & 1 ) * numColumns] : nullptr;
+        float *out = &heights[row * numColumns];
+        const bool checked = size_t( end - in ) < kMaxResidualBytes * numColumns;
+        int32_t left = previous ? previous[0] : 0;
+        for( size_t column = 0; column < numColumns; column++ ) {
+            int32_t residual;
+            if( ! checked && *in < 0x80 ) {
+                residual = int32_t( *in >> 1 ) ^ -int32_t( *in & 1 );
+                in++;
+            }
+            else {
+                uint32_t value = 0;
+                for( int shift = 0; ; shift += 7 ) {
+                    if( in == end || shift > 14 )
+                        return false;
+                    const uint8_t byte = *in++;
+                    value |= uint32_t( byte & 0x7f ) << shift;
+                    if( ! ( byte & 0x80 ) )
+                        break;
+                }
+                residual = int32_t( value >> 1 ) ^ -int32_t( value & 1 );
+            }
+            // left + upper - upper left once past the first column, same as predict()
+            if( previous && column )
+                left += int32_t( previous[column] ) - int32_t( previous[column - 1] );
+            left = uint16_t( left + residual );
+            quantized[column] = uint16_t( left );
+            out[column] = low + float( left ) * step;
+        }
+    }
+    return true;
+}
+
+BakedAnimationHeader BakedAnimationWriter::makeHeader( const HeightParams &params, const HeightField &field, size_t numFrames, float framesPerSecond )
+{
+    BakedAnimationHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.mMagic, kMagic, sizeof( kMagic ) );
+    header.mVersion = kVersion;
+    header.mNumColumns = uint32_t( field.mGridX.size() );
+    header.mNumRows = uint32_t( field.mGridZ.size() );
+    header.mNumFrames = uint32_t( numFrames );
+    header.mFramesPerSecond = framesPerSecond;
+    header.mOriginX = field.mGridX[0];
+    header.mOriginZ = field.mRowZ[0];
+    header.mSpacing = params.mSpacing;
+    header.mHeightFunction = params.mHeightFunction;
+    header.mNoiseHash = params.mNoiseHash;
+    header.mNoiseSeed = params.mNoiseSeed;
+    header.mOctaves = params.mOctaves;
+    header.mNoiseFrequency = params.mNoiseFrequency;
+    header.mNoiseAmplitude = params.mNoiseAmplitude;
+    header.mNoiseLacunarity = params.mNoiseLacunarity;
+    header.mNoisePersistence = params.mNoisePersistence;
+    header.mHeightMult = params.mHeightMult;
+    return header;
+}
+
+BakedAnimationWriterRef BakedAnimationWriter::create( const string &path, const BakedAnimationHeader &header )
+{
+    FILE *file = fopen( path.c_str(), "wb" );
+    if( ! file )
+        return BakedAnimationWriterRef();
+    return BakedAnimationWriterRef( new BakedAnimationWriter( file, header ) );
+}
+
+bool BakedAnimationWriter::bake( const string &path, HeightParams params, const HeightFieldRef &field, size_t numFrames, float framesPerSecond,
+                                 const HeightFieldGeneratorRef &generator, const function<bool( size_t )> &progressFn )
+{
+    auto writer = create( path, makeHeader( params, *field, numFrames, framesPerSecond ) );
+    if( ! writer )
+        return false;
+    
+    // A generator of its own, the invalidations of another one don't cancel the frames
+    TerrainGeneratorRef terrainGenerator = TerrainGenerator::create();
+    params.mNormals = false;
+    params.mScrollMode = false;
+    params.mTileCache = false;
+    params.prepareNoise();
+    params.prepareKernel();
+    const float offset = params.mOffset;
+    const int terrainOffset = params.mTerrainOffset;
+    for( size_t frame = 0; frame < numFrames; frame++ ) {
+        // the app moves the sine phase by 4 and the terrain by one unit every 0.1 s
+        const float time = float( frame ) / framesPerSecond;
+        params.mOffset = offset + time * 4.0f;
+        params.mTerrainOffset = terrainOffset + int( floorf( time * 10.0f ) );
+        params.mGenerationId = terrainGenerator->getGenerationId();
+        terrainGenerator->run( params, field, generator );
+        if( ! writer->addFrame( field->mHeights.data() ) )
+            return false;
+        if( progressFn && ! progressFn( frame + 1 ) )
+            return false;
+    }
+    return writer->finish();
+}
+
+BakedAnimationWriter::BakedAnimationWriter( FILE *file, const BakedAnimationHeader &header )
+    : mFile( file ), mHeader( header ), mNumStored( 0 ), mFailed( false )
+{
+    // the frame table is written by finish(), once the frames are
+    mOffset = sizeof( BakedAnimationHeader ) + uint64_t( mHeader.mNumFrames ) * sizeof( BakedFrameEntry );
+    mFailed = fseek( mFile, long( mOffset ), SEEK_SET ) != 0;
+}
+
+BakedAnimationWriter::~BakedAnimationWriter()
+{
+    fclose( mFile );
+}
+
+bool BakedAnimationWriter::addFrame( const float *heights )
+{
+    if( mFailed || mEntries.size() >= mHeader.mNumFrames )
+        return false;
+    
+    encodeFrame( heights, mHeader.mNumColumns, mHeader.mNumRows, mData );
+    if( ! mEntries.empty() && mData == mLastData ) {
+        mEntries.push_back( mEntries.back() );
+        return true;
+    }
+    mFailed = fwrite( mData.data(), 1, mData.size(), mFile ) != mData.size();
+    mEntries.push_back( BakedFrameEntry{ mOffset, mData.size() } );
+    mOffset += mData.size();
+    mNumStored++;
+    swap( mData, mLastData );
+    return ! mFailed;
+}
+
+bool BakedAnimationWriter::finish()
+{
+    if( mFailed || mEntries.size() != mHeader.mNumFrames )
+        return false;
+    mFailed = fseek( mFile, 0, SEEK_SET ) != 0
+        || fwrite( &mHeader, sizeof( mHeader ), 1, mFile ) != 1
+        || fwrite( mEntries.data(), sizeof( BakedFrameEntry ), mEntries.size(), mFile ) != mEntries.size()
+        || fflush( mFile ) != 0;
+    return ! mFailed;
+}
+
+BakedAnimationPlayerRef BakedAnimationPlayer::open( const string &path, size_t readAhead )
+{
+    FILE *file = fopen( path.c_str(), "rb" );
+    if( ! file )
+        return BakedAnimationPlayerRef();
+    BakedAnimationHeader header;
+    vector<BakedFrameEntry> entries;
+    bool valid = fread( &header, sizeof( header ), 1, file ) == 1 && ! memcmp( header.mMagic, kMagic, sizeof( kMagic ) )
+        && header.mVersion == kVersion && header.mNumColumns > 0 && header.mNumRows > 0 && header.mNumFrames > 0;
+    if( valid ) {
+        entries.resize( header.mNumFrames );
+        valid = fread( entries.data(), sizeof( BakedFrameEntry ), entries.size(), file ) == entries.size();
+    }
+    if( ! valid ) {
+        fclose( file );
+        return BakedAnimationPlayerRef();
+    }
+    return BakedAnimationPlayerRef( new BakedAnimationPlayer( file, header, move( entries ), max<size_t>( readAhead, 1 ) ) );
+}
+
+BakedAnimationPlayer::BakedAnimationPlayer( FILE *file, const BakedAnimationHeader &header, vector<BakedFrameEntry> entries, size_t readAhead )
+    : mFile( file ), mHeader( header ), mEntries( move( entries ) ), mReadAhead( readAhead ),
+    mWanted( 0 ), mNextDecode( 0 ), mNumLateFrames( 0 ), mStop( false )
+{
+    // one more slot than the frames read ahead, for the frame the caller holds
+    mSlots.resize( readAhead + 1 );
+    for( Slot &slot : mSlots ) {
+        slot.mState = FREE;
+        slot.mFrame = 0;
+        slot.mHeights.resize( size_t( header.mNumColumns ) * header.mNumRows );
+    }
+    mThread = thread( &BakedAnimationPlayer::decodeFrames, this );
+}
+
+BakedAnimationPlayer::~BakedAnimationPlayer()
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        mStop = true;
+    }
+    mCondition.notify_all();
+    mThread.join();
+    fclose( mFile );
+}
+
+const float* BakedAnimationPlayer::getFrame( uint64_t frame )
+{
+    unique_lock<mutex> lock( mMutex );
+    mWanted = frame;
+    // The frame held since the last call is released unless it is asked for again, and so are the frames
+    // decoded that won't be asked for
+    Slot *found = nullptr;
+    bool decoding = false;
+    for( Slot &slot : mSlots ) {
+        if( slot.mFrame == frame && ( slot.mState == IN_USE || slot.mState == READY ) )
+            found = &slot;
+        else if( slot.mState == IN_USE || ( slot.mState == READY && ( slot.mFrame < frame || slot.mFrame >= frame + mReadAhead ) ) )
+            slot.mState = FREE;
+        decoding = decoding || ( slot.mState == DECODING && slot.mFrame == frame );
+    }
+    if( found ) {
+        found->mState = IN_USE;
+    }
+    else {
+        mNumLateFrames++;
+        // the decoding is behind, or past this frame after a seek back: it restarts from this frame
+        if( ! decoding )
+            mNextDecode = frame;
+    }
+    lock.unlock();
+    mCondition.notify_all();
+    return found ? found->mHeights.data() : nullptr;
+}
+
+void BakedAnimationPlayer::decodeFrames()
+{
+    vector<uint8_t> data;
+    unique_lock<mutex> lock( mMutex );
+    while( true ) {
+        // next frame within the read ahead of the one asked for, into a free slot
+        Slot *slot = nullptr;
+        mCondition.wait( lock, [&] {
+            if( mStop )
+                return true;
+            if( mNextDecode < mWanted || mNextDecode >= mWanted + mReadAhead )
+                return false;
+            auto it = find_if( mSlots.begin(), mSlots.end(), []( const Slot &slot ) { return slot.mState == FREE; } );
+            slot = ( it != mSlots.end() ) ? &*it : nullptr;
+            return slot != nullptr;
+        } );
+        if( mStop )
+            return;
+    
+        const uint64_t frame = mNextDecode++;
+        slot->mState = DECODING;
+        slot->mFrame = frame;
+        lock.unlock();
+        const bool decoded = decodeFrame( frame, data, slot->mHeights );
+        lock.lock();
+        // a frame that can't be read is skipped, the caller keeps the previous one
+        slot->mState = ( decoded && frame >= mWanted ) ? READY : FREE;
+    }
+}
+
+bool BakedAnimationPlayer::decodeFrame( uint64_t frame, vector<uint8_t> &data, vector<float> &heights )
+{
+    const BakedFrameEntry &entry = mEntries[size_t( frame % mEntries.size() )];
+    data.resize( size_t( entry.mBytes ) );
+    if( fseek( mFile, long( entry.mOffset ), SEEK_SET ) != 0 || fread( data.data(), 1, data.size(), mFile ) != data.size() )
+        return false;
+    return decodeFrameData( data.data(), data.size(), mHeader.mNumColumns, mHeader.mNumRows, heights.data() );
+}
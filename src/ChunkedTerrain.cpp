@@ -0,0 +1,223 @@
+#include "ChunkedTerrain.h"
+
+#include "cinder/gl/gl.h"
+
+#include <algorithm>
+
+using namespace ci;
+using namespace std;
+
+// Vertices along a side of a chunk, and per chunk: the grid then one row of skirt vertices per edge
+static const int kChunkColumns = ChunkedTerrain::kChunkQuads + 1;
+static const int kGridVertices = kChunkColumns * kChunkColumns;
+static const int kChunkVertices = kGridVertices + 4 * kChunkColumns;
+// Chunks kept for reuse once they are not drawn anymore
+static const size_t kMaxCachedChunks = 1024;
+// Deepest level supported by the node keys
+static const int kMaxSupportedDepth = 20;
+
+ChunkedTerrain::ChunkedTerrain( const gl::GlslProgRef &shader )
+    : mShader( shader ), mSize( 512.0f ), mMaxDepth( 8 ), mLodFactor( 2.0f ), mHeightBound( 1.0f ),
+    mFrame( 0 ), mNumCulled( 0 ), mNumGenerated( 0 )
+{
+    // Grid quads, then the skirt quads joining each edge to its skirt vertices
+    vector<uint32_t> indices;
+    indices.reserve( 6 * ( kChunkQuads * kChunkQuads + 4 * kChunkQuads ) );
+    for( uint32_t row = 0; row < (uint32_t)kChunkQuads; row++ ) {
+        for( uint32_t column = 0; column < (uint32_t)kChunkQuads; column++ ) {
+            const uint32_t i = row * kChunkColumns + column;
+            const uint32_t j = i + kChunkColumns;
+            indices.insert( indices.end(), { i, i + 1, j, j, i + 1, j + 1 } );
+        }
+    }
+    for( uint32_t edge = 0; edge < 4; edge++ ) {
+        for( uint32_t k = 0; k < (uint32_t)kChunkQuads; k++ ) {
+            // grid vertex k of the edge, as ordered in terrain-chunk.vert
+            auto gridVertex = [edge]( uint32_t k ) {
+                const uint32_t last = kChunkColumns - 1;
+                return edge == 0 ? k : edge == 1 ? last * kChunkColumns + k : edge == 2 ? k * kChunkColumns : k * kChunkColumns + last;
+            };
+            const uint32_t i = gridVertex( k );
+            const uint32_t j = gridVertex( k + 1 );
+            const uint32_t si = kGridVertices + edge * kChunkColumns + k;
+            const uint32_t sj = si + 1;
+            indices.insert( indices.end(), { i, j, si, si, j, sj } );
+        }
+    }
+    mNumIndices = (uint32_t)indices.size();
+    mIndices = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW );
+}
+
+void ChunkedTerrain::setSize( float size )
+{
+    if( size != mSize ) {
+        mSize = size;
+        clear();
+    }
+}
+
+void ChunkedTerrain::setMaxDepth( int maxDepth )
+{
+    mMaxDepth = min( max( maxDepth, 0 ), kMaxSupportedDepth );
+}
+
+void ChunkedTerrain::setHeightBound( float heightBound )
+{
+    // the skirts depend on it
+    if( heightBound != mHeightBound ) {
+        mHeightBound = heightBound;
+        clear();
+    }
+}
+
+void ChunkedTerrain::clear()
+{
+    mChunks.clear();
+    mSelected.clear();
+}
+
+void ChunkedTerrain::setShader( const gl::GlslProgRef &shader )
+{
+    // the chunks keep their heights, only their batches change
+    mShader = shader;
+    for( auto &chunk : mChunks )
+        chunk.second.mBatch = gl::Batch::create( chunk.second.mBatch->getVboMesh(), mShader );
+}
+
+vec2 ChunkedTerrain::getChunkOrigin( const Node &node ) const
+{
+    const float chunkSize = getChunkSize( node.mDepth );
+    return vec2( -0.5f * mSize + float( node.mX ) * chunkSize, -0.5f * mSize + float( node.mZ ) * chunkSize );
+}
+
+void ChunkedTerrain::update( const mat4 &viewProjection, const vec3 &eye, const HeightFieldGeneratorRef &generator, const HeightFn &heightFn )
+{
+    // Frustum planes of the object space, as (normal, distance) with the inside on the positive side
+    vec4 planes[6];
+    for( int i = 0; i < 3; i++ ) {
+        const vec4 row( viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i] );
+        const vec4 w( viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3] );
+        planes[2 * i] = w + row;
+        planes[2 * i + 1] = w - row;
+    }
+    
+    ++mFrame;
+    mSelected.clear();
+    mNumCulled = 0;
+    select( Node{ 0, 0, 0 }, planes, eye );
+    
+    // Generate the chunks seen for the first time, in parallel, then create their buffers here on the GL thread
+    vector<Node> missing;
+    for( const Node &node : mSelected ) {
+        auto it = mChunks.find( node.getKey() );
+        if( it != mChunks.end() )
+            it->second.mLastUsed = mFrame;
+        else
+            missing.push_back( node );
+    }
+    vector<vector<float>> heights( missing.size() );
+    generator->generateRows( missing.size(), [&]( size_t begin, size_t end ) {
+        for( size_t i = begin; i < end; i++ )
+            generateHeights( missing[i], heightFn, heights[i] );
+    }, 1 );
+    
+    for( size_t i = 0; i < missing.size(); i++ ) {
+        Chunk chunk;
+        chunk.mHeights = gl::Vbo::create( GL_ARRAY_BUFFER, heights[i].size() * sizeof( float ), heights[i].data(), GL_STATIC_DRAW );
+        geom::BufferLayout layout;
+        layout.append( geom::Attrib::CUSTOM_0, 1, 0, 0 );
+        auto mesh = gl::VboMesh::create( kChunkVertices, GL_TRIANGLES, { make_pair( layout, chunk.mHeights ) }, mNumIndices, GL_UNSIGNED_INT, mIndices );
+        chunk.mBatch = gl::Batch::create( mesh, mShader );
+        chunk.mLastUsed = mFrame;
+        mChunks[missing[i].getKey()] = chunk;
+    }
+    mNumGenerated = missing.size();
+    evict();
+}
+
+void ChunkedTerrain::select( const Node &node, const vec4 *planes, const vec3 &eye )
+{
+    const float chunkSize = getChunkSize( node.mDepth );
+    const vec2 origin = getChunkOrigin( node );
+    const vec3 boxMin( origin.x, -mHeightBound, origin.y );
+    const vec3 boxMax( origin.x + chunkSize, mHeightBound, origin.y + chunkSize );
+    
+    // Outside of a frustum plane: the corner of the box the furthest along its normal is behind it
+    for( int i = 0; i < 6; i++ ) {
+        const vec3 normal( planes[i] );
+        const vec3 corner( normal.x > 0 ? boxMax.x : boxMin.x, normal.y > 0 ? boxMax.y : boxMin.y, normal.z > 0 ? boxMax.z : boxMin.z );
+        if( dot( normal, corner ) + planes[i].w < 0 ) {
+            ++mNumCulled;
+            return;
+        }
+    }
+    
+    // Split while the eye is close to the chunk relative to its size
+    const vec3 closest = glm::clamp( eye, boxMin, boxMax );
+    if( node.mDepth < mMaxDepth && glm::distance( eye, closest ) < mLodFactor * chunkSize ) {
+        for( int64_t z = 0; z < 2; z++ ) {
+            for( int64_t x = 0; x < 2; x++ )
+                select( Node{ node.mDepth + 1, 2 * node.mX + x, 2 * node.mZ + z }, planes, eye );
+        }
+        return;
+    }
+    mSelected.push_back( node );
+}
+
+void ChunkedTerrain::generateHeights( const Node &node, const HeightFn &heightFn, vector<float> &heights ) const
+{
+    const float spacing = getChunkSize( node.mDepth ) / kChunkQuads;
+    const vec2 origin = getChunkOrigin( node );
+    vector<float> x( kGridVertices ), z( kGridVertices );
+    for( int row = 0; row < kChunkColumns; row++ ) {
+        for( int column = 0; column < kChunkColumns; column++ ) {
+            x[row * kChunkColumns + column] = origin.x + float( column ) * spacing;
+            z[row * kChunkColumns + column] = origin.y + float( row ) * spacing;
+        }
+    }
+    heights.resize( kChunkVertices );
+    heightFn( x.data(), z.data(), heights.data(), kGridVertices, spacing );
+    
+    // Skirts hang below the edges, deep enough to cover the height differences with coarser neighbors
+    const float skirtDepth = 0.1f * mHeightBound + 2.0f * spacing;
+    const int last = kChunkColumns - 1;
+    float *skirts = &heights[kGridVertices];
+    for( int k = 0; k < kChunkColumns; k++ ) {
+        skirts[k] = heights[k] - skirtDepth;
+        skirts[kChunkColumns + k] = heights[last * kChunkColumns + k] - skirtDepth;
+        skirts[2 * kChunkColumns + k] = heights[k * kChunkColumns] - skirtDepth;
+        skirts[3 * kChunkColumns + k] = heights[k * kChunkColumns + last] - skirtDepth;
+    }
+}
+
+void ChunkedTerrain::draw()
+{
+    gl::ScopedGlslProg shader( mShader );
+    mShader->uniform( "uChunkColumns", kChunkColumns );
+    mShader->uniform( "uTerrainSize", mSize );
+    for( const Node &node : mSelected ) {
+        auto it = mChunks.find( node.getKey() );
+        if( it == mChunks.end() )
+            continue;
+        mShader->uniform( "uChunkOrigin", getChunkOrigin( node ) );
+        mShader->uniform( "uChunkSpacing", getChunkSize( node.mDepth ) / kChunkQuads );
+        it->second.mBatch->draw();
+    }
+}
+
+void ChunkedTerrain::evict()
+{
+    if( mChunks.size() <= kMaxCachedChunks )
+        return;
+    
+    // least recently used first, never the ones selected by this update
+    vector<pair<uint64_t, uint64_t>> lastUsed;
+    for( const auto &chunk : mChunks ) {
+        if( chunk.second.mLastUsed != mFrame )
+            lastUsed.emplace_back( chunk.second.mLastUsed, chunk.first );
+    }
+    sort( lastUsed.begin(), lastUsed.end() );
+    const size_t excess = min( mChunks.size() - kMaxCachedChunks, lastUsed.size() );
+    for( size_t i = 0; i < excess; i++ )
+        mChunks.erase( lastUsed[i].second );
+}
@@ -0,0 +1,138 @@
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+FrameProfiler::FrameProfiler( size_t capacity )
+    : mEpoch( chrono::steady_clock::now() ), mHead( 0 )
+{
+    size_t size = 1;
+    while( size < capacity )
+        size *= 2;
+    mSlots = vector<Slot>( size );
+    mMask = size - 1;
+    for( Slot &slot : mSlots )
+        slot.mSequence.store( 0, memory_order_relaxed );
+}
+
+uint32_t FrameProfiler::threadId()
+{
+    static atomic<uint32_t> sNextThreadId( 0 );
+    static thread_local uint32_t sThreadId = sNextThreadId++;
+    return sThreadId;
+}
+
+void FrameProfiler::record( const char *stage, int64_t startNs, int64_t durationNs )
+{
+    // A writer lapped by mSlots.size() records while filling its slot could tear it, which
+    // would take thousands of samples recorded during a single one.
+    const uint64_t index = mHead.fetch_add( 1, memory_order_relaxed );
+    Slot &slot = mSlots[index & mMask];
+    slot.mSequence.store( 2 * index + 1, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+    slot.mStage.store( stage, memory_order_relaxed );
+    slot.mThread.store( threadId(), memory_order_relaxed );
+    slot.mStartNs.store( startNs, memory_order_relaxed );
+    slot.mDurationNs.store( durationNs, memory_order_relaxed );
+    slot.mSequence.store( 2 * index + 2, memory_order_release );
+}
+
+vector<FrameProfiler::Sample> FrameProfiler::getSamples() const
+{
+    const uint64_t head = mHead.load( memory_order_acquire );
+    const uint64_t first = ( head > mSlots.size() ) ? head - mSlots.size() : 0;
+    vector<Sample> samples;
+    samples.reserve( size_t( head - first ) );
+    for( uint64_t index = first; index < head; index++ ) {
+        const Slot &slot = mSlots[index & mMask];
+        // skip the slots still written, or already reused by a newer record
+        if( slot.mSequence.load( memory_order_acquire ) != 2 * index + 2 )
+            continue;
+        Sample sample;
+        sample.mStage = slot.mStage.load( memory_order_relaxed );
+        sample.mThread = slot.mThread.load( memory_order_relaxed );
+        sample.mStartNs = slot.mStartNs.load( memory_order_relaxed );
+        sample.mDurationNs = slot.mDurationNs.load( memory_order_relaxed );
+        atomic_thread_fence( memory_order_acquire );
+        if( slot.mSequence.load( memory_order_relaxed ) == 2 * index + 2 )
+            samples.push_back( sample );
+    }
+    return samples;
+}
+
+// Nearest-rank percentile of sorted durations, in milliseconds
+static double percentile( const vector<int64_t> &sorted, double p )
+{
+    if( sorted.empty() )
+        return 0.0;
+    const size_t rank = min( sorted.size() - 1, size_t( p * double( sorted.size() ) ) );
+    return double( sorted[rank] ) * 1e-6;
+}
+
+vector<FrameProfiler::Stats> FrameProfiler::computeStats( const vector<Sample> &samples )
+{
+    vector<const char *> stages;
+    vector<vector<int64_t>> durations;
+    for( const Sample &sample : samples ) {
+        const size_t i = size_t( find_if( stages.begin(), stages.end(), [&]( const char *stage ) { return ! strcmp( stage, sample.mStage ); } ) - stages.begin() );
+        if( i == stages.size() ) {
+            stages.push_back( sample.mStage );
+            durations.emplace_back();
+        }
+        durations[i].push_back( sample.mDurationNs );
+    }
+    
+    vector<Stats> stats( stages.size() );
+    for( size_t i = 0; i < stages.size(); i++ ) {
+        sort( durations[i].begin(), durations[i].end() );
+        stats[i].mStage = stages[i];
+        stats[i].mCount = durations[i].size();
+        stats[i].mP50 = percentile( durations[i], 0.50 );
+        stats[i].mP95 = percentile( durations[i], 0.95 );
+        stats[i].mP99 = percentile( durations[i], 0.99 );
+    }
+    return stats;
+}
+
+FrameProfiler::Stats FrameProfiler::getStats( const char *stage ) const
+{
+    for( const Stats &stats : computeStats( getSamples() ) ) {
+        if( ! strcmp( stats.mStage, stage ) )
+            return stats;
+    }
+    return Stats{ stage, 0, 0.0, 0.0, 0.0 };
+}
+
+bool FrameProfiler::writeChromeTrace( const string &path ) const
+{
+    FILE *file = fopen( path.c_str(), "w" );
+    if( ! file )
+        return false;
+    
+    // Complete events ("ph": "X") in microseconds, one track per recording thread
+    const vector<Sample> samples = getSamples();
+    fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+    for( size_t i = 0; i < samples.size(); i++ ) {
+        const Sample &sample = samples[i];
+        fprintf( file, "{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                 sample.mStage, sample.mThread, double( sample.mStartNs ) * 1e-3, double( sample.mDurationNs ) * 1e-3,
+                 ( i + 1 < samples.size() ) ? "," : "" );
+    }
+    fprintf( file, "]}\n" );
+    return fclose( file ) == 0;
+}
+
+bool FrameProfiler::writeCsv( const string &path ) const
+{
+    FILE *file = fopen( path.c_str(), "w" );
+    if( ! file )
+        return false;
+    
+    fprintf( file, "stage,thread,start_us,duration_us\n" );
+    for( const Sample &sample : getSamples() )
+        fprintf( file, "%s,%u,%.3f,%.3f\n", sample.mStage, sample.mThread, double( sample.mStartNs ) * 1e-3, double( sample.mDurationNs ) * 1e-3 );
+    return fclose( file ) == 0;
+}
@@ -0,0 +1,265 @@
+#include "HeightFieldFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char kMagic[8] = "MPTHFLD";
+// Alignment of the first tile, so that the tiles can be mapped on their own pages
+static const uint64_t kDataAlignment = 4096;
+
+static_assert( sizeof( HeightFieldFileHeader ) <= kDataAlignment, "the header must fit before the first tile" );
+
+// IEEE half float conversions, rounding to nearest even
+static uint16_t floatToHalf( float value )
+{
+    uint32_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    const uint16_t sign = uint16_t( ( bits >> 16 ) & 0x8000 );
+    const uint32_t biasedExponent = ( bits >> 23 ) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if( biasedExponent == 0xff )
+        return sign | 0x7c00 | ( mantissa ? 0x200 : 0 );
+    const int exponent = int( biasedExponent ) - 127 + 15;
+    if( exponent >= 31 )
+        return sign | 0x7c00;
+    if( exponent <= 0 ) {
+        // subnormal half, or zero
+        if( exponent < -10 )
+            return sign;
+        mantissa |= 0x800000;
+        const uint32_t shift = uint32_t( 14 - exponent );
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ( ( 1u << shift ) - 1 );
+        const uint32_t halfway = 1u << ( shift - 1 );
+        if( rest > halfway || ( rest == halfway && ( half & 1 ) ) )
+            half++;
+        return sign | uint16_t( half );
+    }
+    // a carry out of the mantissa correctly bumps the exponent, up to infinity
+    uint32_t half = ( uint32_t( exponent ) << 10 ) | ( mantissa >> 13 );
+    const uint32_t rest = mantissa & 0x1fff;
+    if( rest > 0x1000 || ( rest == 0x1000 && ( half & 1 ) ) )
+        half++;
+    return sign | uint16_t( half );
+}
+
+static float halfToFloat( uint16_t half )
+{
+    const uint32_t sign = uint32_t( half & 0x8000 ) << 16;
+    uint32_t exponent = ( half >> 10 ) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if( exponent == 0x1f ) {
+        bits = sign | 0x7f800000 | ( mantissa << 13 );
+    }
+    else if( exponent == 0 ) {
+        if( mantissa == 0 ) {
+            bits = sign;
+        }
+        else {
+            // subnormal half, normalized as a float
+            exponent = 127 - 15 + 1;
+            while( ! ( mantissa & 0x400 ) ) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+        }
+    }
+    else {
+        bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+    }
+    float value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+}
+
+HeightFieldFileHeader HeightFieldFile::makeHeader( const HeightParams &params, size_t numColumns, size_t numRows, float originX, float originZ,
+                                                   HeightElementType type, uint32_t tileSize )
+{
+    HeightFieldFileHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.mMagic, kMagic, sizeof( kMagic ) );
+    header.mVersion = kVersion;
+    header.mElementType = type;
+    header.mNumColumns = uint32_t( numColumns );
+    header.mNumRows = uint32_t( numRows );
+    header.mTileSize = max<uint32_t>( tileSize, 1 );
+    header.mNumTilesX = uint32_t( ( numColumns + header.mTileSize - 1 ) / header.mTileSize );
+    header.mNumTilesZ = uint32_t( ( numRows + header.mTileSize - 1 ) / header.mTileSize );
+    header.mDataOffset = kDataAlignment;
+    header.mTileBytes = uint64_t( header.mTileSize ) * header.mTileSize * getElementSize( type );
+    header.mOriginX = originX;
+    header.mOriginZ = originZ;
+    header.mSpacing = params.mSpacing;
+    header.mHeightFunction = params.mHeightFunction;
+    header.mNoiseHash = params.mNoiseHash;
+    header.mNoiseSeed = params.mNoiseSeed;
+    header.mOctaves = params.mOctaves;
+    header.mNoiseFrequency = params.mNoiseFrequency;
+    header.mNoiseAmplitude = params.mNoiseAmplitude;
+    header.mNoiseLacunarity = params.mNoiseLacunarity;
+    header.mNoisePersistence = params.mNoisePersistence;
+    header.mHeightMult = params.mHeightMult;
+    header.mOffset = params.mOffset;
+    header.mTerrainOffset = params.mTerrainOffset;
+    header.mScrollRow = params.mScrollRow;
+    return header;
+}
+
+HeightFieldFileHeader HeightFieldFile::makeHeader( const HeightParams &params, const HeightField &field, HeightElementType type, uint32_t tileSize )
+{
+    return makeHeader( params, field.mGridX.size(), field.mGridZ.size(), field.mGridX[0], field.mRowZ[0], type, tileSize );
+}
+
+bool HeightFieldFile::write( const string &path, const HeightFieldFileHeader &headerIn, const RowFn &rowFn )
+{
+    HeightFieldFileHeader header = headerIn;
+    const size_t numColumns = header.mNumColumns;
+    const size_t numRows = header.mNumRows;
+    const size_t tileSize = header.mTileSize;
+    const HeightElementType type = HeightElementType( header.mElementType );
+    const size_t elementSize = getElementSize( type );
+    
+    // The range goes in the header, and sets the quantization of the uint16 samples
+    header.mHeightMin = header.mHeightMax = 0.0f;
+    for( size_t row = 0; row < numRows; row++ ) {
+        const auto range = minmax_element( rowFn( row ), rowFn( row ) + numColumns );
+        header.mHeightMin = ( row == 0 ) ? *range.first : min( header.mHeightMin, *range.first );
+        header.mHeightMax = ( row == 0 ) ? *range.second : max( header.mHeightMax, *range.second );
+    }
+    const float quantization = ( header.mHeightMax > header.mHeightMin ) ? 65535.0f / ( header.mHeightMax - header.mHeightMin ) : 0.0f;
+    
+    FILE *file = fopen( path.c_str(), "wb" );
+    if( ! file )
+        return false;
+    vector<uint8_t> bytes( size_t( header.mDataOffset ), 0 );
+    memcpy( bytes.data(), &header, sizeof( header ) );
+    bool written = fwrite( bytes.data(), 1, bytes.size(), file ) == bytes.size();
+    
+    // One row of tiles at a time, each tile filled from the rows it covers
+    bytes.resize( header.mNumTilesX * size_t( header.mTileBytes ) );
+    for( size_t tileZ = 0; tileZ < header.mNumTilesZ && written; tileZ++ ) {
+        fill( bytes.begin(), bytes.end(), 0 );
+        for( size_t tileRow = 0; tileRow < tileSize; tileRow++ ) {
+            const size_t row = tileZ * tileSize + tileRow;
+            if( row >= numRows )
+                break;
+            const float *heights = rowFn( row );
+            for( size_t column = 0; column < numColumns; column++ ) {
+                const size_t tileX = column / tileSize;
+                uint8_t *sample = &bytes[tileX * size_t( header.mTileBytes ) + ( tileRow * tileSize + column - tileX * tileSize ) * elementSize];
+                if( type == HEIGHT_FLOAT32 ) {
+                    memcpy( sample, &heights[column], sizeof( float ) );
+                }
+                else {
+                    const uint16_t value = ( type == HEIGHT_FLOAT16 ) ? floatToHalf( heights[column] )
+                                                                      : uint16_t( lroundf( ( heights[column] - header.mHeightMin ) * quantization ) );
+                    memcpy( sample, &value, sizeof( value ) );
+                }
+            }
+        }
+        written = fwrite( bytes.data(), 1, bytes.size(), file ) == bytes.size();
+    }
+    return ( fclose( file ) == 0 ) && written;
+}
+
+bool HeightFieldFile::write( const string &path, const HeightFieldFileHeader &header, const HeightField &field )
+{
+    const size_t numColumns = field.mGridX.size();
+    return write( path, header, [&field, numColumns]( size_t row ) { return &field.mHeights[field.rowSlot( row ) * numColumns]; } );
+}
+
+HeightFieldFileRef HeightFieldFile::open( const string &path )
+{
+    const int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+        return HeightFieldFileRef();
+    struct stat status;
+    void *data = MAP_FAILED;
+    if( fstat( fd, &status ) == 0 && size_t( status.st_size ) >= sizeof( HeightFieldFileHeader ) )
+        data = mmap( nullptr, size_t( status.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+    // the mapping stays valid once the file is closed
+    close( fd );
+    if( data == MAP_FAILED )
+        return HeightFieldFileRef();
+    
+    HeightFieldFileRef file( new HeightFieldFile( data, size_t( status.st_size ) ) );
+    const HeightFieldFileHeader &header = file->getHeader();
+    const bool valid = ! memcmp( header.mMagic, kMagic, sizeof( kMagic ) ) && header.mVersion == kVersion && header.mElementType <= HEIGHT_UINT16
+        && header.mTileSize > 0 && header.mNumColumns > 0 && header.mNumRows > 0
+        && header.mNumTilesX == ( header.mNumColumns + header.mTileSize - 1 ) / header.mTileSize
+        && header.mNumTilesZ == ( header.mNumRows + header.mTileSize - 1 ) / header.mTileSize
+        && header.mTileBytes == uint64_t( header.mTileSize ) * header.mTileSize * getElementSize( HeightElementType( header.mElementType ) )
+        && header.mDataOffset >= sizeof( HeightFieldFileHeader )
+        && header.mDataOffset + uint64_t( header.mNumTilesX ) * header.mNumTilesZ * header.mTileBytes <= file->mSize;
+    return valid ? file : HeightFieldFileRef();
+}
+
+HeightFieldFile::HeightFieldFile( void *data, size_t size )
+    : mData( data ), mSize( size ), mHeader( static_cast<const HeightFieldFileHeader *>( data ) )
+{
+}
+
+HeightFieldFile::~HeightFieldFile()
+{
+    munmap( mData, mSize );
+}
+
+const void* HeightFieldFile::getTile( size_t tileX, size_t tileZ ) const
+{
+    return static_cast<const uint8_t *>( mData ) + mHeader->mDataOffset + ( tileZ * mHeader->mNumTilesX + tileX ) * mHeader->mTileBytes;
+}
+
+void HeightFieldFile::readRows( size_t rowBegin, size_t rowEnd, void *dst, HeightElementType dstType ) const
+{
+    const size_t numColumns = mHeader->mNumColumns;
+    const size_t tileSize = mHeader->mTileSize;
+    const HeightElementType type = HeightElementType( mHeader->mElementType );
+    const size_t elementSize = getElementSize( type );
+    const float dequantization = ( mHeader->mHeightMax - mHeader->mHeightMin ) / 65535.0f;
+    uint8_t *dstRow = static_cast<uint8_t *>( dst );
+    
+    for( size_t row = rowBegin; row < rowEnd; row++ ) {
+        const size_t tileZ = row / tileSize;
+        const size_t tileRow = row - tileZ * tileSize;
+        for( size_t tileX = 0; tileX < mHeader->mNumTilesX; tileX++ ) {
+            const size_t columnBegin = tileX * tileSize;
+            const size_t count = min( tileSize, numColumns - columnBegin );
+            const uint8_t *src = static_cast<const uint8_t *>( getTile( tileX, tileZ ) ) + tileRow * tileSize * elementSize;
+            if( type == dstType ) {
+                memcpy( dstRow + columnBegin * elementSize, src, count * elementSize );
+                continue;
+            }
+            for( size_t i = 0; i < count; i++ ) {
+                float height;
+                if( type == HEIGHT_FLOAT32 ) {
+                    memcpy( &height, src + i * sizeof( float ), sizeof( float ) );
+                }
+                else {
+                    uint16_t value;
+                    memcpy( &value, src + i * sizeof( uint16_t ), sizeof( uint16_t ) );
+                    height = ( type == HEIGHT_FLOAT16 ) ? halfToFloat( value ) : mHeader->mHeightMin + float( value ) * dequantization;
+                }
+                if( dstType == HEIGHT_FLOAT32 ) {
+                    memcpy( dstRow + ( columnBegin + i ) * sizeof( float ), &height, sizeof( float ) );
+                }
+                else {
+                    const uint16_t half = floatToHalf( height );
+                    memcpy( dstRow + ( columnBegin + i ) * sizeof( uint16_t ), &half, sizeof( uint16_t ) );
+                }
+            }
+        }
+        dstRow += numColumns * getElementSize( dstType );
+    }
+}
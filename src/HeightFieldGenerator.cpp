@@ -0,0 +1,37 @@
+#include "HeightFieldGenerator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Bands per worker: more bands than workers lets the ones that finish early take over the remaining
+// bands, which evens out rows that are cheaper than others (and workers that get preempted).
+static const size_t kBandsPerWorker = 4;
+
+HeightFieldGenerator::HeightFieldGenerator( size_t numWorkers )
+    : mPool( ThreadPool::create( numWorkers ) )
+{
+}
+
+void HeightFieldGenerator::setNumWorkers( size_t numWorkers )
+{
+    if( numWorkers != getNumWorkers() )
+        mPool = ThreadPool::create( numWorkers );
+}
+
+void HeightFieldGenerator::generateRows( size_t numRows, const BandFn &bandFn, size_t minRowsPerBand )
+{
+    if( numRows == 0 )
+        return;
+    
+    const size_t numBands = max<size_t>( 1, min( getNumWorkers() * kBandsPerWorker, numRows / max<size_t>( minRowsPerBand, 1 ) ) );
+    // spread the remainder over the first bands so that they differ by one row at most
+    const size_t rowsPerBand = numRows / numBands;
+    const size_t remainder = numRows % numBands;
+    
+    mPool->parallelFor( numBands, [&]( size_t band ) {
+        const size_t rowBegin = band * rowsPerBand + min( band, remainder );
+        const size_t rowEnd = rowBegin + rowsPerBand + ( band < remainder ? 1 : 0 );
+        bandFn( rowBegin, rowEnd );
+    } );
+}
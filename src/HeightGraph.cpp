@@ -0,0 +1,384 @@
+#include "HeightGraph.h"
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+const vector<string> HeightGraph::kSourceNames = { "constant", "sine", "simplex", "fractal", "random" };
+
+// Frequencies and amplitudes of the sine height function along x and z
+static const float kSineFrequencyX = 1.1467f;
+static const float kSineFrequencyZ = 0.7325f;
+static const float kSineAmplitudeX = 0.323f;
+static const float kSineAmplitudeZ = 0.431f;
+// Shift of the warping noise, away from the noise it warps
+static const float kWarpShift = 71.3f;
+// Random heights keep the 24 high bits of their hash, as many as a float holds
+static const float kRandomScale = 1.0f / 16777216.0f;
+
+// Integer finalizer with a low bias, every input bit flips about half of the output bits
+static inline uint32_t mixBits( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+int HeightGraph::addNode( const HeightNode &node )
+{
+    mNodes.push_back( node );
+    return int( mNodes.size() - 1 );
+}
+
+static HeightNode makeNode( HeightNode::Op op, int a = -1, int b = -1 )
+{
+    HeightNode node;
+    node.mOp = op;
+    node.mInputs[0] = a;
+    node.mInputs[1] = b;
+    node.mValue = node.mValueZ = 0.0f;
+    node.mFrequencyX = node.mFrequencyZ = 0.0f;
+    node.mScale = 1.0f;
+    node.mShift = 0.0f;
+    return node;
+}
+
+int HeightGraph::constant( float value )
+{
+    HeightNode node = makeNode( HeightNode::CONSTANT );
+    node.mValue = value;
+    return addNode( node );
+}
+
+int HeightGraph::sine( float amplitudeX, float frequencyX, float amplitudeZ, float frequencyZ )
+{
+    HeightNode node = makeNode( HeightNode::SINE );
+    node.mValue = amplitudeX;
+    node.mValueZ = amplitudeZ;
+    node.mFrequencyX = frequencyX;
+    node.mFrequencyZ = frequencyZ;
+    return addNode( node );
+}
+
+int HeightGraph::simplex( float scale, float shift )
+{
+    HeightNode node = makeNode( HeightNode::SIMPLEX );
+    node.mScale = scale;
+    node.mShift = shift;
+    return addNode( node );
+}
+
+int HeightGraph::fractal( float scale, float shift )
+{
+    HeightNode node = makeNode( HeightNode::FRACTAL );
+    node.mScale = scale;
+    node.mShift = shift;
+    return addNode( node );
+}
+
+int HeightGraph::random()
+{
+    return addNode( makeNode( HeightNode::RANDOM ) );
+}
+
+int HeightGraph::source( int source )
+{
+    switch( source ) {
+        case HeightNode::SINE:      return sine( kSineAmplitudeX, kSineFrequencyX, kSineAmplitudeZ, kSineFrequencyZ );
+        case HeightNode::SIMPLEX:   return simplex();
+        case HeightNode::FRACTAL:   return fractal();
+        case HeightNode::RANDOM:    return random();
+        default:                    return constant( 1.0f );
+    }
+}
+
+int HeightGraph::add( int a, int b )
+{
+    return addNode( makeNode( HeightNode::ADD, a, b ) );
+}
+
+int HeightGraph::mul( int a, int b )
+{
+    return addNode( makeNode( HeightNode::MUL, a, b ) );
+}
+
+int HeightGraph::warp( int source, int offset, float strength )
+{
+    HeightNode node = makeNode( HeightNode::WARP, source, offset );
+    node.mValue = strength;
+    return addNode( node );
+}
+
+int HeightGraph::clamp( int a, float low, float high )
+{
+    HeightNode node = makeNode( HeightNode::CLAMP, a );
+    node.mValue = low;
+    node.mValueZ = high;
+    return addNode( node );
+}
+
+int HeightGraph::ridge( int a )
+{
+    return addNode( makeNode( HeightNode::RIDGE, a ) );
+}
+
+HeightGraph HeightGraph::makeLayers( const Layers &layers )
+{
+    HeightGraph graph;
+    int node = graph.source( layers.mBase );
+    if( layers.mWarp != 0.0f )
+        node = graph.warp( node, graph.simplex( 0.5f, kWarpShift ), layers.mWarp );
+    if( layers.mRidge )
+        node = graph.ridge( node );
+    if( layers.mDetail >= 0 ) {
+        const int detail = graph.mul( graph.constant( layers.mDetailWeight ), graph.source( layers.mDetail ) );
+        node = layers.mMultiplyDetail ? graph.mul( node, detail ) : graph.add( node, detail );
+    }
+    if( layers.mClamp )
+        graph.clamp( node, layers.mClampLow, layers.mClampHigh );
+    return graph;
+}
+
+HeightKernelRef HeightKernel::compile( const HeightGraph &graph )
+{
+    if( graph.empty() ) {
+        HeightGraph zero;
+        zero.constant( 0.0f );
+        return compile( zero );
+    }
+    shared_ptr<HeightKernel> kernel( new HeightKernel );
+    // registers[position][node]: register holding node evaluated at position, -1 until compiled
+    vector<vector<int>> registers( 1, vector<int>( graph.getNodes().size(), -1 ) );
+    kernel->mOutput = kernel->compileNode( graph, int( graph.getNodes().size() - 1 ), 0, registers );
+    return kernel;
+}
+
+int HeightKernel::compileNode( const HeightGraph &graph, int node, int position, vector<vector<int>> &registers )
+{
+    if( registers[position][node] >= 0 )
+        return registers[position][node];
+    
+    const HeightNode &graphNode = graph.getNodes()[node];
+    Instruction instruction;
+    instruction.mNode = graphNode;
+    instruction.mInputs[0] = instruction.mInputs[1] = -1;
+    instruction.mPosition = position;
+    instruction.mOutputPosition = -1;
+    int result;
+    if( graphNode.mOp == HeightNode::WARP ) {
+        // The offset is evaluated here, the warped source at a new position written by the warp
+        instruction.mInputs[0] = compileNode( graph, graphNode.mInputs[1], position, registers );
+        instruction.mOutputPosition = mNumPositions++;
+        instruction.mOutput = -1;
+        registers.emplace_back( graph.getNodes().size(), -1 );
+        mInstructions.push_back( instruction );
+        result = compileNode( graph, graphNode.mInputs[0], instruction.mOutputPosition, registers );
+    }
+    else {
+        for( int i = 0; i < 2; i++ ) {
+            if( graphNode.mInputs[i] >= 0 )
+                instruction.mInputs[i] = compileNode( graph, graphNode.mInputs[i], position, registers );
+        }
+        instruction.mOutput = mNumRegisters++;
+        mInstructions.push_back( instruction );
+        result = instruction.mOutput;
+    }
+    registers[position][node] = result;
+    return result;
+}
+
+void HeightKernel::evaluate( const HeightParams &params, const float *x, const float *z, float *heights, float *dx, float *dz, size_t count ) const
+{
+    // every register holds a value and its two partial derivatives, every position x, z and their jacobian
+    vector<float> scratch( ( size_t( mNumRegisters ) * 3 + size_t( mNumPositions ) * 6 ) * kBlockSize );
+    for( size_t begin = 0; begin < count; begin += kBlockSize ) {
+        const size_t blockCount = min( kBlockSize, count - begin );
+        float *blockDx = dx ? dx + begin : nullptr;
+        float *blockDz = dz ? dz + begin : nullptr;
+        if( params.mNoiseHash == seededHash )
+            evaluateBlock( params, params.mSeededNoise, params.mSeededFractal, x + begin, z + begin, heights + begin, blockDx, blockDz, blockCount, scratch.data() );
+        else
+            evaluateBlock( params, params.mNoise, params.mFractal, x + begin, z + begin, heights + begin, blockDx, blockDz, blockCount, scratch.data() );
+    }
+}
+
+template <typename Noise, typename Fractal>
+void HeightKernel::evaluateBlock( const HeightParams &params, const Noise &noise, const Fractal &fractalNoise, const float *x, const float *z,
+                                  float *heights, float *dx, float *dz, size_t count, float *scratch ) const
+{
+    const bool derivatives = ( dx != nullptr );
+    const size_t n = kBlockSize;
+    float *positions = scratch + size_t( mNumRegisters ) * 3 * n;
+    copy( x, x + count, positions );
+    copy( z, z + count, positions + n );
+    float scaledX[kBlockSize], scaledZ[kBlockSize];
+    
+    for( const Instruction &instruction : mInstructions ) {
+        const HeightNode &node = instruction.mNode;
+        // position: x, z, then d x / d x, d x / d z, d z / d x, d z / d z
+        const float *posX = positions + size_t( instruction.mPosition ) * 6 * n;
+        const float *posZ = posX + n;
+        const bool warped = ( instruction.mPosition != 0 );
+        float *out = ( instruction.mOutput >= 0 ) ? scratch + size_t( instruction.mOutput ) * 3 * n : nullptr;
+        float *outDx = out ? out + n : nullptr;
+        float *outDz = out ? out + 2 * n : nullptr;
+        const float *a = ( instruction.mInputs[0] >= 0 ) ? scratch + size_t( instruction.mInputs[0] ) * 3 * n : nullptr;
+        const float *b = ( instruction.mInputs[1] >= 0 ) ? scratch + size_t( instruction.mInputs[1] ) * 3 * n : nullptr;
+        bool positional = false;   // derivatives along the position of the instruction, to carry through its warps
+    
+        switch( node.mOp ) {
+            case HeightNode::CONSTANT:
+                fill( out, out + count, node.mValue );
+                if( derivatives ) {
+                    fill( outDx, outDx + count, 0.0f );
+                    fill( outDz, outDz + count, 0.0f );
+                }
+                break;
+            case HeightNode::SINE: {
+                const float offset = params.mOffset;
+                for( size_t i = 0; i < count; i++ ) {
+                    out[i] = node.mValue * sinf( posX[i] * node.mFrequencyX + offset ) + node.mValueZ * cosf( posZ[i] * node.mFrequencyZ + offset );
+                    if( derivatives ) {
+                        outDx[i] = node.mValue * node.mFrequencyX * cosf( posX[i] * node.mFrequencyX + offset );
+                        outDz[i] = -node.mValueZ * node.mFrequencyZ * sinf( posZ[i] * node.mFrequencyZ + offset );
+                    }
+                }
+                positional = true;
+                break;
+            }
+            case HeightNode::SIMPLEX:
+            case HeightNode::FRACTAL: {
+                const bool scaled = ( node.mScale != 1.0f || node.mShift != 0.0f );
+                if( scaled ) {
+                    for( size_t i = 0; i < count; i++ ) {
+                        scaledX[i] = posX[i] * node.mScale + node.mShift;
+                        scaledZ[i] = posZ[i] * node.mScale + node.mShift;
+                    }
+                }
+                const float *noiseX = scaled ? scaledX : posX;
+                const float *noiseZ = scaled ? scaledZ : posZ;
+                if( node.mOp == HeightNode::FRACTAL ) {
+                    if( derivatives )
+                        fractalNoise( noiseX, noiseZ, out, outDx, outDz, count );
+                    else
+                        fractalNoise( noiseX, noiseZ, out, count );
+                }
+                else {
+                    if( derivatives )
+                        noise.noise( noiseX, noiseZ, out, outDx, outDz, count );
+                    else
+                        noise.noise( noiseX, noiseZ, out, count );
+                }
+                if( derivatives && node.mScale != 1.0f ) {
+                    for( size_t i = 0; i < count; i++ ) {
+                        outDx[i] *= node.mScale;
+                        outDz[i] *= node.mScale;
+                    }
+                }
+                positional = true;
+                break;
+            }
+            case HeightNode::RANDOM: {
+                // Counter-based: each sample hashes its own position, so that the heights don't depend on the
+                // order nor the thread they are evaluated in, and repeat for the same params. Branchless
+                // integer math the compiler vectorizes.
+                const uint32_t key = mixBits( mixBits( uint32_t( params.mNoiseSeed ) ) ^ uint32_t( params.mTerrainOffset ) );
+                for( size_t i = 0; i < count; i++ ) {
+                    uint32_t bitsX, bitsZ;
+                    memcpy( &bitsX, &posX[i], sizeof( bitsX ) );
+                    memcpy( &bitsZ, &posZ[i], sizeof( bitsZ ) );
+                    out[i] = float( mixBits( mixBits( key ^ bitsX ) ^ bitsZ ) >> 8 ) * kRandomScale;
+                }
+                // no derivative to speak of
+                if( derivatives ) {
+                    fill( outDx, outDx + count, 0.0f );
+                    fill( outDz, outDz + count, 0.0f );
+                }
+                break;
+            }
+            case HeightNode::ADD:
+                for( size_t i = 0; i < count; i++ )
+                    out[i] = a[i] + b[i];
+                if( derivatives ) {
+                    for( size_t i = 0; i < count; i++ ) {
+                        outDx[i] = a[n + i] + b[n + i];
+                        outDz[i] = a[2 * n + i] + b[2 * n + i];
+                    }
+                }
+                break;
+            case HeightNode::MUL:
+                for( size_t i = 0; i < count; i++ )
+                    out[i] = a[i] * b[i];
+                if( derivatives ) {
+                    for( size_t i = 0; i < count; i++ ) {
+                        outDx[i] = a[n + i] * b[i] + a[i] * b[n + i];
+                        outDz[i] = a[2 * n + i] * b[i] + a[i] * b[2 * n + i];
+                    }
+                }
+                break;
+            case HeightNode::CLAMP:
+                for( size_t i = 0; i < count; i++ ) {
+                    const bool inside = ( a[i] > node.mValue && a[i] < node.mValueZ );
+                    out[i] = min( max( a[i], node.mValue ), node.mValueZ );
+                    if( derivatives ) {
+                        outDx[i] = inside ? a[n + i] : 0.0f;
+                        outDz[i] = inside ? a[2 * n + i] : 0.0f;
+                    }
+                }
+                break;
+            case HeightNode::RIDGE:
+                for( size_t i = 0; i < count; i++ ) {
+                    out[i] = 1.0f - fabsf( a[i] );
+                    if( derivatives ) {
+                        const float sign = ( a[i] < 0.0f ) ? 1.0f : -1.0f;
+                        outDx[i] = sign * a[n + i];
+                        outDz[i] = sign * a[2 * n + i];
+                    }
+                }
+                break;
+            case HeightNode::WARP: {
+                // the new position and its jacobian, from those of the position of the offset and its derivatives
+                float *warpX = positions + size_t( instruction.mOutputPosition ) * 6 * n;
+                const float strength = node.mValue;
+                for( size_t i = 0; i < count; i++ ) {
+                    warpX[i] = posX[i] + strength * a[i];
+                    warpX[n + i] = posZ[i] + strength * a[i];
+                }
+                if( derivatives ) {
+                    for( size_t i = 0; i < count; i++ ) {
+                        const float offsetDx = strength * a[n + i];
+                        const float offsetDz = strength * a[2 * n + i];
+                        warpX[2 * n + i] = ( warped ? posX[2 * n + i] : 1.0f ) + offsetDx;
+                        warpX[3 * n + i] = ( warped ? posX[3 * n + i] : 0.0f ) + offsetDz;
+                        warpX[4 * n + i] = ( warped ? posX[4 * n + i] : 0.0f ) + offsetDx;
+                        warpX[5 * n + i] = ( warped ? posX[5 * n + i] : 1.0f ) + offsetDz;
+                    }
+                }
+                break;
+            }
+        }
+    
+        // Sources under a warp have their derivatives along the warped position, back to x and z by the chain rule
+        if( derivatives && positional && warped ) {
+            for( size_t i = 0; i < count; i++ ) {
+                const float gradientX = outDx[i], gradientZ = outDz[i];
+                outDx[i] = gradientX * posX[2 * n + i] + gradientZ * posX[4 * n + i];
+                outDz[i] = gradientX * posX[3 * n + i] + gradientZ * posX[5 * n + i];
+            }
+        }
+    }
+    
+    const float *output = scratch + size_t( mOutput ) * 3 * n;
+    copy( output, output + count, heights );
+    if( derivatives ) {
+        copy( output + n, output + n + count, dx );
+        copy( output + 2 * n, output + 2 * n + count, dz );
+    }
+}
@@ -0,0 +1,142 @@
+#include "HeightTileCache.h"
+
+#include <cstring>
+
+using namespace std;
+
+bool HeightTileKey::operator==( const HeightTileKey &other ) const
+{
+    return mHeightFunction == other.mHeightFunction && mOctaves == other.mOctaves && mDerivatives == other.mDerivatives
+        && mHash == other.mHash && mSeed == other.mSeed
+        && mFrequency == other.mFrequency && mAmplitude == other.mAmplitude && mLacunarity == other.mLacunarity && mPersistence == other.mPersistence
+        && mSpacing == other.mSpacing && mOriginX == other.mOriginX && mOriginZ == other.mOriginZ
+        && mTileX == other.mTileX && mTileZ == other.mTileZ;
+}
+
+// FNV-1a over the fields, floats by their bit pattern
+template <typename T>
+static inline void hashField( size_t &hash, const T &value )
+{
+    unsigned char bytes[sizeof( T )];
+    memcpy( bytes, &value, sizeof( T ) );
+    for( size_t i = 0; i < sizeof( T ); i++ ) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+size_t HeightTileKeyHasher::operator()( const HeightTileKey &key ) const
+{
+    size_t hash = 14695981039346656037ULL;
+    hashField( hash, key.mHeightFunction );
+    hashField( hash, key.mOctaves );
+    hashField( hash, key.mDerivatives );
+    hashField( hash, key.mHash );
+    hashField( hash, key.mSeed );
+    hashField( hash, key.mFrequency );
+    hashField( hash, key.mAmplitude );
+    hashField( hash, key.mLacunarity );
+    hashField( hash, key.mPersistence );
+    hashField( hash, key.mSpacing );
+    hashField( hash, key.mOriginX );
+    hashField( hash, key.mOriginZ );
+    hashField( hash, key.mTileX );
+    hashField( hash, key.mTileZ );
+    return hash;
+}
+
+HeightTileCache::HeightTileCache( size_t budgetBytes )
+    : mBudget( budgetBytes ), mMemoryUsage( 0 ), mNumHits( 0 ), mNumMisses( 0 ), mNumEvictions( 0 )
+{
+}
+
+HeightTileCache::TileRef HeightTileCache::find( const HeightTileKey &key )
+{
+    lock_guard<mutex> lock( mMutex );
+    auto it = mIndex.find( key );
+    if( it == mIndex.end() ) {
+        ++mNumMisses;
+        return TileRef();
+    }
+    
+    ++mNumHits;
+    mTiles.splice( mTiles.begin(), mTiles, it->second );
+    return it->second->second;
+}
+
+void HeightTileCache::insert( const HeightTileKey &key, const TileRef &tile )
+{
+    lock_guard<mutex> lock( mMutex );
+    auto it = mIndex.find( key );
+    if( it != mIndex.end() ) {
+        mMemoryUsage -= it->second->second->size() * sizeof( float );
+        mTiles.erase( it->second );
+        mIndex.erase( it );
+    }
+    
+    mTiles.emplace_front( key, tile );
+    mIndex[key] = mTiles.begin();
+    mMemoryUsage += tile->size() * sizeof( float );
+    evict();
+}
+
+void HeightTileCache::clear()
+{
+    lock_guard<mutex> lock( mMutex );
+    mTiles.clear();
+    mIndex.clear();
+    mMemoryUsage = 0;
+}
+
+void HeightTileCache::setBudget( size_t budgetBytes )
+{
+    lock_guard<mutex> lock( mMutex );
+    mBudget = budgetBytes;
+    evict();
+}
+
+size_t HeightTileCache::getMemoryUsage() const
+{
+    lock_guard<mutex> lock( mMutex );
+    return mMemoryUsage;
+}
+
+size_t HeightTileCache::getNumTiles() const
+{
+    lock_guard<mutex> lock( mMutex );
+    return mTiles.size();
+}
+
+uint64_t HeightTileCache::getNumHits() const
+{
+    lock_guard<mutex> lock( mMutex );
+    return mNumHits;
+}
+
+uint64_t HeightTileCache::getNumMisses() const
+{
+    lock_guard<mutex> lock( mMutex );
+    return mNumMisses;
+}
+
+uint64_t HeightTileCache::getNumEvictions() const
+{
+    lock_guard<mutex> lock( mMutex );
+    return mNumEvictions;
+}
+
+void HeightTileCache::resetStats()
+{
+    lock_guard<mutex> lock( mMutex );
+    mNumHits = mNumMisses = mNumEvictions = 0;
+}
+
+void HeightTileCache::evict()
+{
+    while( mMemoryUsage > mBudget && ! mTiles.empty() ) {
+        mMemoryUsage -= mTiles.back().second->size() * sizeof( float );
+        mIndex.erase( mTiles.back().first );
+        mTiles.pop_back();
+        ++mNumEvictions;
+    }
+}
@@ -3,12 +3,33 @@
 #include "cinder/Camera.h"
 #include "cinder/params/Params.h"
 #include "cinder/gl/gl.h"
+#include "cinder/gl/BufferTexture.h"
 
 #include "cinder/CameraUi.h"
 #include "cinder/GeomIo.h"
 #include "cinder/ImageIo.h"
-#include "cinder/Rand.h"
+#include "cinder/TriMesh.h"
+#include "cinder/Utilities.h"
 #include "SimplexNoise.h"
+#include "HeightFieldGenerator.h"
+#include "HeightTileCache.h"
+#include "StreamingBuffer.h"
+#include "PlaneMeshPool.h"
+#include "ChunkedTerrain.h"
+#include "FrameProfiler.h"
+#include "TerrainGenerator.h"
+#include "ParamSnapshots.h"
+#include "TaskQueue.h"
+#include "HeightFieldFile.h"
+#include "BakedAnimation.h"
+
+#include "glm/gtc/packing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <limits>
 
 using namespace ci;
 using namespace ci::app;
@@ -21,12 +42,10 @@ void prepareSettings( App::Settings *settings )
     settings->setMultiTouchEnabled( false );
 }
 
-enum HeightFunction { sine, uniform, randnoise, fractal, simplex };
-const vector<string> heightFunctionNames = { "sine", "uniform", "randnoise", "fractal", "simplex" };
-
 class MeshParamTestApp : public App {
 public:
     void setup();
+    void cleanup();
     void resize();
     void update();
     void draw();
@@ -47,6 +66,78 @@ private:
     gl::GlslProgRef         mBlurShader;
     void                    updateNoise();
     SimplexNoise            mNoise;
+    SeededSimplexNoise      mSeededNoise;
+    void                    updateFractal();
+    PreparedFractal         mFractal;       // octave tables of mNoise, rebuilt when the fractal params change
+    SeededPreparedFractal   mSeededFractal;
+    int                     mNoiseHash;
+    int                     mNoiseSeed;
+    // Graph height function: the layers chosen in the params, built into mHeightGraph, compiled with each job
+    HeightGraph::Layers     mGraphLayers;
+    int                     mGraphDetail;   // 0 for none, else 1 + the detail source
+    int                     mGraphCombine;
+    HeightGraph             mHeightGraph;
+    int                     mGraphInstructions;
+    void                    updateHeightGraph();
+    HeightFieldGeneratorRef mGenerator;
+    int                     mNumWorkers;
+    // Pipelined generation: each frame presents the rows of the last completed job and starts the next one,
+    // which runs in the background while the frame is drawn. Every params change invalidates the generation
+    // of mTerrainGenerator, which stale jobs notice between rows: they stop there instead of finishing rows
+    // nobody will see.
+    TerrainGeneratorRef     mTerrainGenerator;
+    HeightFieldRef          mField;
+    // Every params change invalidates the heights; a change of the noise also their unscaled version, the
+    // others (the height multiplier) only make the jobs rescale them, see HeightParams::isRescalable()
+    void                    invalidateHeights( bool noiseChanged = true );
+    // The params callbacks only write the members: every change publishes a prepared copy of them to
+    // mParamSnapshots, which a job picks up once, from its own thread, without locks.
+    ParamSnapshotsRef       mParamSnapshots;
+    int                     mParamsVersion;
+    int                     mRetiredSnapshots;
+    uint64_t                mNoiseVersion;
+    int                     mFullUpdates;       // jobs by HeightUpdate, to see which path the params changes take
+    int                     mScrollUpdates;
+    int                     mRescaleUpdates;
+    int                     mSkippedUpdates;
+    HeightParams            makeSnapshotParams() const;
+    HeightParams            makeHeightParams() const;
+    static HeightParams     makeHeightParams( ParamSnapshots &snapshots, uint64_t generationId, float offset, int terrainOffset, int64_t scrollRow );
+    void                    presentJob( const HeightJob &job );
+    bool                    mBackgroundGeneration;
+    int                     mCancelledJobs;
+    TaskQueueRef            mJobQueue;      // runs the jobs, one at a time, on a thread kept for the app's lifetime
+    future<HeightJob>       mJob;
+    size_t                  mDrawnRingBaseRow;  // ring base row of the rows uploaded to the VBO
+    vec2                    mGridOrigin;        // x of the first column, z of the first row slot
+    size_t                  mNumVertices;
+    bool                    mHalfHeights;   // heights uploaded as half floats to a buffer texture
+    vector<uint16_t>        mHalfStaging;   // heights converted for the upload in half float mode
+    gl::VboRef              mHeightTextureVbo;
+    gl::BufferTextureRef    mHeightTexture; // over mHeightTextureVbo, or the regions of mHeightStream
+    bool                    heightsInTexture() const { return mHalfHeights || mStreamingUpload; }
+    // Streaming upload: the heights go to the next region of a triple-buffered (persistently mapped when
+    // supported) buffer, so that they are written while the GPU still reads the previous regions.
+    bool                    mStreamingUpload;
+    bool                    mPersistentMapping;
+    StreamingBufferRef      mHeightStream;
+    void                    uploadStream( const HeightField &field );
+    int                     mStreamMaps, mStreamWaits;
+    float                   mStreamWaitMs;
+    string                  mStreamMode;
+    bool                    mNormalsEnabled;
+    gl::VboRef              findVbo( geom::Attrib attrib ) const;
+    void                    uploadRows( const HeightField &field, size_t rowBegin, size_t rowEnd );
+    bool                    mScrollMode;
+    int64_t                 mScrollRow;     // index of the first displayed row on the infinite row grid
+    bool                    mAutoScroll;
+    void                    setScrollRow( int row ) { mScrollRow = row; }
+    int                     getScrollRow() { return (int)mScrollRow; }
+    // Tile cache: rows are assembled from cached tiles of unscaled heights when the parameters allow it
+    HeightTileCacheRef      mTileCache;
+    bool                    mTileCacheEnabled;
+    int                     mTileCacheBudgetMB;
+    int                     mCacheHits, mCacheMisses, mCacheTiles;
     float                   mNoiseFrequency;
     float                   mNoiseAmplitude;
     float                   mNoiseLacunarity;
@@ -59,6 +150,17 @@ private:
     void                    setPlaneSubdivisions(int subdivisions);
     int                     getPlaneSize() { return mPlaneSize; }
     int                     getPlaneSubdivisions() { return mPlaneSubdivisions; }
+    // The sliders only request a rebuild, done once they stopped moving for kPlaneRebuildDelay seconds;
+    // until then the mesh keeps its own dimensions, mMeshSubdivisions and mGridSpacing.
+    PlaneMeshPoolRef        mMeshPool;
+    PlaneMeshPool::GridRef  mGrid;
+    bool                    mPlaneRebuildPending;
+    double                  mPlaneRebuildTime;
+    void                    requestPlaneRebuild();
+    int                     mMeshSubdivisions;
+    float                   mGridSpacing;
+    int                     mMeshRebuilds;
+    int                     mPooledGrids, mBufferReuses;
     HeightFunction          mHeightFunction;
     int                     mSelectedHeightFunction;
     vec3                    mCameraEyePoint;
@@ -69,18 +171,107 @@ private:
     int                     mTerrainOffset;
     double                  m_fLastTime;
     gl::GlslProgRef         mWireframeShader;
+    void                    drawHeights();
+    // GPU noise mode: wireframe-noise.vert evaluates the noise heights of every vertex, so nothing is
+    // generated nor uploaded per frame; the noise params are uniforms, set by updateNoiseUniforms().
+    bool                    mGpuNoise;
+    bool                    gpuNoiseActive() const { return mGpuNoise && ( mHeightFunction == fractal || mHeightFunction == simplex ); }
+    gl::GlslProgRef         mNoiseShader;
+    gl::BatchRef            mNoiseBatch;
+    void                    drawGpuNoise();
+    void                    updateNoiseUniforms();
+    void                    setNoiseFrameUniforms( const gl::GlslProgRef &shader ) const;
+    float                   noiseOffsetZ() const;
+    // Chunked terrain mode: a quadtree of chunks, at a resolution decreasing with the distance to the eye,
+    // replaces the plane; see ChunkedTerrain.h
+    bool                    mChunkedTerrain;
+    bool                    chunkedTerrainActive() const { return mChunkedTerrain && ( mHeightFunction == fractal || mHeightFunction == simplex ); }
+    ChunkedTerrainRef       mTerrain;
+    gl::GlslProgRef         mTerrainShader;
+    float                   mTerrainSize;
+    int                     mTerrainMaxDepth;
+    float                   mTerrainLodFactor;
+    int                     mTerrainResolution;
+    int                     mChunksDrawn, mChunksCulled, mChunksGenerated;
+    void                    updateTerrain();
+    template <typename Hash>
+    void                    evaluateTerrain( const BasicSimplexNoise<Hash> &noise, const float *x, const float *z, float *heights, size_t count, float spacing ) const;
+    // Wireframe: the vertex shaders output the grid position of the vertices, from which wireframe-grid.frag finds
+    // the edges, or wireframe.geom emits the barycentric coordinates of each triangle. The benchmark times the
+    // draws of the mesh with both, at the next draw().
+    bool                    mGeometryShaderWireframe;
+    bool                    mWireframeBenchmarkPending;
+    string                  mWireframeBenchmark;
+    void                    updateWireframeShaders();
+    void                    drawMesh();
+    void                    benchmarkWireframe();
+    // Stage timing: PROFILE_STAGE scopes record into mProfiler, from the main thread and the generation
+    // threads alike; the params show the percentiles of each stage, refreshed every kTimingRefreshInterval.
+    FrameProfilerRef        mProfiler;
+    vector<string>          mStageTimings;  // "p50 / p95 / p99 ms" of each kTimedStages
+    double                  mTimingRefreshTime;
+    void                    updateStageTimings();
+    void                    dumpTrace();
+    // Heightfield files: the plane is exported as a HeightFieldFile, and a loaded one is shown until the params
+    // change, its samples copied from the file mapping straight into the mapped height buffer.
+    HeightFieldFileRef      mLoadedField;
+    int                     mExportElementType;
+    string                  mFieldFileStatus;
+    void                    exportField();
+    void                    loadField();
+    void                    uploadLoadedField();
+    void                    uploadNormals();
+    // Baked animations: the plane heights are baked over time on a background thread, and a baked animation
+    // plays back until the params change, its frames decoded ahead by the player on its I/O thread.
+    BakedAnimationPlayerRef mPlayer;
+    double                  mPlaybackStart;
+    uint64_t                mPlaybackFrame;     // frame uploaded last
+    int                     mLateFrames;
+    int                     mBakeFrames;
+    future<bool>            mBakeJob;
+    shared_ptr<atomic<size_t>> mBakeProgress;   // frames baked, shared with the bake job
+    shared_ptr<atomic<bool>> mBakeCancel;
+    string                  mAnimationStatus;
+    void                    bakeAnimation();
+    void                    playAnimation();
+    void                    updatePlayback();
+    void                    uploadHeights( const float *heights );
 };
 
+// Time without a change of the plane dimensions before the mesh is rebuilt
+static const double kPlaneRebuildDelay = 0.15;
+// Frame rate of the baked animations
+static const float kBakeFramesPerSecond = 60.0f;
+// Draws of the mesh timed with each wireframe path
+static const int kWireframeBenchmarkDraws = 20;
+// Timed stages shown in the params, the generation ones are timed by TerrainGenerator
+static const char * const kStageUpdate = "update";
+static const char * const kStageRebuild = "rebuild mesh";
+static const char * const kStageUpload = "upload";
+static const char * const kStageTerrain = "terrain";
+static const char * const kStageDraw = "draw";
+static const char * const kStageDrawMesh = "draw mesh";
+static const char * const kStageDrawParams = "draw params";
+static const char * const kTimedStages[] = { kStageUpdate, kStageRebuild, "generate", "generate band", kStageUpload,
+                                             kStageTerrain, kStageDraw, kStageDrawMesh, kStageDrawParams };
+static const double kTimingRefreshInterval = 0.5;
+
 void MeshParamTestApp::setPlaneSubdivisions( int subdivisions)
 {
     mPlaneSubdivisions = subdivisions;
-    updatePlaneDimensions();
+    requestPlaneRebuild();
 }
 
 void MeshParamTestApp::setPlaneSize( int size)
 {
     mPlaneSize = size;
-    updatePlaneDimensions();
+    requestPlaneRebuild();
+}
+
+void MeshParamTestApp::requestPlaneRebuild()
+{
+    mPlaneRebuildPending = true;
+    mPlaneRebuildTime = getElapsedSeconds();
 }
 
 void MeshParamTestApp::setup()
@@ -90,22 +281,112 @@ void MeshParamTestApp::setup()
     mHeightFunction = fractal;
     mSelectedHeightFunction = fractal;
     mTerrainOffset = 0;
+    mScrollMode = false;
+    mScrollRow = 0;
+    mAutoScroll = true;
+    mBackgroundGeneration = true;
+    mCancelledJobs = 0;
+    mDrawnRingBaseRow = 0;
+    mMeshPool = PlaneMeshPool::create();
+    mPlaneRebuildPending = false;
+    mPlaneRebuildTime = 0;
+    mMeshRebuilds = mPooledGrids = mBufferReuses = 0;
+    mGpuNoise = false;
+    mChunkedTerrain = false;
+    mTerrainSize = 512.0f;
+    mTerrainMaxDepth = 8;
+    mTerrainLodFactor = 2.0f;
+    mTerrainResolution = ChunkedTerrain::kChunkQuads << mTerrainMaxDepth;
+    mChunksDrawn = mChunksCulled = mChunksGenerated = 0;
+    mGeometryShaderWireframe = false;
+    mWireframeBenchmarkPending = false;
+    mWireframeBenchmark = "not run";
+    mProfiler = FrameProfiler::create();
+    mStageTimings.resize( sizeof( kTimedStages ) / sizeof( kTimedStages[0] ) );
+    mTimingRefreshTime = 0;
+    mExportElementType = HEIGHT_FLOAT32;
+    mFieldFileStatus = "none";
+    mPlaybackStart = 0;
+    mPlaybackFrame = 0;
+    mLateFrames = 0;
+    mBakeFrames = 300;
+    mBakeProgress = make_shared<atomic<size_t>>( 0 );
+    mBakeCancel = make_shared<atomic<bool>>( false );
+    mAnimationStatus = "none";
+    
+    mNormalsEnabled = false;
+    mHalfHeights = false;
+    mStreamingUpload = false;
+    mPersistentMapping = true;
+    mStreamMaps = mStreamWaits = 0;
+    mStreamWaitMs = 0;
+    
+    mTileCacheEnabled = false;
+    mTileCacheBudgetMB = 64;
+    mCacheHits = mCacheMisses = mCacheTiles = 0;
+    mTileCache = HeightTileCache::create( size_t( mTileCacheBudgetMB ) << 20 );
+    mTerrainGenerator = TerrainGenerator::create( mTileCache );
+    mTerrainGenerator->setProfiler( mProfiler );
+    mParamsVersion = mRetiredSnapshots = 0;
+    mNoiseVersion = 1;
+    mFullUpdates = mScrollUpdates = mRescaleUpdates = mSkippedUpdates = 0;
+    
+    mGenerator = HeightFieldGenerator::create();
+    mNumWorkers = (int)mGenerator->getNumWorkers();
+    mJobQueue = TaskQueue::create();
     
     setupParams();
     updateNoise();
     setupShader();
     setupPlane();
+    mParamSnapshots = ParamSnapshots::create( makeSnapshotParams() );
+    mParamsVersion = (int)mParamSnapshots->getVersion();
     udpatePlaneHeights();
 }
 
+void MeshParamTestApp::cleanup()
+{
+    // let the job in flight notice it is stale, and wait for it since it uses the generator and the cache
+    invalidateHeights();
+    if( mJob.valid() )
+        mJob.wait();
+    *mBakeCancel = true;
+    if( mBakeJob.valid() )
+        mBakeJob.wait();
+}
+
+void MeshParamTestApp::updateHeightGraph()
+{
+    mGraphLayers.mDetail = mGraphDetail - 1;
+    mGraphLayers.mMultiplyDetail = ( mGraphCombine == 1 );
+    mHeightGraph = HeightGraph::makeLayers( mGraphLayers );
+    mGraphInstructions = (int)HeightKernel::compile( mHeightGraph )->getNumInstructions();
+    invalidateHeights();
+}
+
 void MeshParamTestApp::updateNoise()
 {
     // successive octaves of coherent noise, each with higher frequency and lower amplitude
-    cout << "updating noise " << mNoiseFrequency << ", " << mNoiseAmplitude << ", " << mNoiseLacunarity << ", " << mNoisePersistence << "\n";
     mNoise.mFrequency = mNoiseFrequency;
     mNoise.mAmplitude = mNoiseAmplitude;
     mNoise.mLacunarity = mNoiseLacunarity;
     mNoise.mPersistence = mNoisePersistence;
+    
+    mSeededNoise.mFrequency = mNoiseFrequency;
+    mSeededNoise.mAmplitude = mNoiseAmplitude;
+    mSeededNoise.mLacunarity = mNoiseLacunarity;
+    mSeededNoise.mPersistence = mNoisePersistence;
+    mSeededNoise.mHash = SimplexIntegerHash( mNoiseSeed );
+    updateFractal();
+    invalidateHeights();
+}
+
+void MeshParamTestApp::updateFractal()
+{
+    // frequencies and amplitudes of every octave are computed once here instead of for every vertex
+    mFractal = PreparedFractal( mNoise, mOctaves );
+    mSeededFractal = SeededPreparedFractal( mSeededNoise, mOctaves );
+    updateNoiseUniforms();
 }
 
 void MeshParamTestApp::setupShader()
@@ -115,9 +396,19 @@ void MeshParamTestApp::setupShader()
         mBlurShader = gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "blur.vert" ) )
                                      .fragment( loadAsset( "blur.frag" ) ));
         
-        mWireframeShader = gl::GlslProg::create(loadAsset("wireframe.vert"),
-                                                loadAsset("wireframe.frag"),
-                                                loadAsset("wireframe.geom"));
+        // Without the geometry shader, the fragment shader finds the edges from the grid position of the vertices
+        auto wireframeFormat = [this]( const string &vertex ) {
+            auto format = gl::GlslProg::Format().vertex( loadAsset( vertex ) );
+            if( mGeometryShaderWireframe )
+                format.fragment( loadAsset( "wireframe.frag" ) ).geometry( loadAsset( "wireframe.geom" ) );
+            else
+                format.fragment( loadAsset( "wireframe-grid.frag" ) );
+            return format;
+        };
+        mWireframeShader = gl::GlslProg::create( wireframeFormat( "wireframe.vert" ).attrib( geom::Attrib::CUSTOM_0, "aHeight" ) );
+        mNoiseShader = gl::GlslProg::create( wireframeFormat( "wireframe-noise.vert" ) );
+        updateNoiseUniforms();
+        mTerrainShader = gl::GlslProg::create( wireframeFormat( "terrain-chunk.vert" ).attrib( geom::Attrib::CUSTOM_0, "aHeight" ) );
     }
     catch( gl::GlslProgCompileExc ex ) {
         cout << ex.what() << endl;
@@ -125,9 +416,18 @@ void MeshParamTestApp::setupShader()
     }
 }
 
+void MeshParamTestApp::updateWireframeShaders()
+{
+    setupShader();
+    mBatch = gl::Batch::create( mVboMesh, mWireframeShader );
+    mNoiseBatch = gl::Batch::create( mVboMesh, mNoiseShader );
+    mTerrain->setShader( mTerrainShader );
+}
+
 void MeshParamTestApp::setupPlane()
 {
     updatePlaneDimensions();
+    mTerrain = ChunkedTerrain::create( mTerrainShader );
     
     mTexture = gl::Texture::create(loadImage(loadAsset("cinder_logo.png")),
                                    gl::Texture::Format().loadTopDown() );
@@ -137,59 +437,291 @@ void MeshParamTestApp::setupPlane()
 
 void MeshParamTestApp::updatePlaneDimensions()
 {
-    // create some geometry using a geom::Plane
-    auto plane = geom::Plane().size( vec2(mPlaneSize, mPlaneSize) ).subdivisions( ivec2(mPlaneSubdivisions, mPlaneSubdivisions) );
+    // The indices and tex coords only depend on the subdivisions, they come from the pool
+    // along with the grid of a plane of size 1, scaled below.
+    PROFILE_STAGE( mProfiler, kStageRebuild );
+    mPlaneRebuildPending = false;
+    mGrid = mMeshPool->getGrid( mPlaneSubdivisions );
+    mMeshSubdivisions = mPlaneSubdivisions;
+    mGridSpacing = mPlaneSize / (float)mPlaneSubdivisions;
+    const uint32_t numColumns = mGrid->getNumColumns();
+    const uint32_t numRows = mGrid->getNumRows();
+    const size_t numVertices = mGrid->getNumVertices();
+    
+    // The per-vertex buffers of the previous mesh go back to the pool and are reused if large enough
+    if( mVboMesh ) {
+        for( const auto &layoutVbo : mVboMesh->getVertexArrayLayoutVbos() ) {
+            if( ! layoutVbo.first.hasAttrib( geom::Attrib::TEX_COORD_0 ) )
+                mMeshPool->releaseBuffer( layoutVbo.second );
+        }
+    }
+    mMeshPool->releaseBuffer( mHeightTextureVbo );
     
-    // Specify two planar buffers - positions are dynamic because they will be modified
-    // in the update() loop. Tex Coords are static since we don't need to update them.
-    vector<gl::VboMesh::Layout> bufferLayout = {
-        gl::VboMesh::Layout().usage( GL_DYNAMIC_DRAW ).attrib( geom::Attrib::POSITION, 3 ),
-        gl::VboMesh::Layout().usage( GL_STATIC_DRAW ).attrib( geom::Attrib::TEX_COORD_0, 2 )
-    };
+    // Specify planar buffers - the heights are dynamic because they will be modified in the update() loop,
+    // as a single float per vertex (CUSTOM_0) since x and z never change: the vertex shader rebuilds them.
+    // Tex Coords are static since we don't need to update them.
+    vector<pair<geom::BufferLayout, gl::VboRef>> vertexBuffers;
+    geom::BufferLayout texCoordLayout;
+    texCoordLayout.append( geom::Attrib::TEX_COORD_0, 2, 0, 0 );
+    vertexBuffers.push_back( make_pair( texCoordLayout, mGrid->mTexCoords ) );
+    // VboMesh attributes can't be half floats, those go to a buffer texture fetched by gl_VertexID instead,
+    // and so do the streamed ones, the current region being selected by an offset
+    if( ! heightsInTexture() ) {
+        geom::BufferLayout heightLayout;
+        heightLayout.append( geom::Attrib::CUSTOM_0, 1, 0, 0 );
+        vertexBuffers.push_back( make_pair( heightLayout, mMeshPool->acquireBuffer( GL_ARRAY_BUFFER, numVertices * sizeof( float ) ) ) );
+    }
+    // Normals are optional, in their own dynamic buffer filled along with the heights
+    if( mNormalsEnabled ) {
+        geom::BufferLayout normalLayout;
+        normalLayout.append( geom::Attrib::NORMAL, 3, 0, 0 );
+        vertexBuffers.push_back( make_pair( normalLayout, mMeshPool->acquireBuffer( GL_ARRAY_BUFFER, numVertices * sizeof( vec3 ) ) ) );
+    }
     
-    mVboMesh = gl::VboMesh::create( plane, bufferLayout );
+    mVboMesh = gl::VboMesh::create( (uint32_t)numVertices, GL_TRIANGLES, vertexBuffers, mGrid->mNumIndices, GL_UNSIGNED_INT, mGrid->mIndices );
+    // the batches only change with the mesh, not every frame
+    mBatch = gl::Batch::create( mVboMesh, mWireframeShader );
+    mNoiseBatch = gl::Batch::create( mVboMesh, mNoiseShader );
+    const size_t heightBytes = mHalfHeights ? sizeof( uint16_t ) : sizeof( float );
+    const GLenum heightFormat = mHalfHeights ? GL_R16F : GL_R32F;
+    mHeightTextureVbo.reset();
+    mHeightTexture.reset();
+    mHeightStream.reset();
+    if( mStreamingUpload ) {
+        mHeightStream = StreamingBuffer::create( GL_TEXTURE_BUFFER, numVertices * heightBytes, 3, mPersistentMapping );
+        mHeightTexture = gl::BufferTexture::create( mHeightStream->getVbo(), heightFormat );
+        mStreamMode = ( mHeightStream->getMode() == StreamingBuffer::PERSISTENT_MAPPED ) ? "persistent" : "map range";
+    }
+    else if( mHalfHeights ) {
+        mHeightTextureVbo = mMeshPool->acquireBuffer( GL_TEXTURE_BUFFER, numVertices * heightBytes );
+        mHeightTexture = gl::BufferTexture::create( mHeightTextureVbo, heightFormat );
+        mStreamMode = "off";
+    }
+    else {
+        mStreamMode = "off";
+    }
+    mMeshRebuilds++;
+    mPooledGrids = (int)mMeshPool->getNumGridBuilds();
+    mBufferReuses = (int)mMeshPool->getNumBufferReuses();
+    mHalfStaging.resize( mHalfHeights ? numVertices : 0 );
+    mNumVertices = numVertices;
     mTerrainOffset = 0;
+    mScrollRow = 0;
+    mDrawnRingBaseRow = 0;
+    invalidateHeights();
+    
+    // A new CPU copy of the heights to generate them into, a job still running on the previous one drops it.
+    // The plane is a regular grid, x only depends on the column and z on the row.
+    vector<float> gridX( numColumns ), gridZ( numRows );
+    for( uint32_t column = 0; column < numColumns; column++ )
+        gridX[column] = mGrid->mUnitX[column] * mPlaneSize;
+    for( uint32_t row = 0; row < numRows; row++ )
+        gridZ[row] = mGrid->mUnitZ[row] * mPlaneSize;
+    auto field = HeightField::create( gridX, gridZ, mNormalsEnabled );
+    mGridOrigin = vec2( field->mGridX[0], field->mGridZ[0] );
+    mField = field;
 }
 
 void MeshParamTestApp::udpatePlaneHeights()
 {
-    float offset = getElapsedSeconds() * 4.0f;
-    
+    bool scrolled = false;
     if (cinder::app::getElapsedSeconds() >= m_fLastTime + 0.3) {
         m_fLastTime += 0.1;
         mTerrainOffset += 1;
+        scrolled = true;
+    }
+    
+    // The ring and the cache need the scrolling snapped to the row spacing: it advances by whole rows,
+    // about one unit per step like mTerrainOffset, so that rows always fall on the same lattice.
+    const bool positional = ( mHeightFunction == fractal || mHeightFunction == simplex || mHeightFunction == uniform );
+    if( positional && ( mScrollMode || mTileCacheEnabled ) && scrolled && mAutoScroll ) {
+        mScrollRow += max<int64_t>( 1, lroundf( 1.0f / mGridSpacing ) );
+    }
+    // the vertex shader evaluates the heights itself
+    if( gpuNoiseActive() )
+        return;
+    // the heights of a loaded file stay until the params change
+    if( mLoadedField )
+        return;
+    if( mPlayer ) {
+        updatePlayback();
+        return;
+    }
+    
+    // Present the rows of the last completed job. The main thread never waits for a job:
+    // while one is still running it keeps drawing the rows presented last.
+    if( mJob.valid() ) {
+        if( mJob.wait_for( chrono::seconds( 0 ) ) != future_status::ready )
+            return;
+        presentJob( mJob.get() );
+    }
+    
+    // Start the next job, it runs while this frame is drawn: it picks up the params snapshot itself, and
+    // only takes where the plane is at this frame from here
+    if( mBackgroundGeneration ) {
+        const uint64_t generationId = mTerrainGenerator->getGenerationId();
+        const float offset = getElapsedSeconds() * 4.0f;
+        const int terrainOffset = mTerrainOffset;
+        const int64_t scrollRow = mScrollRow;
+        const ParamSnapshotsRef snapshots = mParamSnapshots;
+        const HeightFieldRef field = mField;
+        const HeightFieldGeneratorRef generator = mGenerator;
+        const TerrainGeneratorRef terrainGenerator = mTerrainGenerator;
+        mJob = mJobQueue->push( [=] {
+            return terrainGenerator->run( makeHeightParams( *snapshots, generationId, offset, terrainOffset, scrollRow ), field, generator );
+        } );
+    }
+    else {
+        presentJob( mTerrainGenerator->run( makeHeightParams(), mField, mGenerator ) );
+    }
+}
+
+void MeshParamTestApp::invalidateHeights( bool noiseChanged )
+{
+    // publish before invalidating: a job that sees the new generation id gets the new params
+    if( noiseChanged )
+        mNoiseVersion++;
+    if( mParamSnapshots ) {
+        mParamsVersion = (int)mParamSnapshots->publish( makeSnapshotParams() );
+        mRetiredSnapshots = (int)mParamSnapshots->getNumRetired();
     }
+    mTerrainGenerator->invalidate();
+    mLoadedField.reset();
+    mPlayer.reset();
+    if( mTerrain )
+        mTerrain->clear();
+}
+
+HeightParams MeshParamTestApp::makeSnapshotParams() const
+{
+    HeightParams params;
+    params.mGenerationId = 0;
+    params.mNoiseVersion = mNoiseVersion;
+    params.mHeightFunction = mHeightFunction;
+    params.mNoiseHash = mNoiseHash;
+    params.mNoiseSeed = mNoiseSeed;
+    params.mOctaves = mOctaves;
+    params.mNoiseFrequency = mNoiseFrequency;
+    params.mNoiseAmplitude = mNoiseAmplitude;
+    params.mNoiseLacunarity = mNoiseLacunarity;
+    params.mNoisePersistence = mNoisePersistence;
+    params.mNoise = mNoise;
+    params.mSeededNoise = mSeededNoise;
+    params.mFractal = mFractal;
+    params.mSeededFractal = mSeededFractal;
+    params.mHeightMult = mHeightMult;
+    params.mSpacing = mGridSpacing;
+    params.mNormals = mNormalsEnabled;
+    params.mScrollMode = mScrollMode;
+    params.mTileCache = mTileCacheEnabled;
+    params.mOffset = 0;
+    params.mTerrainOffset = 0;
+    params.mScrollRow = 0;
+    params.mGraph = mHeightGraph;
+    params.prepareKernel();
+    return params;
+}
+
+HeightParams MeshParamTestApp::makeHeightParams() const
+{
+    return makeHeightParams( *mParamSnapshots, mTerrainGenerator->getGenerationId(), getElapsedSeconds() * 4.0f, mTerrainOffset, mScrollRow );
+}
+
+HeightParams MeshParamTestApp::makeHeightParams( ParamSnapshots &snapshots, uint64_t generationId, float offset, int terrainOffset, int64_t scrollRow )
+{
+    // The generation id is read before the snapshot is acquired: a newer snapshot only makes the job stale sooner.
+    // The snapshot is held just for the copy, its prepared kernel is shared.
+    HeightParams params = *snapshots.acquire();
+    params.mGenerationId = generationId;
+    params.mOffset = offset;
+    params.mTerrainOffset = terrainOffset;
+    params.mScrollRow = scrollRow;
+    return params;
+}
+
+void MeshParamTestApp::presentJob( const HeightJob &job )
+{
+    // A job on a previous plane has nothing to present, and a cancelled one left rows unfinished:
+    // the VBO keeps the rows presented last, the next job regenerates them all.
+    if( job.mField != mField )
+        return;
+    if( job.mCancelled ) {
+        mCancelledJobs++;
+        return;
+    }
+    int *updates[] = { &mFullUpdates, &mScrollUpdates, &mRescaleUpdates, &mSkippedUpdates };
+    ( *updates[job.mUpdate] )++;
+    
+    PROFILE_STAGE( mProfiler, kStageUpload );
+    mDrawnRingBaseRow = mField->mRingBaseRow;
+    if( job.mRowBegin != job.mRowEnd )
+        uploadRows( *mField, job.mRowBegin, job.mRowEnd );
+    
+    mCacheHits = (int)mTileCache->getNumHits();
+    mCacheMisses = (int)mTileCache->getNumMisses();
+    mCacheTiles = (int)mTileCache->getNumTiles();
+}
+
+gl::VboRef MeshParamTestApp::findVbo( geom::Attrib attrib ) const
+{
+    for( const auto &layoutVbo : mVboMesh->getVertexArrayLayoutVbos() ) {
+        if( layoutVbo.first.hasAttrib( attrib ) )
+            return layoutVbo.second;
+    }
+    return gl::VboRef();
+}
+
+void MeshParamTestApp::uploadRows( const HeightField &field, size_t rowBegin, size_t rowEnd )
+{
+    // Upload the row slots of displayed rows [rowBegin, rowEnd), in at most two contiguous
+    // ranges since they can wrap around the end of the ring. Uploads are write-only sub-data
+    // updates of the heights (4 or 2 bytes per vertex) and the normals when enabled.
+    const size_t numRows = field.mGridZ.size();
+    const size_t numColumns = field.mGridX.size();
+    if( mStreamingUpload )
+        uploadStream( field );
+    auto heightVbo = mStreamingUpload ? gl::VboRef() : mHalfHeights ? mHeightTextureVbo : findVbo( geom::Attrib::CUSTOM_0 );
+    auto normalVbo = mNormalsEnabled ? findVbo( geom::Attrib::NORMAL ) : gl::VboRef();
     
-    // Dynmaically generate our new positions based on a sin(x) + cos(z) wave
-    // We set 'orphanExisting' to false so that we can also read from the position buffer, though keep
-    // in mind that this isn't the most efficient way to do cpu-side updates. Consider using VboMesh::bufferAttrib() as well.
-    
-    auto mappedPosAttrib = mVboMesh->mapAttrib3f( geom::Attrib::POSITION, false );
-    for( int i = 0; i < mVboMesh->getNumVertices(); i++ ) {
-        vec3 &pos = *mappedPosAttrib;
-        switch (mHeightFunction) {
-            case sine:
-                mappedPosAttrib->y = mHeightMult * sinf( pos.x * 1.1467f + offset ) * 0.323f + cosf( pos.z * 0.7325f + offset ) * 0.431f;
-                break;
-            case uniform:
-                mappedPosAttrib->y = 1;
-                break;
-            case randnoise:
-                mappedPosAttrib->y = Rand::randFloat(1);
-                break;
-            case fractal:
-                mappedPosAttrib->y = mHeightMult * mNoise.fractal(mOctaves, pos.x, pos.z + mTerrainOffset);
-                break;
-            case simplex:
-                mappedPosAttrib->y = mHeightMult * mNoise.noise(pos.x, pos.z + mTerrainOffset);
-                break;
-            default:
-                break;
+    size_t slot = field.rowSlot( rowBegin );
+    size_t count = rowEnd - rowBegin;
+    while( count > 0 ) {
+        const size_t contiguous = min( count, numRows - slot );
+        const size_t first = slot * numColumns;
+        const size_t numVertices = contiguous * numColumns;
+        if( heightVbo && mHalfHeights ) {
+            for( size_t i = first; i < first + numVertices; i++ )
+                mHalfStaging[i] = glm::packHalf1x16( field.mHeights[i] );
+            heightVbo->bufferSubData( first * sizeof( uint16_t ), numVertices * sizeof( uint16_t ), &mHalfStaging[first] );
         }
-        
-        ++mappedPosAttrib;
+        else if( heightVbo ) {
+            heightVbo->bufferSubData( first * sizeof( float ), numVertices * sizeof( float ), &field.mHeights[first] );
+        }
+        if( normalVbo )
+            normalVbo->bufferSubData( first * sizeof( HeightNormal ), numVertices * sizeof( HeightNormal ), &field.mNormals[first] );
+        slot = 0;
+        count -= contiguous;
     }
-    mappedPosAttrib.unmap();
+}
+
+void MeshParamTestApp::uploadStream( const HeightField &field )
+{
+    // Every region must hold all the rows since they are drawn on their own, so the whole height field
+    // is written: a sequential write to mapped memory, still less than the rows of one vec3 upload.
+    uint8_t *region = static_cast<uint8_t *>( mHeightStream->map() );
+    if( mHalfHeights ) {
+        uint16_t *halfHeights = reinterpret_cast<uint16_t *>( region );
+        for( size_t i = 0; i < field.mHeights.size(); i++ )
+            halfHeights[i] = glm::packHalf1x16( field.mHeights[i] );
+    }
+    else {
+        copy( field.mHeights.begin(), field.mHeights.end(), reinterpret_cast<float *>( region ) );
+    }
+    mHeightStream->unmap();
+    
+    mStreamMaps = (int)mHeightStream->getNumMaps();
+    mStreamWaits = (int)mHeightStream->getNumWaits();
+    mStreamWaitMs = float( mHeightStream->getWaitSeconds() * 1000.0 );
 }
 
 void MeshParamTestApp::setupParams()
@@ -212,22 +744,30 @@ void MeshParamTestApp::setupParams()
     mNoiseAmplitude = 0.64f; // Amplitude of an octave of noise it the "height" of its feature
     mNoiseLacunarity = 0.65f; // Lacunarity specifies frequency multipler between successive octaves (typically 2.0)
     mNoisePersistence = 1.4f; // Persistence is loss of amplitude between successive octabes (usually 1/lacunarity)
+    mNoiseHash = permutationHash; // The permutation table repeats every 256 units, the seeded hash does not
+    mNoiseSeed = 0;
+    
+    // graph params: fractal ridged by default, so that switching to the graph shows a difference
+    mGraphLayers.mRidge = true;
+    mGraphDetail = 0;
+    mGraphCombine = 0;
+    updateHeightGraph();
     
     // Create the interface and give it a name.
     mParams = params::InterfaceGl::create( getWindow(), "App parameters", toPixels( ivec2( 200, 400 ) ) );
     
-    mParams->addParam( "Rotation", &mObjOrientation ).group("Camera Params").updateFn( [this] { console() << "mObjOrientation: " << mObjOrientation << endl; } );
+    mParams->addParam( "Rotation", &mObjOrientation ).group("Camera Params");
     mParams->addParam( "Camera EyePoint", &mCameraEyePoint ).group("Camera Params");
     mParams->addParam( "Camera Target", &mCameraTarget ).group("Camera Params");
     
     mParams->addParam( "Height Function", heightFunctionNames, &mSelectedHeightFunction )
-    .updateFn( [this] { mHeightFunction = HeightFunction(mSelectedHeightFunction); } );
+    .updateFn( [this] { mHeightFunction = HeightFunction(mSelectedHeightFunction); invalidateHeights(); } );
     mParams->addParam( "Height Function", heightFunctionNames, &mSelectedHeightFunction )
-    .updateFn( [this] { mHeightFunction = HeightFunction(mSelectedHeightFunction); } );
+    .updateFn( [this] { mHeightFunction = HeightFunction(mSelectedHeightFunction); invalidateHeights(); } );
     
-    mParams->addParam("Octaves", &mOctaves).min(1).max(20).group("Simplex Params").updateFn( [this] { console() << "new mOctaves value: " << mOctaves << endl; } );
+    mParams->addParam("Octaves", &mOctaves).min(1).max(20).group("Simplex Params").updateFn( [this] { updateFractal(); invalidateHeights(); } );
     
-    mParams->addParam("Height Multiplier", &mHeightMult ).precision( 2 ).step( 0.02f ).group("Mesh Params");
+    mParams->addParam("Height Multiplier", &mHeightMult ).precision( 2 ).step( 0.02f ).group("Mesh Params").updateFn( [this] { invalidateHeights( false ); } );
     
     function<void( int )> planeSizeSetter = bind(&MeshParamTestApp::setPlaneSize, this, placeholders::_1);
     function<int ()> planeSizeGetter = bind(&MeshParamTestApp::getPlaneSize, this);
@@ -236,11 +776,309 @@ void MeshParamTestApp::setupParams()
     function<void( int )> planeSubdivisionsSetter = bind( &MeshParamTestApp::setPlaneSubdivisions, this, placeholders::_1 );
     function<int ()> planeSubdivisionsGetter = bind( &MeshParamTestApp::getPlaneSubdivisions, this );
     mParams->addParam( "Plane Subdivisions", planeSubdivisionsSetter, planeSubdivisionsGetter ).group("Mesh Params");
+    mParams->addParam( "Chunked Terrain", &mChunkedTerrain ).group("Terrain").updateFn( [this] { invalidateHeights(); } );
+    mParams->addParam( "Terrain Size", &mTerrainSize ).min( 16.0f ).max( 65536.0f ).step( 16.0f ).group("Terrain");
+    mParams->addParam( "Max Depth", &mTerrainMaxDepth ).min( 0 ).max( 12 ).group("Terrain");
+    mParams->addParam( "LOD Distance Factor", &mTerrainLodFactor ).min( 0.5f ).max( 8.0f ).precision( 2 ).step( 0.1f ).group("Terrain");
+    mParams->addParam( "Finest Resolution", &mTerrainResolution, true ).group("Terrain");
+    mParams->addParam( "Chunks Drawn", &mChunksDrawn, true ).group("Terrain");
+    mParams->addParam( "Chunks Culled", &mChunksCulled, true ).group("Terrain");
+    mParams->addParam( "Chunks Generated", &mChunksGenerated, true ).group("Terrain");
+    mParams->addParam( "GPU Noise", &mGpuNoise ).group("GPU Noise").updateFn( [this] { invalidateHeights(); } );
+    mParams->addParam( "Geometry Shader", &mGeometryShaderWireframe ).group("Wireframe").updateFn( [this] { updateWireframeShaders(); } );
+    mParams->addButton( "Benchmark Wireframe", [this] { mWireframeBenchmarkPending = true; }, "group='Wireframe'" );
+    mParams->addParam( "Draw GS / no GS (ms)", &mWireframeBenchmark, true ).group("Wireframe");
+    mParams->addParam( "Mesh Rebuilds", &mMeshRebuilds, true ).group("Mesh Params");
+    mParams->addParam( "Pooled Grids Built", &mPooledGrids, true ).group("Mesh Params");
+    mParams->addParam( "Buffers Reused", &mBufferReuses, true ).group("Mesh Params");
+    mParams->addParam( "Half Float Heights", &mHalfHeights ).group("Mesh Params").updateFn( [this] { updatePlaneDimensions(); } );
+    mParams->addParam( "Streaming Upload", &mStreamingUpload ).group("Upload").updateFn( [this] { updatePlaneDimensions(); } );
+    mParams->addParam( "Persistent Mapping", &mPersistentMapping ).group("Upload").updateFn( [this] { updatePlaneDimensions(); } );
+    mParams->addParam( "Stream Mode", &mStreamMode, true ).group("Upload");
+    mParams->addParam( "Stream Writes", &mStreamMaps, true ).group("Upload");
+    mParams->addParam( "Fence Waits", &mStreamWaits, true ).group("Upload");
+    mParams->addParam( "Fence Wait (ms)", &mStreamWaitMs, true ).group("Upload");
+    mParams->addParam( "Normals", &mNormalsEnabled ).group("Mesh Params").updateFn( [this] { updatePlaneDimensions(); } );
+    mParams->addParam( "Scroll Ring Buffer", &mScrollMode ).group("Mesh Params").updateFn( [this] { invalidateHeights(); } );
+    mParams->addParam( "Auto Scroll", &mAutoScroll ).group("Mesh Params");
+    function<void( int )> scrollRowSetter = bind( &MeshParamTestApp::setScrollRow, this, placeholders::_1 );
+    function<int ()> scrollRowGetter = bind( &MeshParamTestApp::getScrollRow, this );
+    mParams->addParam( "Scroll Row", scrollRowSetter, scrollRowGetter ).group("Mesh Params");
+    
+    mParams->addParam( "Tile Cache", &mTileCacheEnabled ).group("Cache").updateFn( [this] { invalidateHeights(); } );
+    mParams->addParam( "Cache Budget (MB)", &mTileCacheBudgetMB ).min( 1 ).max( 4096 ).group("Cache").updateFn( [this] { mTileCache->setBudget( size_t( mTileCacheBudgetMB ) << 20 ); } );
+    mParams->addParam( "Cache Hits", &mCacheHits, true ).group("Cache");
+    mParams->addParam( "Cache Misses", &mCacheMisses, true ).group("Cache");
+    mParams->addParam( "Cached Tiles", &mCacheTiles, true ).group("Cache");
+    mParams->addButton( "Clear Cache", [this] { mTileCache->clear(); mTileCache->resetStats(); } , "group='Cache'" );
+    mParams->addParam( "Workers", &mNumWorkers ).min( 1 ).max( 256 ).group("Mesh Params").updateFn( [this] { mGenerator = HeightFieldGenerator::create( mNumWorkers ); } );
+    mParams->addParam( "Background Generation", &mBackgroundGeneration ).group("Mesh Params");
+    mParams->addParam( "Cancelled Jobs", &mCancelledJobs, true ).group("Mesh Params");
+    mParams->addParam( "Params Version", &mParamsVersion, true ).group("Mesh Params");
+    mParams->addParam( "Retired Snapshots", &mRetiredSnapshots, true ).group("Mesh Params");
+    mParams->addParam( "Full Updates", &mFullUpdates, true ).group("Mesh Params");
+    mParams->addParam( "Scroll Updates", &mScrollUpdates, true ).group("Mesh Params");
+    mParams->addParam( "Rescale Updates", &mRescaleUpdates, true ).group("Mesh Params");
+    mParams->addParam( "Skipped Updates", &mSkippedUpdates, true ).group("Mesh Params");
     
     mParams->addParam("Frequency", &mNoiseFrequency).min(0.1f).max(20.0f).precision(2).step(0.02f).group("Fractal Params").updateFn([this]{updateNoise();});
     mParams->addParam("Amplitude", &mNoiseAmplitude).min(0.1f).max(20.0f).precision(2).step(0.02f).group("Fractal Params").updateFn([this]{updateNoise();});
     mParams->addParam("Lacunarity", &mNoiseLacunarity).min(0.1f).max(20.0f).precision(2).step(0.01f).group("Fractal Params").updateFn([this]{updateNoise();});
     mParams->addParam("Persistence", &mNoisePersistence).min(0.1f).max(20.0f).precision(1).step(0.1f).group("Fractal Params").updateFn([this]{updateNoise();});
+    mParams->addParam("Hash", noiseHashNames, &mNoiseHash).group("Fractal Params").updateFn([this]{updateNoise();});
+    mParams->addParam("Seed", &mNoiseSeed).min(0).group("Fractal Params").updateFn([this]{updateNoise();});
+    
+    vector<string> detailNames = { "none" };
+    detailNames.insert( detailNames.end(), HeightGraph::kSourceNames.begin(), HeightGraph::kSourceNames.end() );
+    mParams->addParam( "Graph Base", HeightGraph::kSourceNames, &mGraphLayers.mBase ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Warp", &mGraphLayers.mWarp ).min( -4.0f ).max( 4.0f ).precision( 2 ).step( 0.05f ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Ridge", &mGraphLayers.mRidge ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Detail", detailNames, &mGraphDetail ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Combine", { "add", "multiply" }, &mGraphCombine ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Detail Weight", &mGraphLayers.mDetailWeight ).precision( 2 ).step( 0.05f ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Clamp", &mGraphLayers.mClamp ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Clamp Low", &mGraphLayers.mClampLow ).precision( 2 ).step( 0.05f ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Clamp High", &mGraphLayers.mClampHigh ).precision( 2 ).step( 0.05f ).group("Height Graph").updateFn( [this] { updateHeightGraph(); } );
+    mParams->addParam( "Graph Instructions", &mGraphInstructions, true ).group("Height Graph");
+#if MESH_PROFILING
+    for( size_t i = 0; i < mStageTimings.size(); i++ )
+        mParams->addParam( string( kTimedStages[i] ) + " (ms)", &mStageTimings[i], true ).group("Timing");
+    mParams->addButton( "Dump Trace", [this] { dumpTrace(); }, "group='Timing'" );
+#endif
+    mParams->addParam( "Export Type", { "float32", "float16", "uint16" }, &mExportElementType ).group("File");
+    mParams->addButton( "Export Field", [this] { exportField(); }, "group='File'" );
+    mParams->addButton( "Load Field", [this] { loadField(); }, "group='File'" );
+    mParams->addParam( "Field File", &mFieldFileStatus, true ).group("File");
+    mParams->addParam( "Bake Frames", &mBakeFrames ).min( 1 ).max( 100000 ).group("Animation");
+    mParams->addButton( "Bake Animation", [this] { bakeAnimation(); }, "group='Animation'" );
+    mParams->addButton( "Play Animation", [this] { playAnimation(); }, "group='Animation'" );
+    mParams->addButton( "Stop Animation", [this] { mPlayer.reset(); mAnimationStatus = "stopped"; }, "group='Animation'" );
+    mParams->addParam( "Animation", &mAnimationStatus, true ).group("Animation");
+    mParams->addParam( "Late Frames", &mLateFrames, true ).group("Animation");
+}
+
+void MeshParamTestApp::updateStageTimings()
+{
+#if MESH_PROFILING
+    if( getElapsedSeconds() - mTimingRefreshTime < kTimingRefreshInterval )
+        return;
+    mTimingRefreshTime = getElapsedSeconds();
+    
+    const auto stats = FrameProfiler::computeStats( mProfiler->getSamples() );
+    for( size_t i = 0; i < mStageTimings.size(); i++ ) {
+        mStageTimings[i] = "-";
+        for( const auto &stageStats : stats ) {
+            if( ! strcmp( stageStats.mStage, kTimedStages[i] ) ) {
+                char text[64];
+                snprintf( text, sizeof( text ), "%.2f / %.2f / %.2f", stageStats.mP50, stageStats.mP95, stageStats.mP99 );
+                mStageTimings[i] = text;
+            }
+        }
+    }
+#endif
+}
+
+void MeshParamTestApp::dumpTrace()
+{
+    // Chrome trace for chrome://tracing or ui.perfetto.dev, and the same samples as CSV
+    const string tracePath = ( getDocumentsDirectory() / "MeshParamTest-trace.json" ).string();
+    const string csvPath = ( getDocumentsDirectory() / "MeshParamTest-trace.csv" ).string();
+    if( mProfiler->writeChromeTrace( tracePath ) && mProfiler->writeCsv( csvPath ) )
+        console() << "stage timings written to " << tracePath << " and " << csvPath << endl;
+    else
+        console() << "can't write the stage timings to " << tracePath << endl;
+}
+
+static fs::path fieldFilePath()
+{
+    return getDocumentsDirectory() / "MeshParamTest.hfield";
+}
+
+void MeshParamTestApp::exportField()
+{
+    if( chunkedTerrainActive() || gpuNoiseActive() || mLoadedField ) {
+        mFieldFileStatus = "plane heights only";
+        return;
+    }
+    // the job in flight owns mField, wait for its rows
+    if( mJob.valid() )
+        presentJob( mJob.get() );
+    
+    const string path = fieldFilePath().string();
+    const auto header = HeightFieldFile::makeHeader( makeHeightParams(), *mField, HeightElementType( mExportElementType ) );
+    const bool written = HeightFieldFile::write( path, header, *mField );
+    mFieldFileStatus = written ? "exported" : "export failed";
+    console() << ( written ? "heightfield written to " : "can't write the heightfield to " ) << path << endl;
+}
+
+void MeshParamTestApp::loadField()
+{
+    const string path = fieldFilePath().string();
+    auto file = HeightFieldFile::open( path );
+    if( ! file || file->getNumColumns() != file->getNumRows() || file->getNumColumns() < 2 ) {
+        mFieldFileStatus = "load failed";
+        console() << "can't load a square heightfield from " << path << endl;
+        return;
+    }
+    
+    // The plane takes the dimensions of the file, the heights of the rebuilt one come from the file
+    const HeightFieldFileHeader &header = file->getHeader();
+    mPlaneSubdivisions = int( header.mNumColumns - 1 );
+    mPlaneSize = max( 1, int( lroundf( header.mSpacing * float( mPlaneSubdivisions ) ) ) );
+    updatePlaneDimensions();
+    mLoadedField = file;
+    uploadLoadedField();
+    mFieldFileStatus = "loaded";
+}
+
+void MeshParamTestApp::uploadLoadedField()
+{
+    PROFILE_STAGE( mProfiler, kStageUpload );
+    const size_t numRows = mLoadedField->getNumRows();
+    const HeightElementType type = mHalfHeights ? HEIGHT_FLOAT16 : HEIGHT_FLOAT32;
+    const size_t bytes = mNumVertices * HeightFieldFile::getElementSize( type );
+    mDrawnRingBaseRow = 0;
+    
+    // The samples go from the pages of the file to the mapped buffer, converted only if the types differ
+    if( mStreamingUpload ) {
+        mLoadedField->readRows( 0, numRows, mHeightStream->map(), type );
+        mHeightStream->unmap();
+    }
+    else {
+        auto heightVbo = mHalfHeights ? mHeightTextureVbo : findVbo( geom::Attrib::CUSTOM_0 );
+        void *heights = heightVbo->mapBufferRange( 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+        if( heights ) {
+            mLoadedField->readRows( 0, numRows, heights, type );
+            heightVbo->unmap();
+        }
+    }
+    
+    // The file holds no normals, they are rebuilt from the heights
+    if( mNormalsEnabled ) {
+        mLoadedField->readRows( 0, numRows, mField->mHeights.data(), HEIGHT_FLOAT32 );
+        uploadNormals();
+    }
+}
+
+void MeshParamTestApp::uploadNormals()
+{
+    // Normals of the heights in mField by central differences, one sided on the borders
+    const size_t numRows = mField->mGridZ.size();
+    const size_t numColumns = mField->mGridX.size();
+    const vector<float> &heights = mField->mHeights;
+    for( size_t row = 0; row < numRows; row++ ) {
+        for( size_t column = 0; column < numColumns; column++ ) {
+            const size_t left = column > 0 ? column - 1 : column, right = column + 1 < numColumns ? column + 1 : column;
+            const size_t up = row > 0 ? row - 1 : row, down = row + 1 < numRows ? row + 1 : row;
+            const float dx = ( heights[row * numColumns + right] - heights[row * numColumns + left] ) / ( float( right - left ) * mGridSpacing );
+            const float dz = ( heights[down * numColumns + column] - heights[up * numColumns + column] ) / ( float( down - up ) * mGridSpacing );
+            const vec3 normal = normalize( vec3( -dx, 1.0f, -dz ) );
+            mField->mNormals[row * numColumns + column] = HeightNormal{ normal.x, normal.y, normal.z };
+        }
+    }
+    findVbo( geom::Attrib::NORMAL )->bufferSubData( 0, mNumVertices * sizeof( HeightNormal ), mField->mNormals.data() );
+}
+
+static fs::path animationFilePath()
+{
+    return getDocumentsDirectory() / "MeshParamTest.hanim";
+}
+
+void MeshParamTestApp::bakeAnimation()
+{
+    if( chunkedTerrainActive() || gpuNoiseActive() ) {
+        mAnimationStatus = "plane heights only";
+        return;
+    }
+    if( mBakeJob.valid() )
+        return;
+    
+    // The frames are generated into a field of their own by a generator of their own, while the plane
+    // keeps animating; they start from the current params and offsets
+    const HeightParams params = makeHeightParams();
+    const HeightFieldRef field = HeightField::create( mField->mGridX, mField->mGridZ, false );
+    const size_t numFrames = size_t( mBakeFrames );
+    const size_t numWorkers = size_t( mNumWorkers );
+    const string path = animationFilePath().string();
+    const auto progress = mBakeProgress;
+    const auto cancel = mBakeCancel;
+    *progress = 0;
+    *cancel = false;
+    mPlayer.reset();
+    mAnimationStatus = "baking";
+    mBakeJob = async( launch::async, [=] {
+        return BakedAnimationWriter::bake( path, params, field, numFrames, kBakeFramesPerSecond, HeightFieldGenerator::create( numWorkers ),
+                                           [progress, cancel]( size_t frames ) { *progress = frames; return ! *cancel; } );
+    } );
+}
+
+void MeshParamTestApp::playAnimation()
+{
+    if( mBakeJob.valid() )
+        return;
+    const string path = animationFilePath().string();
+    auto player = BakedAnimationPlayer::open( path );
+    if( ! player || player->getHeader().mNumColumns != player->getHeader().mNumRows || player->getHeader().mNumColumns < 2 ) {
+        mAnimationStatus = "play failed";
+        console() << "can't play a square baked animation from " << path << endl;
+        return;
+    }
+    
+    // The plane takes the dimensions of the frames, like a loaded heightfield
+    const BakedAnimationHeader &header = player->getHeader();
+    mPlaneSubdivisions = int( header.mNumColumns - 1 );
+    mPlaneSize = max( 1, int( lroundf( header.mSpacing * float( mPlaneSubdivisions ) ) ) );
+    updatePlaneDimensions();
+    mPlayer = player;
+    mPlaybackStart = getElapsedSeconds();
+    mPlaybackFrame = numeric_limits<uint64_t>::max();
+    mLateFrames = 0;
+    mAnimationStatus = "playing";
+}
+
+void MeshParamTestApp::updatePlayback()
+{
+    // The frame due at this time, the one shown stays until it is decoded
+    const uint64_t frame = uint64_t( ( getElapsedSeconds() - mPlaybackStart ) * mPlayer->getHeader().mFramesPerSecond );
+    if( frame == mPlaybackFrame )
+        return;
+    const float *heights = mPlayer->getFrame( frame );
+    mLateFrames = (int)mPlayer->getNumLateFrames();
+    if( heights ) {
+        uploadHeights( heights );
+        mPlaybackFrame = frame;
+    }
+}
+
+void MeshParamTestApp::uploadHeights( const float *heights )
+{
+    // A whole frame written to the mapped buffer, converted in half float mode
+    PROFILE_STAGE( mProfiler, kStageUpload );
+    const size_t bytes = mNumVertices * ( mHalfHeights ? sizeof( uint16_t ) : sizeof( float ) );
+    mDrawnRingBaseRow = 0;
+    
+    auto heightVbo = mStreamingUpload ? gl::VboRef() : mHalfHeights ? mHeightTextureVbo : findVbo( geom::Attrib::CUSTOM_0 );
+    void *mapped = heightVbo ? heightVbo->mapBufferRange( 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) : mHeightStream->map();
+    if( mapped ) {
+        if( mHalfHeights ) {
+            uint16_t *halfHeights = static_cast<uint16_t *>( mapped );
+            for( size_t i = 0; i < mNumVertices; i++ )
+                halfHeights[i] = glm::packHalf1x16( heights[i] );
+        }
+        else {
+            memcpy( mapped, heights, bytes );
+        }
+        if( heightVbo )
+            heightVbo->unmap();
+        else
+            mHeightStream->unmap();
+    }
+    
+    // no normals are baked, they are rebuilt from the heights
+    if( mNormalsEnabled ) {
+        copy( heights, heights + mNumVertices, mField->mHeights.begin() );
+        uploadNormals();
+    }
 }
 
 void MeshParamTestApp::resize()
@@ -250,11 +1088,220 @@ void MeshParamTestApp::resize()
 
 void MeshParamTestApp::update()
 {
-    udpatePlaneHeights();
+    updateStageTimings();
+    PROFILE_STAGE( mProfiler, kStageUpdate );
+    if( mPlaneRebuildPending && getElapsedSeconds() - mPlaneRebuildTime >= kPlaneRebuildDelay )
+        updatePlaneDimensions();
+    if( mBakeJob.valid() ) {
+        if( mBakeJob.wait_for( chrono::seconds( 0 ) ) == future_status::ready )
+            mAnimationStatus = mBakeJob.get() ? "baked" : "bake failed";
+        else
+            mAnimationStatus = "baking frame " + to_string( mBakeProgress->load() );
+    }
+    if( chunkedTerrainActive() )
+        updateTerrain();
+    else
+        udpatePlaneHeights();
+}
+
+void MeshParamTestApp::updateTerrain()
+{
+    PROFILE_STAGE( mProfiler, kStageTerrain );
+    mTerrain->setSize( mTerrainSize );
+    mTerrain->setMaxDepth( mTerrainMaxDepth );
+    mTerrain->setLodFactor( mTerrainLodFactor );
+    mTerrain->setHeightBound( fabsf( mHeightMult ) );
+    
+    // draw() rotates the object by mObjOrientation, the selection works in object space
+    const mat4 viewProjection = mCamera.getProjectionMatrix() * mCamera.getViewMatrix() * glm::mat4_cast( mObjOrientation );
+    const vec3 eye = glm::inverse( mObjOrientation ) * mCamera.getEyePoint();
+    mTerrain->update( viewProjection, eye, mGenerator, [this]( const float *x, const float *z, float *heights, size_t count, float spacing ) {
+        if( mNoiseHash == seededHash )
+            evaluateTerrain( mSeededNoise, x, z, heights, count, spacing );
+        else
+            evaluateTerrain( mNoise, x, z, heights, count, spacing );
+    } );
+    
+    mTerrainResolution = ChunkedTerrain::kChunkQuads << mTerrain->getMaxDepth();
+    mChunksDrawn = (int)mTerrain->getNumDrawn();
+    mChunksCulled = (int)mTerrain->getNumCulled();
+    mChunksGenerated = (int)mTerrain->getNumGenerated();
+}
+
+template <typename Hash>
+void MeshParamTestApp::evaluateTerrain( const BasicSimplexNoise<Hash> &noise, const float *x, const float *z, float *heights, size_t count, float spacing ) const
+{
+    if( mHeightFunction == fractal ) {
+        // Octaves with features under two vertex spacings would only alias at this LOD, they are left out.
+        // The sum is still divided by the amplitudes of all the octaves, so that the levels agree on the
+        // octaves they share; the lowest frequency octave is always kept.
+        float denom = 0.0f;
+        float frequency = mNoiseFrequency;
+        float amplitude = mNoiseAmplitude;
+        int lowestOctave = 0;
+        float lowestFrequency = frequency;
+        for( int octave = 0; octave < mOctaves; octave++ ) {
+            denom += amplitude;
+            if( frequency < lowestFrequency ) {
+                lowestFrequency = frequency;
+                lowestOctave = octave;
+            }
+            frequency *= mNoiseLacunarity;
+            amplitude *= mNoisePersistence;
+        }
+        
+        vector<float> px( count ), pz( count ), octaveHeights( count );
+        fill( heights, heights + count, 0.0f );
+        frequency = mNoiseFrequency;
+        amplitude = mNoiseAmplitude;
+        for( int octave = 0; octave < mOctaves; octave++ ) {
+            if( frequency * spacing <= 0.5f || octave == lowestOctave ) {
+                for( size_t i = 0; i < count; i++ ) {
+                    px[i] = x[i] * frequency;
+                    pz[i] = z[i] * frequency;
+                }
+                noise.noise( px.data(), pz.data(), octaveHeights.data(), count );
+                for( size_t i = 0; i < count; i++ )
+                    heights[i] += amplitude * octaveHeights[i];
+            }
+            frequency *= mNoiseLacunarity;
+            amplitude *= mNoisePersistence;
+        }
+        for( size_t i = 0; i < count; i++ )
+            heights[i] = mHeightMult * ( heights[i] / denom );
+    }
+    else {
+        noise.noise( x, z, heights, count );
+        for( size_t i = 0; i < count; i++ )
+            heights[i] *= mHeightMult;
+    }
+}
+
+void MeshParamTestApp::drawHeights()
+{
+    gl::ScopedGlslProg shader( mWireframeShader );
+    
+    // Move the row slots of the ring to their displayed place, see wireframe.vert
+    const int numRows = mMeshSubdivisions + 1;
+    mWireframeShader->uniform( "uNumColumns", mMeshSubdivisions + 1 );
+    mWireframeShader->uniform( "uNumRows", numRows );
+    mWireframeShader->uniform( "uRingBaseRow", (int)mDrawnRingBaseRow );
+    mWireframeShader->uniform( "uGridOrigin", mGridOrigin );
+    mWireframeShader->uniform( "uGridSpacing", mGridSpacing );
+    mWireframeShader->uniform( "uLighting", mNormalsEnabled );
+    mWireframeShader->uniform( "uHeightsInTexture", heightsInTexture() );
+    mWireframeShader->uniform( "uHeightTexture", 1 );
+    mWireframeShader->uniform( "uHeightOffset", mHeightStream ? int( mHeightStream->getCurrentRegion() * mNumVertices ) : 0 );
+    if( mHeightTexture )
+        mHeightTexture->bindTexture( 1 );
+    
+    // Draw every quad row of the ring but the one joining the last displayed row back to the first one,
+    // from row slot mDrawnRingBaseRow - 1 to mDrawnRingBaseRow (the closing quad row at the end when the base is 0).
+    const int indicesPerRow = 6 * mMeshSubdivisions;
+    const int base = (int)mDrawnRingBaseRow;
+    if( base == 0 ) {
+        mBatch->draw( 0, mMeshSubdivisions * indicesPerRow );
+    }
+    else {
+        mBatch->draw( base * indicesPerRow, ( numRows - base ) * indicesPerRow );
+        if( base > 1 )
+            mBatch->draw( 0, ( base - 1 ) * indicesPerRow );
+    }
+    if( mHeightTexture )
+        mHeightTexture->unbindTexture( 1 );
+    // the GPU reads the current region until these draws complete
+    if( mHeightStream )
+        mHeightStream->fence();
+}
+
+void MeshParamTestApp::drawGpuNoise()
+{
+    // Rows are evaluated in place every frame, the quad row closing the ring is never drawn
+    gl::ScopedGlslProg shader( mNoiseShader );
+    setNoiseFrameUniforms( mNoiseShader );
+    mNoiseBatch->draw( 0, mMeshSubdivisions * 6 * mMeshSubdivisions );
+}
+
+void MeshParamTestApp::updateNoiseUniforms()
+{
+    if( ! mNoiseShader )
+        return;
+    mNoiseShader->uniform( "uOctaves", mOctaves );
+    mNoiseShader->uniform( "uFrequency", mNoiseFrequency );
+    mNoiseShader->uniform( "uAmplitude", mNoiseAmplitude );
+    mNoiseShader->uniform( "uLacunarity", mNoiseLacunarity );
+    mNoiseShader->uniform( "uPersistence", mNoisePersistence );
+    mNoiseShader->uniform( "uSeededHash", mNoiseHash == seededHash );
+    mNoiseShader->uniform( "uSeed", (uint32_t)mNoiseSeed );
+}
+
+void MeshParamTestApp::setNoiseFrameUniforms( const gl::GlslProgRef &shader ) const
+{
+    shader->uniform( "uGridOrigin", mGridOrigin );
+    shader->uniform( "uGridSpacing", mGridSpacing );
+    shader->uniform( "uNumColumns", mMeshSubdivisions + 1 );
+    shader->uniform( "uNumRows", mMeshSubdivisions + 1 );
+    shader->uniform( "uNoiseOffsetZ", noiseOffsetZ() );
+    shader->uniform( "uFractal", mHeightFunction == fractal );
+    shader->uniform( "uHeightMult", mHeightMult );
+    shader->uniform( "uLighting", mNormalsEnabled );
+}
+
+// Offset of the noise z from the mesh z, so that the GPU rows match those of the CPU ones
+float MeshParamTestApp::noiseOffsetZ() const
+{
+    if( mScrollMode || mTileCacheEnabled )
+        return float( mScrollRow ) * mGridSpacing;
+    return (float)mTerrainOffset;
+}
+
+void MeshParamTestApp::drawMesh()
+{
+    if( chunkedTerrainActive() )
+        mTerrain->draw();
+    else if( gpuNoiseActive() )
+        drawGpuNoise();
+    else
+        drawHeights();
+}
+
+void MeshParamTestApp::benchmarkWireframe()
+{
+    // The mesh as drawn this frame, kWireframeBenchmarkDraws times with each path, the GPU done before the
+    // clock stops. The depth is cleared before every draw so that none of them is culled by the previous one.
+    mWireframeBenchmarkPending = false;
+    const bool geometryShader = mGeometryShaderWireframe;
+    double drawMs[2];
+    for( int path = 0; path < 2; path++ ) {
+        mGeometryShaderWireframe = ( path == 0 );
+        updateWireframeShaders();
+        // the first draw with a program may finish its compilation
+        glClear( GL_DEPTH_BUFFER_BIT );
+        drawMesh();
+        glFinish();
+        
+        const auto start = chrono::steady_clock::now();
+        for( int i = 0; i < kWireframeBenchmarkDraws; i++ ) {
+            glClear( GL_DEPTH_BUFFER_BIT );
+            drawMesh();
+        }
+        glFinish();
+        drawMs[path] = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count() / kWireframeBenchmarkDraws;
+    }
+    mGeometryShaderWireframe = geometryShader;
+    updateWireframeShaders();
+    gl::clear( Color::gray( 0.1f ) );
+    
+    char text[64];
+    snprintf( text, sizeof( text ), "%.2f / %.2f", drawMs[0], drawMs[1] );
+    mWireframeBenchmark = text;
+    const string mesh = chunkedTerrainActive() ? to_string( mTerrain->getNumDrawn() ) + " chunks" : to_string( mMeshSubdivisions ) + " subdivisions";
+    console() << "Wireframe draw of " << mesh << ": " << drawMs[0] << " ms with the geometry shader, " << drawMs[1] << " ms without" << endl;
 }
 
 void MeshParamTestApp::draw()
 {
+    PROFILE_STAGE( mProfiler, kStageDraw );
     // this pair of lines is the standard way to clear the screen in OpenGL
     gl::enableDepthRead();
     gl::enableDepthWrite();
@@ -266,16 +1313,20 @@ void MeshParamTestApp::draw()
     gl::rotate( mObjOrientation );
     
     // Draw the interface
-    mParams->draw();
+    {
+        PROFILE_STAGE( mProfiler, kStageDrawParams );
+        mParams->draw();
+    }
     
     
     
     gl::ScopedGlslProg glslScope( gl::getStockShader( gl::ShaderDef().texture() ) );
     
-    gl::ScopedGlslProg shader( mWireframeShader );
+    if( mWireframeBenchmarkPending )
+        benchmarkWireframe();
     
-    mBatch = gl::Batch::create( mVboMesh, mWireframeShader );
-    mBatch->draw();
+    PROFILE_STAGE( mProfiler, kStageDrawMesh );
+    drawMesh();
     
     
     
@@ -0,0 +1,88 @@
+#include "ParamSnapshots.h"
+
+#include <thread>
+
+using namespace std;
+
+ParamSnapshots::ParamSnapshots( const HeightParams &params )
+    : mCurrent( new Snapshot{ params, 1, 0 } ), mVersion( 1 ), mEpoch( 1 )
+{
+    for( auto &slot : mSlots )
+        slot.mEpoch.store( 0 );
+}
+
+ParamSnapshots::~ParamSnapshots()
+{
+    for( Snapshot *snapshot : mRetired )
+        delete snapshot;
+    delete mCurrent.load();
+}
+
+uint64_t ParamSnapshots::publish( const HeightParams &params )
+{
+    // The copy is made before the swap: readers only ever see complete snapshots
+    const uint64_t version = mVersion.load( memory_order_relaxed ) + 1;
+    Snapshot *snapshot = new Snapshot{ params, version, 0 };
+    Snapshot *replaced = mCurrent.exchange( snapshot );
+    mVersion.store( version );
+    
+    // Readers that loaded the replaced snapshot announced their epoch before the exchange, so at most the
+    // epoch read here: the next readers announce a later one
+    replaced->mRetiredEpoch = mEpoch.fetch_add( 1 );
+    mRetired.push_back( replaced );
+    reclaim();
+    return version;
+}
+
+void ParamSnapshots::reclaim()
+{
+    uint64_t oldestEpoch = mEpoch.load();
+    for( const auto &slot : mSlots ) {
+        const uint64_t epoch = slot.mEpoch.load();
+        if( epoch != 0 && epoch < oldestEpoch )
+            oldestEpoch = epoch;
+    }
+    
+    size_t kept = 0;
+    for( Snapshot *snapshot : mRetired ) {
+        if( snapshot->mRetiredEpoch < oldestEpoch )
+            delete snapshot;
+        else
+            mRetired[kept++] = snapshot;
+    }
+    mRetired.resize( kept );
+}
+
+ParamSnapshots::Reader ParamSnapshots::acquire()
+{
+    // Each thread starts looking for a free slot where it found one last time, so that concurrent readers
+    // usually claim different slots at the first try
+    static thread_local size_t sSlotHint = 0;
+    for( ;; ) {
+        for( size_t i = 0; i < kMaxReaders; ++i ) {
+            const size_t slotIndex = ( sSlotHint + i ) % kMaxReaders;
+            atomic<uint64_t> &slot = mSlots[slotIndex].mEpoch;
+            uint64_t free = 0;
+            if( slot.load( memory_order_relaxed ) != 0 || ! slot.compare_exchange_strong( free, mEpoch.load() ) )
+                continue;
+    
+            // announced before loading: the publisher can't delete what is loaded now until the slot is cleared
+            sSlotHint = slotIndex;
+            const Snapshot *snapshot = mCurrent.load();
+            return Reader( &slot, &snapshot->mParams, snapshot->mVersion );
+        }
+        this_thread::yield();
+    }
+}
+
+ParamSnapshots::Reader::Reader( Reader &&other )
+    : mSlot( other.mSlot ), mParams( other.mParams ), mVersion( other.mVersion )
+{
+    other.mSlot = nullptr;
+}
+
+ParamSnapshots::Reader::~Reader()
+{
+    if( mSlot )
+        mSlot->store( 0, memory_order_release );
+}
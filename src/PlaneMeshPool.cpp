@@ -0,0 +1,109 @@
+#include "PlaneMeshPool.h"
+
+#include <algorithm>
+
+using namespace ci;
+using namespace std;
+
+// Released buffers kept for reuse, the smallest ones are dropped beyond that
+static const size_t kMaxFreeBuffers = 6;
+
+PlaneMeshPool::PlaneMeshPool( size_t maxGrids )
+    : mMaxGrids( max<size_t>( maxGrids, 1 ) ), mNumGridBuilds( 0 ), mNumBufferAllocations( 0 ), mNumBufferReuses( 0 )
+{
+}
+
+PlaneMeshPool::GridRef PlaneMeshPool::getGrid( int subdivisions )
+{
+    for( auto it = mGrids.begin(); it != mGrids.end(); ++it ) {
+        if( (*it)->mSubdivisions == subdivisions ) {
+            mGrids.splice( mGrids.begin(), mGrids, it );
+            return mGrids.front();
+        }
+    }
+    
+    mGrids.push_front( buildGrid( subdivisions ) );
+    ++mNumGridBuilds;
+    if( mGrids.size() > mMaxGrids )
+        mGrids.pop_back();
+    return mGrids.front();
+}
+
+PlaneMeshPool::GridRef PlaneMeshPool::buildGrid( int subdivisions ) const
+{
+    // Vertices are laid out row by row along x, like the heights: vertex ( row, column ) at index
+    // row * numColumns + column. x and z scale linearly with the plane size, so the unit ones times
+    // the size give the grid of any size.
+    auto grid = make_shared<Grid>();
+    grid->mSubdivisions = subdivisions;
+    const uint32_t numColumns = subdivisions + 1;
+    const uint32_t numRows = subdivisions + 1;
+    grid->mUnitX.resize( numColumns );
+    grid->mUnitZ.resize( numRows );
+    for( uint32_t column = 0; column < numColumns; column++ )
+        grid->mUnitX[column] = float( column ) / float( subdivisions ) - 0.5f;
+    for( uint32_t row = 0; row < numRows; row++ )
+        grid->mUnitZ[row] = float( row ) / float( subdivisions ) - 0.5f;
+    
+    // u runs along the columns and v along the rows, the ring shader shifts v by whole rows
+    vector<vec2> texCoords;
+    texCoords.reserve( numColumns * numRows );
+    for( uint32_t row = 0; row < numRows; row++ ) {
+        for( uint32_t column = 0; column < numColumns; column++ )
+            texCoords.push_back( vec2( float( column ) / float( subdivisions ), float( row ) / float( subdivisions ) ) );
+    }
+    
+    // Quad row q (between vertex rows q and q+1) is at index q * 6 * subdivisions. For the scroll mode the
+    // grid is closed into a ring by one more row of quads, from the last row of vertices back to the first one.
+    vector<uint32_t> indices;
+    indices.reserve( numRows * subdivisions * 6 );
+    for( uint32_t row = 0; row < numRows; row++ ) {
+        for( uint32_t column = 0; column < (uint32_t)subdivisions; column++ ) {
+            const uint32_t i = row * numColumns + column;
+            const uint32_t j = ( ( row + 1 ) % numRows ) * numColumns + column;
+            indices.insert( indices.end(), { i, i + 1, j, j, i + 1, j + 1 } );
+        }
+    }
+    
+    grid->mNumIndices = (uint32_t)indices.size();
+    grid->mIndices = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW );
+    grid->mTexCoords = gl::Vbo::create( GL_ARRAY_BUFFER, texCoords.size() * sizeof( vec2 ), texCoords.data(), GL_STATIC_DRAW );
+    return grid;
+}
+
+gl::VboRef PlaneMeshPool::acquireBuffer( GLenum target, size_t bytes, GLenum usage )
+{
+    // smallest released buffer that fits
+    auto best = mFreeBuffers.end();
+    for( auto it = mFreeBuffers.begin(); it != mFreeBuffers.end(); ++it ) {
+        if( (*it)->getTarget() == target && (*it)->getSize() >= bytes && ( best == mFreeBuffers.end() || (*it)->getSize() < (*best)->getSize() ) )
+            best = it;
+    }
+    if( best != mFreeBuffers.end() ) {
+        gl::VboRef vbo = *best;
+        mFreeBuffers.erase( best );
+        ++mNumBufferReuses;
+        return vbo;
+    }
+    
+    // Rounded up to a power of two, so that growing the plane a few subdivisions at a time still reuses buffers
+    size_t capacity = 4096;
+    while( capacity < bytes )
+        capacity *= 2;
+    ++mNumBufferAllocations;
+    return gl::Vbo::create( target, capacity, nullptr, usage );
+}
+
+void PlaneMeshPool::releaseBuffer( const gl::VboRef &vbo )
+{
+    if( ! vbo )
+        return;
+    
+    mFreeBuffers.push_back( vbo );
+    if( mFreeBuffers.size() > kMaxFreeBuffers ) {
+        auto smallest = min_element( mFreeBuffers.begin(), mFreeBuffers.end(), []( const gl::VboRef &a, const gl::VboRef &b ) {
+            return a->getSize() < b->getSize();
+        } );
+        mFreeBuffers.erase( smallest );
+    }
+}
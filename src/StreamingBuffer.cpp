@@ -0,0 +1,118 @@
+#include "StreamingBuffer.h"
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/scoped.h"
+
+#include <chrono>
+
+using namespace ci;
+using namespace std;
+
+// Granularity of the waits on a fence, the CPU checks again after each of them
+static const GLuint64 kFenceWaitTimeoutNs = 1000000;
+
+bool StreamingBuffer::isPersistentMappingSupported()
+{
+#if defined( GL_MAP_PERSISTENT_BIT )
+    const auto version = gl::getVersion();
+    return version.first > 4 || ( version.first == 4 && version.second >= 4 ) || gl::isExtensionAvailable( "GL_ARB_buffer_storage" );
+#else
+    return false;
+#endif
+}
+
+StreamingBuffer::StreamingBuffer( GLenum target, size_t regionBytes, size_t numRegions, bool persistent )
+    : mTarget( target ), mRegionBytes( regionBytes ), mFences( max<size_t>( numRegions, 1 ), nullptr ),
+    mCurrent( 0 ), mWriting( 0 ), mPersistentData( nullptr ), mNumMaps( 0 ), mNumWaits( 0 ), mWaitSeconds( 0 )
+{
+    const size_t totalBytes = mRegionBytes * mFences.size();
+#if defined( GL_MAP_PERSISTENT_BIT )
+    if( persistent && isPersistentMappingSupported() ) {
+        // Immutable storage mapped once for the lifetime of the buffer, coherent so that no flush is needed
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        mVbo = gl::Vbo::create( mTarget );
+        gl::ScopedBuffer scopedBuffer( mVbo );
+        glBufferStorage( mTarget, totalBytes, nullptr, flags );
+        mPersistentData = static_cast<uint8_t *>( glMapBufferRange( mTarget, 0, totalBytes, flags ) );
+    }
+#endif
+    if( mPersistentData ) {
+        mMode = PERSISTENT_MAPPED;
+    }
+    else {
+        mMode = MAP_RANGE;
+        mVbo = gl::Vbo::create( mTarget, totalBytes, nullptr, GL_STREAM_DRAW );
+    }
+}
+
+StreamingBuffer::~StreamingBuffer()
+{
+    for( GLsync &sync : mFences ) {
+        if( sync )
+            glDeleteSync( sync );
+    }
+    if( mPersistentData ) {
+        gl::ScopedBuffer scopedBuffer( mVbo );
+        glUnmapBuffer( mTarget );
+    }
+}
+
+void StreamingBuffer::waitFence( size_t region )
+{
+    GLsync &sync = mFences[region];
+    if( ! sync )
+        return;
+    
+    // Only count the waits that actually block: the fence is usually signaled by now
+    GLenum result = glClientWaitSync( sync, 0, 0 );
+    if( result == GL_TIMEOUT_EXPIRED ) {
+        mNumWaits++;
+        const auto start = chrono::steady_clock::now();
+        do {
+            result = glClientWaitSync( sync, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceWaitTimeoutNs );
+        } while( result == GL_TIMEOUT_EXPIRED );
+        mWaitSeconds += chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    }
+    glDeleteSync( sync );
+    sync = nullptr;
+}
+
+void* StreamingBuffer::map()
+{
+    mNumMaps++;
+    mWriting = ( mCurrent + 1 ) % mFences.size();
+    waitFence( mWriting );
+    
+    if( mPersistentData )
+        return mPersistentData + mWriting * mRegionBytes;
+    
+    // The fence already guarantees the GPU is done with the region, so the driver need not synchronize
+    mVbo->bind();
+    return glMapBufferRange( mTarget, mWriting * mRegionBytes, mRegionBytes,
+                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+}
+
+void StreamingBuffer::unmap()
+{
+    if( ! mPersistentData ) {
+        mVbo->bind();
+        glUnmapBuffer( mTarget );
+    }
+    mCurrent = mWriting;
+}
+
+void StreamingBuffer::fence()
+{
+    // A newer fence covers the previous draws of the region as well
+    GLsync &sync = mFences[mCurrent];
+    if( sync )
+        glDeleteSync( sync );
+    sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+void StreamingBuffer::resetStats()
+{
+    mNumMaps = 0;
+    mNumWaits = 0;
+    mWaitSeconds = 0;
+}
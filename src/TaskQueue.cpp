@@ -0,0 +1,44 @@
+#include "TaskQueue.h"
+
+using namespace std;
+
+TaskQueue::TaskQueue()
+    : mQuit( false ), mThread( &TaskQueue::workerLoop, this )
+{
+}
+
+TaskQueue::~TaskQueue()
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        mQuit = true;
+    }
+    mCondition.notify_one();
+    mThread.join();
+}
+
+void TaskQueue::pushTask( function<void()> task )
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        mTasks.push_back( move( task ) );
+    }
+    mCondition.notify_one();
+}
+
+void TaskQueue::workerLoop()
+{
+    for( ;; ) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock( mMutex );
+            mCondition.wait( lock, [this] { return mQuit || ! mTasks.empty(); } );
+            // the tasks queued before the destructor still run, their futures are never left without a result
+            if( mTasks.empty() )
+                return;
+            task = move( mTasks.front() );
+            mTasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,347 @@
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const vector<string> heightFunctionNames = { "sine", "uniform", "randnoise", "fractal", "simplex", "graph" };
+const vector<string> noiseHashNames = { "permutation", "seeded integer" };
+
+void HeightParams::prepareNoise()
+{
+    // frequencies and amplitudes of every octave are computed once here instead of for every vertex
+    mNoise = SimplexNoise( mNoiseFrequency, mNoiseAmplitude, mNoiseLacunarity, mNoisePersistence );
+    mSeededNoise = SeededSimplexNoise( mNoiseFrequency, mNoiseAmplitude, mNoiseLacunarity, mNoisePersistence, SimplexIntegerHash( mNoiseSeed ) );
+    mFractal = PreparedFractal( mNoise, mOctaves );
+    mSeededFractal = SeededPreparedFractal( mSeededNoise, mOctaves );
+}
+
+void HeightParams::prepareKernel()
+{
+    // Every height function is a graph: the sine and the constant ones aren't scaled as a whole, the sine
+    // wave only along x; the rescalable ones stay unscaled, TerrainGenerator::scaleRows() multiplies their
+    // heights by mHeightMult, and the others are multiplied by it here
+    HeightGraph functionGraph;
+    switch( mHeightFunction ) {
+        case sine:
+            functionGraph.sine( 0.323f * mHeightMult, 1.1467f, 0.431f, 0.7325f );
+            break;
+        case uniform:
+            functionGraph.constant( 1.0f );
+            break;
+        case randnoise:
+            functionGraph.random();
+            break;
+        case fractal:
+            functionGraph.fractal();
+            break;
+        case simplex:
+            functionGraph.simplex();
+            break;
+        case graph:
+            functionGraph = mGraph;
+            if( ! functionGraph.empty() )
+                functionGraph.mul( functionGraph.constant( mHeightMult ), int( functionGraph.getNodes().size() - 1 ) );
+            break;
+    }
+    mKernel = HeightKernel::compile( functionGraph );
+}
+
+HeightFieldRef HeightField::create( const vector<float> &gridX, const vector<float> &gridZ, bool normals )
+{
+    auto field = make_shared<HeightField>();
+    const size_t numVertices = gridX.size() * gridZ.size();
+    field->mHeights.assign( numVertices, 0.0f );
+    if( normals )
+        field->mNormals.assign( numVertices, HeightNormal{ 0, 1, 0 } );
+    field->mGridX = gridX;
+    field->mGridZ = gridZ;
+    field->mRowZ.resize( gridZ.size() );
+    field->mRingScrollRow = 0;
+    field->mRingBaseRow = 0;
+    field->mGenerationId = 0;
+    field->mNoiseVersion = 0;
+    field->mNoiseRowZ = 0;
+    field->mScale = NAN;
+    return field;
+}
+
+TerrainGenerator::TerrainGenerator( const HeightTileCacheRef &tileCache )
+    : mTileCache( tileCache ), mGenerationId( 1 )
+{
+}
+
+HeightJob TerrainGenerator::run( const HeightParams &params, const HeightFieldRef &fieldRef, const HeightFieldGeneratorRef &generator ) const
+{
+    PROFILE_STAGE( mProfiler, "generate" );
+    HeightField &field = *fieldRef;
+    HeightJob job;
+    job.mField = fieldRef;
+    job.mRowBegin = 0;
+    job.mRowEnd = 0;
+    job.mCancelled = false;
+    job.mUpdate = fullUpdate;
+    
+    const size_t numRows = field.mGridZ.size();
+    // Only the height functions depending on nothing but the position can keep their rows from one step
+    // to the next. Only the noise ones are cached: the tiles hold unscaled heights, and a constant needs no cache.
+    const bool positional = ( params.mHeightFunction == fractal || params.mHeightFunction == simplex || params.mHeightFunction == uniform );
+    const bool rescalable = params.isRescalable();
+    const bool ring = positional && params.mScrollMode;
+    const bool cached = rescalable && params.mTileCache && mTileCache;
+    if( rescalable && ( field.mNoiseHeights.size() != field.mHeights.size() || field.mNoiseDx.size() != ( params.mNormals ? field.mHeights.size() : 0 ) ) ) {
+        field.mNoiseHeights.assign( field.mHeights.size(), 0.0f );
+        field.mNoiseDx.assign( params.mNormals ? field.mHeights.size() : 0, 0.0f );
+        field.mNoiseDz.assign( params.mNormals ? field.mHeights.size() : 0, 0.0f );
+        field.mGenerationId = 0;
+        field.mNoiseVersion = 0;
+    }
+    
+    // Displayed rows to generate: [newRowBegin, newRowEnd)
+    size_t newRowBegin = 0;
+    size_t newRowEnd = numRows;
+    if( ring || cached ) {
+        for( size_t row = 0; row < numRows; row++ )
+            field.mRowZ[row] = field.mGridZ[0] + float( params.mScrollRow + (int64_t)row ) * params.mSpacing;
+    }
+    else {
+        // the sine function moves with time alone
+        const int terrainOffset = ( params.mHeightFunction == sine ) ? 0 : params.mTerrainOffset;
+        for( size_t row = 0; row < numRows; row++ )
+            field.mRowZ[row] = field.mGridZ[row] + terrainOffset;
+    }
+    
+    // The unscaled rows held are still valid when nothing they depend on changed, whatever the generation
+    const bool noiseUpToDate = rescalable && params.mNoiseVersion != 0 && field.mNoiseVersion == params.mNoiseVersion;
+    const bool upToDate = ( field.mGenerationId == params.mGenerationId ) || noiseUpToDate;
+    if( ring ) {
+        // Rows that scrolled in at the bottom (or at the top when scrubbing back)
+        const int64_t scrolledRows = params.mScrollRow - field.mRingScrollRow;
+        if( upToDate && scrolledRows >= 0 && scrolledRows < (int64_t)numRows )
+            newRowBegin = numRows - (size_t)scrolledRows;
+        else if( upToDate && scrolledRows < 0 && -scrolledRows < (int64_t)numRows )
+            newRowEnd = (size_t)-scrolledRows;
+        field.mRingBaseRow = size_t( ( params.mScrollRow % (int64_t)numRows + (int64_t)numRows ) % (int64_t)numRows );
+        field.mRingScrollRow = params.mScrollRow;
+    }
+    else {
+        field.mRingBaseRow = 0;
+        // the same rows as the last job
+        if( noiseUpToDate && field.mNoiseRowZ == field.mRowZ[0] )
+            newRowBegin = newRowEnd;
+    }
+    // Only the ring, or the unscaled rows, are kept for the next job, and only once they are all generated
+    field.mGenerationId = 0;
+    
+    if( newRowBegin != newRowEnd ) {
+        field.mNoiseVersion = 0;
+        if( cached ) {
+            job.mCancelled = ! fillRowsFromCache( params, field, generator, newRowBegin, newRowEnd );
+        }
+        else {
+            // Generate the heights into the CPU-side staging heights, in bands of rows spread over the worker
+            // threads, so that the GL buffer is only touched for the final copy.
+            generator->generateRows( newRowEnd - newRowBegin, [&]( size_t rowBegin, size_t rowEnd ) {
+                PROFILE_STAGE( mProfiler, "generate band" );
+                generateRows( params, field, newRowBegin + rowBegin, newRowBegin + rowEnd );
+            } );
+            job.mCancelled = isCancelled( params );
+        }
+    }
+    if( job.mCancelled )
+        return job;
+    
+    // Scale stage of the rescalable heights: the new rows, or every row when the multiplier changed. It isn't
+    // cancelled, it is cheap next to the noise and its rows are complete.
+    const size_t numNewRows = newRowEnd - newRowBegin;
+    bool rescaled = false;
+    if( rescalable ) {
+        rescaled = ! ( field.mScale == params.mHeightMult );
+        if( rescaled ) {
+            newRowBegin = 0;
+            newRowEnd = numRows;
+        }
+        if( newRowBegin != newRowEnd )
+            scaleRows( params, field, generator, newRowBegin, newRowEnd );
+        field.mScale = params.mHeightMult;
+        field.mNoiseVersion = params.mNoiseVersion;
+        field.mNoiseRowZ = field.mRowZ[0];
+    }
+    
+    if( ring )
+        field.mGenerationId = params.mGenerationId;
+    if( numNewRows == numRows )
+        job.mUpdate = fullUpdate;
+    else if( rescaled )
+        job.mUpdate = rescaleUpdate;
+    else if( numNewRows == 0 )
+        job.mUpdate = noUpdate;
+    else
+        job.mUpdate = scrollUpdate;
+    job.mRowBegin = newRowBegin;
+    job.mRowEnd = newRowEnd;
+    return job;
+}
+
+// Largest integer not greater than a / b, for a positive b
+static int64_t floorDiv( int64_t a, int64_t b )
+{
+    return ( a >= 0 ) ? a / b : -( ( -a + b - 1 ) / b );
+}
+
+HeightTileKey TerrainGenerator::makeTileKey( const HeightParams &params, const HeightField &field ) const
+{
+    HeightTileKey key;
+    key.mHeightFunction = params.mHeightFunction;
+    key.mOctaves = ( params.mHeightFunction == fractal ) ? params.mOctaves : 0;
+    key.mDerivatives = params.mNormals;
+    key.mHash = params.mNoiseHash;
+    key.mSeed = ( params.mNoiseHash == seededHash ) ? params.mNoiseSeed : 0;
+    key.mFrequency = params.mNoiseFrequency;
+    key.mAmplitude = params.mNoiseAmplitude;
+    key.mLacunarity = params.mNoiseLacunarity;
+    key.mPersistence = params.mNoisePersistence;
+    key.mSpacing = params.mSpacing;
+    key.mOriginX = field.mGridX[0];
+    key.mOriginZ = field.mGridZ[0];
+    key.mTileX = 0;
+    key.mTileZ = 0;
+    return key;
+}
+
+HeightTileCache::TileRef TerrainGenerator::generateTile( const HeightParams &params, const HeightTileKey &key ) const
+{
+    const int size = HeightTileCache::kTileSize;
+    const int numPlanes = key.mDerivatives ? 3 : 1;
+    auto samples = make_shared<vector<float>>( numPlanes * size * size );
+    vector<float> x( size ), z( size );
+    
+    for( int column = 0; column < size; column++ )
+        x[column] = key.mOriginX + float( key.mTileX * size + column ) * key.mSpacing;
+    for( int row = 0; row < size; row++ ) {
+        float *heights = &(*samples)[row * size];
+        float *dx = key.mDerivatives ? heights + size * size : nullptr;
+        float *dz = key.mDerivatives ? heights + 2 * size * size : nullptr;
+        fill( z.begin(), z.end(), key.mOriginZ + float( key.mTileZ * size + row ) * key.mSpacing );
+        params.mKernel->evaluate( params, x.data(), z.data(), heights, dx, dz, size );
+    }
+    return samples;
+}
+
+// Returns false when the job was cancelled before the rows were filled
+bool TerrainGenerator::fillRowsFromCache( const HeightParams &params, HeightField &field, const HeightFieldGeneratorRef &generator, size_t rowBegin, size_t rowEnd ) const
+{
+    // Tiles hold the unscaled heights of the lattice point (column, mScrollRow + row)
+    const int64_t size = HeightTileCache::kTileSize;
+    const size_t numColumns = field.mGridX.size();
+    const int64_t numTilesX = ( (int64_t)numColumns + size - 1 ) / size;
+    const int64_t tileZBegin = floorDiv( params.mScrollRow + (int64_t)rowBegin, size );
+    const int64_t tileZEnd = floorDiv( params.mScrollRow + (int64_t)rowEnd - 1, size ) + 1;
+    
+    // Look every tile up, then generate the missing ones in parallel
+    vector<HeightTileKey> keys;
+    vector<HeightTileCache::TileRef> tiles;
+    vector<size_t> missing;
+    HeightTileKey key = makeTileKey( params, field );
+    for( key.mTileZ = tileZBegin; key.mTileZ < tileZEnd; key.mTileZ++ ) {
+        for( key.mTileX = 0; key.mTileX < numTilesX; key.mTileX++ ) {
+            keys.push_back( key );
+            tiles.push_back( mTileCache->find( key ) );
+            if( ! tiles.back() )
+                missing.push_back( tiles.size() - 1 );
+        }
+    }
+    // Tiles finished before a cancellation are still valid for their key, only the remaining ones are skipped
+    generator->generateRows( missing.size(), [&]( size_t begin, size_t end ) {
+        for( size_t i = begin; i < end && ! isCancelled( params ); i++ )
+            tiles[missing[i]] = generateTile( params, keys[missing[i]] );
+    }, 1 );
+    for( size_t i : missing ) {
+        if( tiles[i] )
+            mTileCache->insert( keys[i], tiles[i] );
+    }
+    if( isCancelled( params ) )
+        return false;
+    
+    // Assemble the unscaled rows from the tile rows, scaleRows() scales them
+    for( size_t row = rowBegin; row < rowEnd; row++ ) {
+        const int64_t latticeRow = params.mScrollRow + (int64_t)row;
+        const int64_t tileZ = floorDiv( latticeRow, size );
+        const size_t tileRow = size_t( latticeRow - tileZ * size );
+        const size_t rowOffset = field.rowSlot( row ) * numColumns;
+        for( int64_t tileX = 0; tileX < numTilesX; tileX++ ) {
+            const float *heights = &(*tiles[( tileZ - tileZBegin ) * numTilesX + tileX])[tileRow * size];
+            const size_t columnBegin = size_t( tileX * size );
+            const size_t columnEnd = min( numColumns, columnBegin + size );
+            copy( heights, heights + ( columnEnd - columnBegin ), &field.mNoiseHeights[rowOffset + columnBegin] );
+            if( params.mNormals ) {
+                copy( heights + size * size, heights + size * size + ( columnEnd - columnBegin ), &field.mNoiseDx[rowOffset + columnBegin] );
+                copy( heights + 2 * size * size, heights + 2 * size * size + ( columnEnd - columnBegin ), &field.mNoiseDz[rowOffset + columnBegin] );
+            }
+        }
+    }
+    return true;
+}
+
+// Normal of the surface y = h( x, z ), from the partial derivatives of h
+void TerrainGenerator::setNormal( HeightNormal &normal, float dydx, float dydz )
+{
+    const float nx = -dydx;
+    const float nz = -dydz;
+    const float invLength = 1.0f / sqrtf( nx * nx + 1.0f + nz * nz );
+    normal = HeightNormal{ nx * invLength, invLength, nz * invLength };
+}
+
+void TerrainGenerator::generateRows( const HeightParams &params, HeightField &field, size_t rowBegin, size_t rowEnd ) const
+{
+    const size_t numColumns = field.mGridX.size();
+    const HeightKernel &kernel = *params.mKernel;
+    vector<float> z( numColumns );
+    vector<float> dx( params.mNormals ? numColumns : 0 ), dz( params.mNormals ? numColumns : 0 );
+    
+    // a stale job stops at the next row, its remaining rows would never be presented
+    for( size_t row = rowBegin; row < rowEnd && ! isCancelled( params ); row++ ) {
+        fill( z.begin(), z.end(), field.mRowZ[row] );
+        // the rescalable heights are kept unscaled, along with their derivatives, scaleRows() scales them
+        if( params.isRescalable() ) {
+            const size_t rowOffset = field.rowSlot( row ) * numColumns;
+            kernel.evaluate( params, field.mGridX.data(), z.data(), &field.mNoiseHeights[rowOffset],
+                             params.mNormals ? &field.mNoiseDx[rowOffset] : nullptr, params.mNormals ? &field.mNoiseDz[rowOffset] : nullptr, numColumns );
+            continue;
+        }
+        float *heights = &field.mHeights[field.rowSlot( row ) * numColumns];
+        HeightNormal *normals = params.mNormals ? &field.mNormals[field.rowSlot( row ) * numColumns] : nullptr;
+        // the whole row goes through the compiled height function, along with the analytic derivatives
+        // of the heights when the normals are needed
+        kernel.evaluate( params, field.mGridX.data(), z.data(), heights, normals ? dx.data() : nullptr, normals ? dz.data() : nullptr, numColumns );
+        if( normals ) {
+            for( size_t column = 0; column < numColumns; column++ )
+                setNormal( normals[column], dx[column], dz[column] );
+        }
+    }
+}
+
+void TerrainGenerator::scaleRows( const HeightParams &params, HeightField &field, const HeightFieldGeneratorRef &generator, size_t rowBegin, size_t rowEnd ) const
+{
+    PROFILE_STAGE( mProfiler, "rescale" );
+    const size_t numColumns = field.mGridX.size();
+    const float scale = params.mHeightMult;
+    generator->generateRows( rowEnd - rowBegin, [&]( size_t bandBegin, size_t bandEnd ) {
+        for( size_t row = rowBegin + bandBegin; row < rowBegin + bandEnd; row++ ) {
+            // plain loops over contiguous rows, that the compiler vectorizes
+            const size_t rowOffset = field.rowSlot( row ) * numColumns;
+            const float *noiseHeights = &field.mNoiseHeights[rowOffset];
+            float *heights = &field.mHeights[rowOffset];
+            for( size_t column = 0; column < numColumns; column++ )
+                heights[column] = scale * noiseHeights[column];
+            if( params.mNormals ) {
+                const float *dx = &field.mNoiseDx[rowOffset];
+                const float *dz = &field.mNoiseDz[rowOffset];
+                HeightNormal *normals = &field.mNormals[rowOffset];
+                for( size_t column = 0; column < numColumns; column++ )
+                    setNormal( normals[column], scale * dx[column], scale * dz[column] );
+            }
+        }
+    } );
+}
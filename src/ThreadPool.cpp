@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool( size_t numThreads )
+    : mTaskFn( nullptr ), mNumTasks( 0 ), mNextTask( 0 ), mNumBusyWorkers( 0 ), mLoopId( 0 ), mQuit( false )
+{
+    if( numThreads == 0 )
+        numThreads = max<size_t>( thread::hardware_concurrency(), 1 );
+    
+    for( size_t i = 1; i < numThreads; ++i )
+        mThreads.emplace_back( &ThreadPool::workerLoop, this );
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        mQuit = true;
+    }
+    mWakeCondition.notify_all();
+    for( auto &thread : mThreads )
+        thread.join();
+}
+
+void ThreadPool::parallelFor( size_t numTasks, const function<void( size_t )> &fn )
+{
+    if( numTasks == 0 )
+        return;
+    
+    // not worth waking the workers for a single task
+    if( numTasks == 1 || mThreads.empty() ) {
+        for( size_t task = 0; task < numTasks; ++task )
+            fn( task );
+        return;
+    }
+    
+    lock_guard<mutex> loopLock( mLoopMutex );
+    {
+        lock_guard<mutex> lock( mMutex );
+        mTaskFn = &fn;
+        mNumTasks = numTasks;
+        mNextTask = 0;
+        mNumBusyWorkers = mThreads.size();
+        ++mLoopId;
+    }
+    mWakeCondition.notify_all();
+    
+    runTasks();
+    
+    // every worker has to check in, so that none of them still references fn once we return
+    unique_lock<mutex> lock( mMutex );
+    mDoneCondition.wait( lock, [this] { return mNumBusyWorkers == 0; } );
+    mTaskFn = nullptr;
+}
+
+void ThreadPool::runTasks()
+{
+    for( size_t task = mNextTask++; task < mNumTasks; task = mNextTask++ )
+        (*mTaskFn)( task );
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t lastLoopId = 0;
+    while( true ) {
+        {
+            unique_lock<mutex> lock( mMutex );
+            mWakeCondition.wait( lock, [&] { return mQuit || mLoopId != lastLoopId; } );
+            if( mQuit )
+                return;
+            lastLoopId = mLoopId;
+        }
+        
+        runTasks();
+        
+        lock_guard<mutex> lock( mMutex );
+        if( --mNumBusyWorkers == 0 )
+            mDoneCondition.notify_one();
+    }
+}
@@ -25,7 +25,9 @@
  */
 
 #include "SimplexNoise.h"
+#include "SimplexNoiseSimd.h"
 
+#include <atomic>   // std::atomic
 #include <cstdint>  // int32_t/uint8_t
 
 /**
@@ -100,6 +102,76 @@ static inline uint8_t hash(int32_t i) {
     return perm[static_cast<uint8_t>(i)];
 }
 
+/**
+ * The permutation table widened to 32 bits, for the vector kernels of SimplexNoiseSimd.cpp
+ *
+ *  AVX2 can only gather 32-bit elements, and SSE4.1 extracts 32-bit lanes anyway.
+ *
+ * @return pointer to the 256 entries of perm[] as int32_t
+ */
+const int32_t* SimplexNoiseSimd::permutation32() {
+    static const struct Table {
+        int32_t values[256];
+        Table() {
+            for (int32_t i = 0; i < 256; ++i) {
+                values[i] = perm[i];
+            }
+        }
+    } table;
+    return table.values;
+}
+
+int32_t SimplexPermutationHash::operator()(int32_t i) const {
+    return hash(i);
+}
+
+int32_t SimplexPermutationHash::operator()(int32_t i, int32_t j) const {
+    return hash(i + hash(j));
+}
+
+int32_t SimplexPermutationHash::operator()(int32_t i, int32_t j, int32_t k) const {
+    return hash(i + hash(j + hash(k)));
+}
+
+/**
+ * Helper function to finalize an integer hash ("lowbias32" xorshift-multiply by Chris Wellons)
+ *
+ *  Every input bit affects every output bit, so that the low bits used by grad() are well distributed.
+ * Only uses multiplies, shifts and xors, which all have SSE4.1/AVX2 equivalents.
+ *
+ * @param[in] h Combined seed and coordinates
+ *
+ * @return 32-bits hashed value
+ */
+static inline uint32_t mixHash(uint32_t h) {
+    using namespace SimplexNoiseSimd;
+    h ^= h >> 16;
+    h *= kHashMix1;
+    h ^= h >> 15;
+    h *= kHashMix2;
+    h ^= h >> 16;
+    return h;
+}
+
+using SimplexNoiseSimd::kHashPrimeX;
+using SimplexNoiseSimd::kHashPrimeY;
+using SimplexNoiseSimd::kHashPrimeZ;
+
+int32_t SimplexIntegerHash::operator()(int32_t i) const {
+    return static_cast<int32_t>(mixHash(mSeed ^ (static_cast<uint32_t>(i) * kHashPrimeX)));
+}
+
+int32_t SimplexIntegerHash::operator()(int32_t i, int32_t j) const {
+    return static_cast<int32_t>(mixHash(mSeed ^ (static_cast<uint32_t>(i) * kHashPrimeX)
+                                              ^ (static_cast<uint32_t>(j) * kHashPrimeY)));
+}
+
+int32_t SimplexIntegerHash::operator()(int32_t i, int32_t j, int32_t k) const {
+    return static_cast<int32_t>(mixHash(mSeed ^ (static_cast<uint32_t>(i) * kHashPrimeX)
+                                              ^ (static_cast<uint32_t>(j) * kHashPrimeY)
+                                              ^ (static_cast<uint32_t>(k) * kHashPrimeZ)));
+}
+
 /* NOTE Gradient table to test if lookup-table are more efficient than calculs
  static const float gradients1D[16] = {
  -8.f, -7.f, -6.f, -5.f, -4.f, -3.f, -2.f, -1.f,
@@ -163,6 +235,43 @@ static float grad(int32_t hash, float x, float y, float z) {
     return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
 }
 
+/**
+ * Helper function computing the contribution of a 2D corner along with its partial derivatives
+ *
+ *  With t = 0.5 - x*x - y*y and g = grad(hash, x, y) = gx*x + gy*y, the contribution t^4 * g has the
+ * derivative t^4 * gx - 8 * t^3 * x * g along x (and likewise along y), all already at hand.
+ * The contribution itself is computed exactly as in noise(x, y).
+ *
+ * @param[in]  hash  hash value
+ * @param[in]  x     x coord of the distance to the corner
+ * @param[in]  y     y coord of the distance to the corner
+ * @param[out] dx    partial derivative of the contribution along x
+ * @param[out] dy    partial derivative of the contribution along y
+ *
+ * @return contribution of the corner
+ */
+static inline float gradCorner(int32_t hash, float x, float y, float& dx, float& dy) {
+    const float t = 0.5f - x*x - y*y;
+    if (t < 0.0f) {
+        dx = 0.0f;
+        dy = 0.0f;
+        return 0.0f;
+    }
+    const float t2 = t * t;
+    const float t4 = t2 * t2;
+    const float g = grad(hash, x, y);
+    // Components of the gradient vector selected by grad(): (+-1, +-2) below 4, (+-2, +-1) above
+    const int32_t h = hash & 0x3F;
+    const float a = (h & 1) ? -1.0f : 1.0f;
+    const float b = (h & 2) ? -2.0f : 2.0f;
+    const float gx = h < 4 ? a : b;
+    const float gy = h < 4 ? b : a;
+    const float t3g = -8.0f * t * t2 * g;
+    dx = t3g * x + t4 * gx;
+    dy = t3g * y + t4 * gy;
+    return t4 * g;
+}
+
 /**
  * 1D Perlin simplex noise
  *
@@ -172,7 +281,8 @@ static float grad(int32_t hash, float x, float y, float z) {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::noise(float x) {
+template <typename Hash>
+float BasicSimplexNoise<Hash>::noise(float x) const {
     float n0, n1;   // Noise contributions from the two "corners"
     
     // No need to skew the input space in 1D
@@ -188,13 +298,13 @@ float SimplexNoise::noise(float x) {
     float t0 = 1.0f - x0*x0;
     //  if(t0 < 0.0f) t0 = 0.0f; // not possible
     t0 *= t0;
-    n0 = t0 * t0 * grad(hash(i0), x0);
+    n0 = t0 * t0 * grad(mHash(i0), x0);
     
     // Calculate the contribution from the second corner
     float t1 = 1.0f - x1*x1;
     //  if(t1 < 0.0f) t1 = 0.0f; // not possible
     t1 *= t1;
-    n1 = t1 * t1 * grad(hash(i1), x1);
+    n1 = t1 * t1 * grad(mHash(i1), x1);
     
     // The maximum value of this noise is 8*(3/4)^4 = 2.53125
     // A factor of 0.395 scales to fit exactly within [-1,1]
@@ -211,7 +321,8 @@ float SimplexNoise::noise(float x) {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::noise(float x, float y) {
+template <typename Hash>
+float BasicSimplexNoise<Hash>::noise(float x, float y) const {
     float n0, n1, n2;   // Noise contributions from the three corners
     
     // Skewing/Unskewing factors for 2D
@@ -253,9 +364,9 @@ float SimplexNoise::noise(float x, float y) {
     const float y2 = y0 - 1.0f + 2.0f * G2;
     
     // Work out the hashed gradient indices of the three simplex corners
-    const int gi0 = hash(i + hash(j));
-    const int gi1 = hash(i + i1 + hash(j + j1));
-    const int gi2 = hash(i + 1 + hash(j + 1));
+    const int gi0 = mHash(i, j);
+    const int gi1 = mHash(i + i1, j + j1);
+    const int gi2 = mHash(i + 1, j + 1);
     
     // Calculate the contribution from the first corner
     float t0 = 0.5f - x0*x0 - y0*y0;
@@ -289,6 +400,61 @@ float SimplexNoise::noise(float x, float y) {
     return 45.23065f * (n0 + n1 + n2);
 }
 
+/**
+ * 2D Perlin simplex noise along with its analytic partial derivatives
+ *
+ *  Costs only a few more multiplications than noise(x, y), which returns the same value,
+ * instead of the 2 or 4 more noise evaluations of finite differences.
+ *
+ * @param[in]  x   float coordinate
+ * @param[in]  y   float coordinate
+ * @param[out] dx  partial derivative of the noise along x
+ * @param[out] dy  partial derivative of the noise along y
+ *
+ * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
+ */
+template <typename Hash>
+float BasicSimplexNoise<Hash>::noise(float x, float y, float& dx, float& dy) const {
+    static const float F2 = 0.366025403f;  // F2 = (sqrt(3) - 1) / 2
+    static const float G2 = 0.211324865f;  // G2 = (3 - sqrt(3)) / 6   = F2 / (1 + 2 * K)
+    
+    // Same simplex cell, corners and hashes as noise(x, y)
+    const float s = (x + y) * F2;
+    const float xs = x + s;
+    const float ys = y + s;
+    const int32_t i = fastfloor(xs);
+    const int32_t j = fastfloor(ys);
+    
+    const float t = static_cast<float>(i + j) * G2;
+    const float X0 = i - t;
+    const float Y0 = j - t;
+    const float x0 = x - X0;
+    const float y0 = y - Y0;
+    
+    int32_t i1, j1;
+    if (x0 > y0) {
+        i1 = 1;
+        j1 = 0;
+    } else {
+        i1 = 0;
+        j1 = 1;
+    }
+    
+    const float x1 = x0 - i1 + G2;
+    const float y1 = y0 - j1 + G2;
+    const float x2 = x0 - 1.0f + 2.0f * G2;
+    const float y2 = y0 - 1.0f + 2.0f * G2;
+    
+    float dx0, dy0, dx1, dy1, dx2, dy2;
+    const float n0 = gradCorner(mHash(i, j), x0, y0, dx0, dy0);
+    const float n1 = gradCorner(mHash(i + i1, j + j1), x1, y1, dx1, dy1);
+    const float n2 = gradCorner(mHash(i + 1, j + 1), x2, y2, dx2, dy2);
+    
+    // The derivatives of the unskewed distances are those of x and y, so only the final scale applies
+    dx = 45.23065f * (dx0 + dx1 + dx2);
+    dy = 45.23065f * (dy0 + dy1 + dy2);
+    return 45.23065f * (n0 + n1 + n2);
+}
 
 /**
  * 3D Perlin simplex noise
@@ -299,7 +465,8 @@ float SimplexNoise::noise(float x, float y) {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::noise(float x, float y, float z) {
+template <typename Hash>
+float BasicSimplexNoise<Hash>::noise(float x, float y, float z) const {
     float n0, n1, n2, n3; // Noise contributions from the four corners
     
     // Skewing/Unskewing factors for 3D
@@ -356,10 +523,10 @@ float SimplexNoise::noise(float x, float y, float z) {
     float z3 = z0 - 1.0f + 3.0f * G3;
     
     // Work out the hashed gradient indices of the four simplex corners
-    int gi0 = hash(i + hash(j + hash(k)));
-    int gi1 = hash(i + i1 + hash(j + j1 + hash(k + k1)));
-    int gi2 = hash(i + i2 + hash(j + j2 + hash(k + k2)));
-    int gi3 = hash(i + 1 + hash(j + 1 + hash(k + 1)));
+    int gi0 = mHash(i, j, k);
+    int gi1 = mHash(i + i1, j + j1, k + k1);
+    int gi2 = mHash(i + i2, j + j2, k + k2);
+    int gi3 = mHash(i + 1, j + 1, k + 1);
     
     // Calculate the contribution from the four corners
     float t0 = 0.6f - x0*x0 - y0*y0 - z0*z0;
@@ -396,6 +563,146 @@ float SimplexNoise::noise(float x, float y, float z) {
 }
 
 
+/**
+ * Detects the best instruction set usable by the batched functions on this CPU
+ *
+ * @return SimdAvx2, SimdSse41 or SimdScalar
+ */
+static SimplexNoiseBase::SimdLevel detectSimdLevel() {
+#if SIMPLEXNOISE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimplexNoiseBase::SimdAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimplexNoiseBase::SimdSse41;
+    }
+#endif
+    return SimplexNoiseBase::SimdScalar;
+}
+
+/**
+ * Instruction set currently used by the batched functions, initialized on first use
+ */
+static std::atomic<int>& simdLevel() {
+    static std::atomic<int> level(detectSimdLevel());
+    return level;
+}
+
+SimplexNoiseBase::SimdLevel SimplexNoiseBase::getSupportedSimdLevel() {
+    static const SimdLevel supported = detectSimdLevel();
+    return supported;
+}
+
+SimplexNoiseBase::SimdLevel SimplexNoiseBase::getSimdLevel() {
+    return static_cast<SimdLevel>(simdLevel().load(std::memory_order_relaxed));
+}
+
+SimplexNoiseBase::SimdLevel SimplexNoiseBase::setSimdLevel(SimdLevel level) {
+    if (level > getSupportedSimdLevel()) {
+        level = getSupportedSimdLevel();
+    }
+    simdLevel().store(level, std::memory_order_relaxed);
+    return level;
+}
+
+/**
+ * Batched 2D Perlin simplex noise
+ *
+ *  Dispatches to the AVX2 (8 points at a time) or SSE4.1 (4 points at a time) kernel when available,
+ * the results are the same as calling noise(x[n], y[n]) for each point (see SimdLevel).
+ *
+ * @param[in]  x     x float coordinates
+ * @param[in]  y     y float coordinates
+ * @param[out] out   noise values, in the range[-1; 1]
+ * @param[in]  count number of points
+ */
+template <typename Hash>
+void BasicSimplexNoise<Hash>::noise(const float* x, const float* y, float* out, size_t count) const {
+    size_t done = 0;
+    switch (getSimdLevel()) {
+#if SIMPLEXNOISE_X86_SIMD
+        case SimdAvx2:
+            done = SimplexNoiseSimd::noise2Avx2(mHash, x, y, out, count);
+            break;
+        case SimdSse41:
+            done = SimplexNoiseSimd::noise2Sse41(mHash, x, y, out, count);
+            break;
+#endif
+        default:
+            break;
+    }
+    // The kernels process whole registers, finish the remaining points one by one
+    for (size_t n = done; n < count; ++n) {
+        out[n] = noise(x[n], y[n]);
+    }
+}
+
+/**
+ * Batched 3D Perlin simplex noise
+ *
+ * @param[in]  x     x float coordinates
+ * @param[in]  y     y float coordinates
+ * @param[in]  z     z float coordinates
+ * @param[out] out   noise values, in the range[-1; 1]
+ * @param[in]  count number of points
+ */
+template <typename Hash>
+void BasicSimplexNoise<Hash>::noise(const float* x, const float* y, const float* z, float* out, size_t count) const {
+    size_t done = 0;
+    switch (getSimdLevel()) {
+#if SIMPLEXNOISE_X86_SIMD
+        case SimdAvx2:
+            done = SimplexNoiseSimd::noise3Avx2(mHash, x, y, z, out, count);
+            break;
+        case SimdSse41:
+            done = SimplexNoiseSimd::noise3Sse41(mHash, x, y, z, out, count);
+            break;
+#endif
+        default:
+            break;
+    }
+    for (size_t n = done; n < count; ++n) {
+        out[n] = noise(x[n], y[n], z[n]);
+    }
+}
+
+/**
+ * Batched 2D Perlin simplex noise along with its analytic partial derivatives
+ *
+ * @param[in]  x     x float coordinates
+ * @param[in]  y     y float coordinates
+ * @param[out] out   noise values, in the range[-1; 1]
+ * @param[out] dx    partial derivatives of the noise along x
+ * @param[out] dy    partial derivatives of the noise along y
+ * @param[in]  count number of points
+ */
+template <typename Hash>
+void BasicSimplexNoise<Hash>::noise(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const {
+    size_t done = 0;
+    switch (getSimdLevel()) {
+#if SIMPLEXNOISE_X86_SIMD
+        case SimdAvx2:
+            done = SimplexNoiseSimd::noise2DerivativesAvx2(mHash, x, y, out, dx, dy, count);
+            break;
+        case SimdSse41:
+            done = SimplexNoiseSimd::noise2DerivativesSse41(mHash, x, y, out, dx, dy, count);
+            break;
+#endif
+        default:
+            break;
+    }
+    for (size_t n = done; n < count; ++n) {
+        out[n] = noise(x[n], y[n], dx[n], dy[n]);
+    }
+}
+
+/**
+ * Number of points processed per block by the batched fractal functions,
+ * small enough for the scaled coordinates and partial sums to stay in L1 cache.
+ */
+static const size_t kFractalBlockSize = 256;
+
 /**
  * Fractal/Fractional Brownian Motion (fBm) summation of 1D Perlin Simplex noise
  *
@@ -404,7 +711,8 @@ float SimplexNoise::noise(float x, float y, float z) {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::fractal(size_t octaves, float x) const {
+template <typename Hash>
+float BasicSimplexNoise<Hash>::fractal(size_t octaves, float x) const {
     float output    = 0.f;
     float denom     = 0.f;
     float frequency = mFrequency;
@@ -430,7 +738,8 @@ float SimplexNoise::fractal(size_t octaves, float x) const {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::fractal(size_t octaves, float x, float y) const {
+template <typename Hash>
+float BasicSimplexNoise<Hash>::fractal(size_t octaves, float x, float y) const {
     float output = 0.f;
     float denom  = 0.f;
     float frequency = mFrequency;
@@ -457,7 +766,8 @@ float SimplexNoise::fractal(size_t octaves, float x, float y) const {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::fractal(size_t octaves, float x, float y, float z) const {
+template <typename Hash>
+float BasicSimplexNoise<Hash>::fractal(size_t octaves, float x, float y, float z) const {
     float output = 0.f;
     float denom  = 0.f;
     float frequency = mFrequency;
@@ -473,3 +783,465 @@ float SimplexNoise::fractal(size_t octaves, float x, float y, float z) const {
     
     return (output / denom);
 }
+
+/**
+ * Fractal/Fractional Brownian Motion (fBm) summation of 2D Perlin Simplex noise with its partial derivatives
+ *
+ *  Each octave contributes amplitude * noise(x * frequency, ...), so its derivatives are scaled
+ * by amplitude * frequency. The value is the same as fractal(octaves, x, y).
+ *
+ * @param[in]  octaves   number of fraction of noise to sum
+ * @param[in]  x         x float coordinate
+ * @param[in]  y         y float coordinate
+ * @param[out] dx        partial derivative along x
+ * @param[out] dy        partial derivative along y
+ *
+ * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
+ */
+template <typename Hash>
+float BasicSimplexNoise<Hash>::fractal(size_t octaves, float x, float y, float& dx, float& dy) const {
+    float output = 0.f;
+    float outDx  = 0.f;
+    float outDy  = 0.f;
+    float denom  = 0.f;
+    float frequency = mFrequency;
+    float amplitude = mAmplitude;
+    
+    for (size_t i = 0; i < octaves; i++) {
+        float octaveDx, octaveDy;
+        output += (amplitude * noise(x * frequency, y * frequency, octaveDx, octaveDy));
+        outDx += (amplitude * frequency * octaveDx);
+        outDy += (amplitude * frequency * octaveDy);
+        denom += amplitude;
+        
+        frequency *= mLacunarity;
+        amplitude *= mPersistence;
+    }
+    
+    dx = (outDx / denom);
+    dy = (outDy / denom);
+    return (output / denom);
+}
+
+/**
+ * Batched Fractal/Fractional Brownian Motion (fBm) summation of 2D Perlin Simplex noise
+ *
+ *  Evaluates one octave at a time over blocks of points with the batched noise(),
+ * accumulating in the same order as fractal(octaves, x, y) so that the results are identical.
+ *
+ * @param[in]  octaves   number of fraction of noise to sum
+ * @param[in]  x         x float coordinates
+ * @param[in]  y         y float coordinates
+ * @param[out] out       noise values, in the range[-1; 1]
+ * @param[in]  count     number of points
+ */
+template <typename Hash>
+void BasicSimplexNoise<Hash>::fractal(size_t octaves, const float* x, const float* y, float* out, size_t count) const {
+    float xs[kFractalBlockSize];
+    float ys[kFractalBlockSize];
+    float octave[kFractalBlockSize];
+    
+    for (size_t begin = 0; begin < count; begin += kFractalBlockSize) {
+        const size_t size = (count - begin < kFractalBlockSize) ? (count - begin) : kFractalBlockSize;
+        float* output = out + begin;
+        float denom = 0.f;
+        float frequency = mFrequency;
+        float amplitude = mAmplitude;
+        
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = 0.f;
+        }
+        for (size_t i = 0; i < octaves; i++) {
+            for (size_t n = 0; n < size; ++n) {
+                xs[n] = x[begin + n] * frequency;
+                ys[n] = y[begin + n] * frequency;
+            }
+            noise(xs, ys, octave, size);
+            for (size_t n = 0; n < size; ++n) {
+                output[n] += (amplitude * octave[n]);
+            }
+            denom += amplitude;
+            
+            frequency *= mLacunarity;
+            amplitude *= mPersistence;
+        }
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = (output[n] / denom);
+        }
+    }
+}
+
+/**
+ * Batched Fractal/Fractional Brownian Motion (fBm) summation of 3D Perlin Simplex noise
+ *
+ * @param[in]  octaves   number of fraction of noise to sum
+ * @param[in]  x         x float coordinates
+ * @param[in]  y         y float coordinates
+ * @param[in]  z         z float coordinates
+ * @param[out] out       noise values, in the range[-1; 1]
+ * @param[in]  count     number of points
+ */
+template <typename Hash>
+void BasicSimplexNoise<Hash>::fractal(size_t octaves, const float* x, const float* y, const float* z, float* out, size_t count) const {
+    float xs[kFractalBlockSize];
+    float ys[kFractalBlockSize];
+    float zs[kFractalBlockSize];
+    float octave[kFractalBlockSize];
+    
+    for (size_t begin = 0; begin < count; begin += kFractalBlockSize) {
+        const size_t size = (count - begin < kFractalBlockSize) ? (count - begin) : kFractalBlockSize;
+        float* output = out + begin;
+        float denom = 0.f;
+        float frequency = mFrequency;
+        float amplitude = mAmplitude;
+        
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = 0.f;
+        }
+        for (size_t i = 0; i < octaves; i++) {
+            for (size_t n = 0; n < size; ++n) {
+                xs[n] = x[begin + n] * frequency;
+                ys[n] = y[begin + n] * frequency;
+                zs[n] = z[begin + n] * frequency;
+            }
+            noise(xs, ys, zs, octave, size);
+            for (size_t n = 0; n < size; ++n) {
+                output[n] += (amplitude * octave[n]);
+            }
+            denom += amplitude;
+            
+            frequency *= mLacunarity;
+            amplitude *= mPersistence;
+        }
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = (output[n] / denom);
+        }
+    }
+}
+
+
+/**
+ * Batched Fractal/Fractional Brownian Motion (fBm) summation of 2D Perlin Simplex noise with its partial derivatives
+ *
+ * @param[in]  octaves   number of fraction of noise to sum
+ * @param[in]  x         x float coordinates
+ * @param[in]  y         y float coordinates
+ * @param[out] out       noise values, in the range[-1; 1]
+ * @param[out] dx        partial derivatives along x
+ * @param[out] dy        partial derivatives along y
+ * @param[in]  count     number of points
+ */
+template <typename Hash>
+void BasicSimplexNoise<Hash>::fractal(size_t octaves, const float* x, const float* y,
+                                      float* out, float* dx, float* dy, size_t count) const {
+    float xs[kFractalBlockSize];
+    float ys[kFractalBlockSize];
+    float octave[kFractalBlockSize];
+    float octaveDx[kFractalBlockSize];
+    float octaveDy[kFractalBlockSize];
+    
+    for (size_t begin = 0; begin < count; begin += kFractalBlockSize) {
+        const size_t size = (count - begin < kFractalBlockSize) ? (count - begin) : kFractalBlockSize;
+        float* output = out + begin;
+        float* outputDx = dx + begin;
+        float* outputDy = dy + begin;
+        float denom = 0.f;
+        float frequency = mFrequency;
+        float amplitude = mAmplitude;
+        
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = 0.f;
+            outputDx[n] = 0.f;
+            outputDy[n] = 0.f;
+        }
+        for (size_t i = 0; i < octaves; i++) {
+            for (size_t n = 0; n < size; ++n) {
+                xs[n] = x[begin + n] * frequency;
+                ys[n] = y[begin + n] * frequency;
+            }
+            noise(xs, ys, octave, octaveDx, octaveDy, size);
+            const float scale = amplitude * frequency;
+            for (size_t n = 0; n < size; ++n) {
+                output[n] += (amplitude * octave[n]);
+                outputDx[n] += (scale * octaveDx[n]);
+                outputDy[n] += (scale * octaveDy[n]);
+            }
+            denom += amplitude;
+            
+            frequency *= mLacunarity;
+            amplitude *= mPersistence;
+        }
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = (output[n] / denom);
+            outputDx[n] = (outputDx[n] / denom);
+            outputDy[n] = (outputDy[n] / denom);
+        }
+    }
+}
+
+/**
+ * Helper calling fn(I), fn(I + 1) ... fn(N - 1) through template recursion, so that the loop is always
+ * fully unrolled (a constant trip count alone does not guarantee it with a call in the loop body).
+ */
+template <size_t I, size_t N>
+struct UnrolledOctaves {
+    template <typename Fn>
+    static inline void run(Fn& fn) {
+        fn(I);
+        UnrolledOctaves<I + 1, N>::run(fn);
+    }
+};
+template <size_t N>
+struct UnrolledOctaves<N, N> {
+    template <typename Fn>
+    static inline void run(Fn&) {
+    }
+};
+
+/**
+ * Runs fn(i) for each octave: unrolled when the count is known at compile time, a plain loop otherwise
+ */
+template <size_t Octaves, typename Fn>
+static inline void forEachOctave(size_t octaves, Fn& fn) {
+    if (Octaves != 0) {
+        UnrolledOctaves<0, Octaves>::run(fn);
+    } else {
+        for (size_t i = 0; i < octaves; i++) {
+            fn(i);
+        }
+    }
+}
+
+/**
+ * Prepares the frequency and amplitude tables, and picks the instantiation matching the octave count
+ *
+ *  The tables are built with the same successive multiplications as fractal(), so the octaves match exactly.
+ *
+ * @param[in] noise    Noise providing the parameters of the fBm
+ * @param[in] octaves  Number of fraction of noise to sum
+ */
+template <typename Hash>
+BasicPreparedFractal<Hash>::BasicPreparedFractal(const BasicSimplexNoise<Hash>& noise, size_t octaves) :
+    mNoise(noise) {
+    if (octaves < 1) {
+        octaves = 1;
+    }
+    float denom     = 0.f;
+    float frequency = noise.mFrequency;
+    float amplitude = noise.mAmplitude;
+    for (size_t i = 0; i < octaves; i++) {
+        mFrequencies.push_back(frequency);
+        mAmplitudes.push_back(amplitude);
+        denom += amplitude;
+        
+        frequency *= noise.mLacunarity;
+        amplitude *= noise.mPersistence;
+    }
+    mInvDenom = 1.0f / denom;
+    
+#define SIMPLEXNOISE_OCTAVES_TABLE(fn) { \
+        &fn<0>, &fn<1>, &fn<2>, &fn<3>, &fn<4>, &fn<5>, &fn<6>, &fn<7>, &fn<8>, \
+        &fn<9>, &fn<10>, &fn<11>, &fn<12>, &fn<13>, &fn<14>, &fn<15>, &fn<16> }
+    static const Scalar2Fn scalar2Fns[] = SIMPLEXNOISE_OCTAVES_TABLE(scalar2);
+    static const Scalar3Fn scalar3Fns[] = SIMPLEXNOISE_OCTAVES_TABLE(scalar3);
+    static const Batch2Fn  batch2Fns[]  = SIMPLEXNOISE_OCTAVES_TABLE(batch2);
+    static const Batch3Fn  batch3Fns[]  = SIMPLEXNOISE_OCTAVES_TABLE(batch3);
+    static const Batch2DerivativesFn batch2DerivativesFns[] = SIMPLEXNOISE_OCTAVES_TABLE(batch2Derivatives);
+#undef SIMPLEXNOISE_OCTAVES_TABLE
+    
+    const size_t index = (octaves <= kMaxUnrolledOctaves) ? octaves : 0;
+    mScalar2 = scalar2Fns[index];
+    mScalar3 = scalar3Fns[index];
+    mBatch2  = batch2Fns[index];
+    mBatch3  = batch3Fns[index];
+    mBatch2Derivatives = batch2DerivativesFns[index];
+}
+
+/**
+ * Prepared fBm summation of 2D Perlin Simplex noise of a point
+ *
+ * @param[in] self  Prepared fractal
+ * @param[in] x     x float coordinate
+ * @param[in] y     y float coordinate
+ *
+ * @return Noise value in the range[-1; 1]
+ */
+template <typename Hash>
+template <size_t Octaves>
+float BasicPreparedFractal<Hash>::scalar2(const BasicPreparedFractal& self, float x, float y) {
+    float output = 0.f;
+    auto octave = [&](size_t i) {
+        const float frequency = self.mFrequencies[i];
+        output += (self.mAmplitudes[i] * self.mNoise.noise(x * frequency, y * frequency));
+    };
+    forEachOctave<Octaves>(self.mFrequencies.size(), octave);
+    return output * self.mInvDenom;
+}
+
+/**
+ * Prepared fBm summation of 3D Perlin Simplex noise of a point
+ *
+ * @param[in] self  Prepared fractal
+ * @param[in] x     x float coordinate
+ * @param[in] y     y float coordinate
+ * @param[in] z     z float coordinate
+ *
+ * @return Noise value in the range[-1; 1]
+ */
+template <typename Hash>
+template <size_t Octaves>
+float BasicPreparedFractal<Hash>::scalar3(const BasicPreparedFractal& self, float x, float y, float z) {
+    float output = 0.f;
+    auto octave = [&](size_t i) {
+        const float frequency = self.mFrequencies[i];
+        output += (self.mAmplitudes[i] * self.mNoise.noise(x * frequency, y * frequency, z * frequency));
+    };
+    forEachOctave<Octaves>(self.mFrequencies.size(), octave);
+    return output * self.mInvDenom;
+}
+
+/**
+ * Batched prepared fBm summation of 2D Perlin Simplex noise
+ *
+ * @param[in]  self      Prepared fractal
+ * @param[in]  x         x float coordinates
+ * @param[in]  y         y float coordinates
+ * @param[out] out       noise values, in the range[-1; 1]
+ * @param[in]  count     number of points
+ */
+template <typename Hash>
+template <size_t Octaves>
+void BasicPreparedFractal<Hash>::batch2(const BasicPreparedFractal& self, const float* x, const float* y, float* out, size_t count) {
+    float xs[kFractalBlockSize];
+    float ys[kFractalBlockSize];
+    float noise[kFractalBlockSize];
+    
+    for (size_t begin = 0; begin < count; begin += kFractalBlockSize) {
+        const size_t size = (count - begin < kFractalBlockSize) ? (count - begin) : kFractalBlockSize;
+        float* output = out + begin;
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = 0.f;
+        }
+        auto octave = [&](size_t i) {
+            const float frequency = self.mFrequencies[i];
+            const float amplitude = self.mAmplitudes[i];
+            for (size_t n = 0; n < size; ++n) {
+                xs[n] = x[begin + n] * frequency;
+                ys[n] = y[begin + n] * frequency;
+            }
+            self.mNoise.noise(xs, ys, noise, size);
+            for (size_t n = 0; n < size; ++n) {
+                output[n] += (amplitude * noise[n]);
+            }
+        };
+        forEachOctave<Octaves>(self.mFrequencies.size(), octave);
+        for (size_t n = 0; n < size; ++n) {
+            output[n] *= self.mInvDenom;
+        }
+    }
+}
+
+/**
+ * Batched prepared fBm summation of 3D Perlin Simplex noise
+ *
+ * @param[in]  self      Prepared fractal
+ * @param[in]  x         x float coordinates
+ * @param[in]  y         y float coordinates
+ * @param[in]  z         z float coordinates
+ * @param[out] out       noise values, in the range[-1; 1]
+ * @param[in]  count     number of points
+ */
+template <typename Hash>
+template <size_t Octaves>
+void BasicPreparedFractal<Hash>::batch3(const BasicPreparedFractal& self, const float* x, const float* y, const float* z, float* out, size_t count) {
+    float xs[kFractalBlockSize];
+    float ys[kFractalBlockSize];
+    float zs[kFractalBlockSize];
+    float noise[kFractalBlockSize];
+    
+    for (size_t begin = 0; begin < count; begin += kFractalBlockSize) {
+        const size_t size = (count - begin < kFractalBlockSize) ? (count - begin) : kFractalBlockSize;
+        float* output = out + begin;
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = 0.f;
+        }
+        auto octave = [&](size_t i) {
+            const float frequency = self.mFrequencies[i];
+            const float amplitude = self.mAmplitudes[i];
+            for (size_t n = 0; n < size; ++n) {
+                xs[n] = x[begin + n] * frequency;
+                ys[n] = y[begin + n] * frequency;
+                zs[n] = z[begin + n] * frequency;
+            }
+            self.mNoise.noise(xs, ys, zs, noise, size);
+            for (size_t n = 0; n < size; ++n) {
+                output[n] += (amplitude * noise[n]);
+            }
+        };
+        forEachOctave<Octaves>(self.mFrequencies.size(), octave);
+        for (size_t n = 0; n < size; ++n) {
+            output[n] *= self.mInvDenom;
+        }
+    }
+}
+
+/**
+ * Batched prepared fBm summation of 2D Perlin Simplex noise with its partial derivatives
+ *
+ * @param[in]  self      Prepared fractal
+ * @param[in]  x         x float coordinates
+ * @param[in]  y         y float coordinates
+ * @param[out] out       noise values, in the range[-1; 1]
+ * @param[out] dx        partial derivatives along x
+ * @param[out] dy        partial derivatives along y
+ * @param[in]  count     number of points
+ */
+template <typename Hash>
+template <size_t Octaves>
+void BasicPreparedFractal<Hash>::batch2Derivatives(const BasicPreparedFractal& self, const float* x, const float* y,
+                                                   float* out, float* dx, float* dy, size_t count) {
+    float xs[kFractalBlockSize];
+    float ys[kFractalBlockSize];
+    float noise[kFractalBlockSize];
+    float noiseDx[kFractalBlockSize];
+    float noiseDy[kFractalBlockSize];
+    
+    for (size_t begin = 0; begin < count; begin += kFractalBlockSize) {
+        const size_t size = (count - begin < kFractalBlockSize) ? (count - begin) : kFractalBlockSize;
+        float* output = out + begin;
+        float* outputDx = dx + begin;
+        float* outputDy = dy + begin;
+        for (size_t n = 0; n < size; ++n) {
+            output[n] = 0.f;
+            outputDx[n] = 0.f;
+            outputDy[n] = 0.f;
+        }
+        auto octave = [&](size_t i) {
+            const float frequency = self.mFrequencies[i];
+            const float amplitude = self.mAmplitudes[i];
+            const float scale = amplitude * frequency;
+            for (size_t n = 0; n < size; ++n) {
+                xs[n] = x[begin + n] * frequency;
+                ys[n] = y[begin + n] * frequency;
+            }
+            self.mNoise.noise(xs, ys, noise, noiseDx, noiseDy, size);
+            for (size_t n = 0; n < size; ++n) {
+                output[n] += (amplitude * noise[n]);
+                outputDx[n] += (scale * noiseDx[n]);
+                outputDy[n] += (scale * noiseDy[n]);
+            }
+        };
+        forEachOctave<Octaves>(self.mFrequencies.size(), octave);
+        for (size_t n = 0; n < size; ++n) {
+            output[n] *= self.mInvDenom;
+            outputDx[n] *= self.mInvDenom;
+            outputDy[n] *= self.mInvDenom;
+        }
+    }
+}
+
+// Explicit instantiation of the two hashing backends
+template class BasicSimplexNoise<SimplexPermutationHash>;
+template class BasicSimplexNoise<SimplexIntegerHash>;
+template class BasicPreparedFractal<SimplexPermutationHash>;
+template class BasicPreparedFractal<SimplexIntegerHash>;
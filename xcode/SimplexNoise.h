@@ -10,24 +10,104 @@
 #pragma once
 
 #include <cstddef>  // size_t
+#include <cstdint>  // int32_t/uint32_t
+#include <vector>   // std::vector
+
+/**
+ * @brief Reference hashing backend: Ken Perlin's 256 entries permutation table.
+ *
+ * Produces the classic output, but repeats every 256 units and needs a table lookup (a gather) per corner.
+ */
+struct SimplexPermutationHash {
+    // Hash of a 1D, 2D or 3D simplex corner, composed as perm[i + perm[j + perm[k]]]
+    int32_t operator()(int32_t i) const;
+    int32_t operator()(int32_t i, int32_t j) const;
+    int32_t operator()(int32_t i, int32_t j, int32_t k) const;
+};
+
+/**
+ * @brief Arithmetic hashing backend: multiply/xorshift integer hash of the corner coordinates.
+ *
+ * No table lookup, so it vectorizes without gathers, it does not repeat before 2^32 units,
+ * and each seed produces a different (but deterministic) noise field.
+ */
+struct SimplexIntegerHash {
+    explicit SimplexIntegerHash(uint32_t seed = 0) : mSeed(seed) {
+    }
+
+    // Hash of a 1D, 2D or 3D simplex corner
+    int32_t operator()(int32_t i) const;
+    int32_t operator()(int32_t i, int32_t j) const;
+    int32_t operator()(int32_t i, int32_t j, int32_t k) const;
+
+    uint32_t mSeed; ///< Seed mixed into every hash
+};
+
+/**
+ * @brief Non-template part of the noise: selection of the instruction set of the batched functions.
+ */
+class SimplexNoiseBase {
+public:
+    /**
+     * Instruction set used by the batched entry points.
+     *
+     * The best level supported by the CPU is selected at runtime. All levels evaluate the corners
+     * with the same operations in the same order as the scalar functions, so their results are
+     * bit-identical to them (0 ULP) as long as the scalar code is not built with FMA contraction
+     * (-ffp-contract=fast with -mfma); in that case they stay within 1e-6 of it.
+     */
+    enum SimdLevel {
+        SimdScalar = 0, ///< Portable fallback looping over the scalar functions
+        SimdSse41,      ///< 4 points at a time, hash lookups done per lane
+        SimdAvx2        ///< 8 points at a time, hash lookups done with gathers
+    };
+
+    // Best instruction set supported by this CPU
+    static SimdLevel getSupportedSimdLevel();
+    // Instruction set currently used by the batched entry points
+    static SimdLevel getSimdLevel();
+    // Force an instruction set (clamped to the supported one), mostly useful for benchmarks and comparisons
+    static SimdLevel setSimdLevel(SimdLevel level);
+};
 
 /**
  * @brief A Perlin Simplex Noise C++ Implementation (1D, 2D, 3D, 4D).
+ *
+ * The hashing backend is a template parameter so that the noise loops carry no branch on it;
+ * both SimplexPermutationHash and SimplexIntegerHash are instantiated in SimplexNoise.cpp.
  */
-class SimplexNoise {
+template <typename Hash>
+class BasicSimplexNoise : public SimplexNoiseBase {
 public:
     // 1D Perlin simplex noise
-    static float noise(float x);
+    float noise(float x) const;
     // 2D Perlin simplex noise
-    static float noise(float x, float y);
+    float noise(float x, float y) const;
     // 3D Perlin simplex noise
-    static float noise(float x, float y, float z);
-    
+    float noise(float x, float y, float z) const;
+
+    // Batched 2D/3D Perlin simplex noise over contiguous coordinate arrays (out[n] = noise(x[n], y[n]...))
+    void noise(const float* x, const float* y, float* out, size_t count) const;
+    void noise(const float* x, const float* y, const float* z, float* out, size_t count) const;
+
+    // 2D Perlin simplex noise along with its analytic partial derivatives d/dx and d/dy
+    float noise(float x, float y, float& dx, float& dy) const;
+    // Batched 2D Perlin simplex noise along with its partial derivatives (out[n] = noise(x[n], y[n], dx[n], dy[n]))
+    void noise(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const;
+
     // Fractal/Fractional Brownian Motion (fBm) noise summation
     float fractal(size_t octaves, float x) const;
     float fractal(size_t octaves, float x, float y) const;
     float fractal(size_t octaves, float x, float y, float z) const;
-    
+
+    // Batched fBm summation over contiguous coordinate arrays (out[n] = fractal(octaves, x[n], y[n]...))
+    void fractal(size_t octaves, const float* x, const float* y, float* out, size_t count) const;
+    void fractal(size_t octaves, const float* x, const float* y, const float* z, float* out, size_t count) const;
+
+    // 2D fBm summation along with its analytic partial derivatives, scalar and batched
+    float fractal(size_t octaves, float x, float y, float& dx, float& dy) const;
+    void fractal(size_t octaves, const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const;
+
     /**
      * Constructor of to initialize a fractal noise summation
      *
@@ -35,21 +115,112 @@ public:
      * @param[in] amplitude    Amplitude ("height") of the first octave of noise (default to 1.0)
      * @param[in] lacunarity   Lacunarity specifies the frequency multiplier between successive octaves (default to 2.0).
      * @param[in] persistence  Persistence is the loss of amplitude between successive octaves (usually 1/lacunarity)
+     * @param[in] hash         Hashing backend, carrying the seed if it has one
      */
-    explicit SimplexNoise(float frequency = 1.0f,
-                          float amplitude = 1.0f,
-                          float lacunarity = 2.0f,
-                          float persistence = 0.5f) :
+    explicit BasicSimplexNoise(float frequency = 1.0f,
+                               float amplitude = 1.0f,
+                               float lacunarity = 2.0f,
+                               float persistence = 0.5f,
+                               const Hash& hash = Hash()) :
     mFrequency(frequency),
     mAmplitude(amplitude),
     mLacunarity(lacunarity),
-    mPersistence(persistence) {
+    mPersistence(persistence),
+    mHash(hash) {
     }
-    
-    
+
+
     // Parameters of Fractional Brownian Motion (fBm) : sum of N "octaves" of noise
     float mFrequency;   ///< Frequency ("width") of the first octave of noise (default to 1.0)
     float mAmplitude;   ///< Amplitude ("height") of the first octave of noise (default to 1.0)
     float mLacunarity;  ///< Lacunarity specifies the frequency multiplier between successive octaves (default to 2.0).
     float mPersistence; ///< Persistence is the loss of amplitude between successive octaves (usually 1/lacunarity)
+
+    Hash  mHash;        ///< Hashing backend of the simplex corners
 };
+
+/// Reference noise, using the permutation table
+typedef BasicSimplexNoise<SimplexPermutationHash> SimplexNoise;
+/// Seeded noise, using the arithmetic integer hash
+typedef BasicSimplexNoise<SimplexIntegerHash> SeededSimplexNoise;
+
+/**
+ * @brief Fractal/Fractional Brownian Motion (fBm) summation prepared for a fixed set of parameters.
+ *
+ * BasicSimplexNoise::fractal() recomputes the frequency and amplitude of every octave, and their sum,
+ * for each point. This object computes them once: per-octave frequency/amplitude tables and the
+ * reciprocal of the amplitude sum. Octave counts from 1 to kMaxUnrolledOctaves are served by template
+ * instantiations whose octave loop is fully unrolled, picked once at construction; larger counts
+ * use a generic loop.
+ *
+ * The octaves are summed in the same order as fractal(), only the final division becomes a multiplication
+ * by the reciprocal, so the results are within 2 ULP of fractal().
+ * Rebuild the object whenever the noise parameters or the octave count change.
+ */
+template <typename Hash>
+class BasicPreparedFractal {
+public:
+    static const size_t kMaxUnrolledOctaves = 16;
+
+    /**
+     * Prepares the fBm summation of the given noise parameters
+     *
+     * @param[in] noise    Noise providing the parameters of the fBm (copied, later changes are not seen)
+     * @param[in] octaves  Number of fraction of noise to sum (at least 1)
+     */
+    explicit BasicPreparedFractal(const BasicSimplexNoise<Hash>& noise = BasicSimplexNoise<Hash>(), size_t octaves = 1);
+
+    // Fractal/Fractional Brownian Motion (fBm) noise summation of a point
+    float operator()(float x, float y) const { return mScalar2(*this, x, y); }
+    float operator()(float x, float y, float z) const { return mScalar3(*this, x, y, z); }
+
+    // Batched fBm summation over contiguous coordinate arrays
+    void operator()(const float* x, const float* y, float* out, size_t count) const {
+        mBatch2(*this, x, y, out, count);
+    }
+    void operator()(const float* x, const float* y, const float* z, float* out, size_t count) const {
+        mBatch3(*this, x, y, z, out, count);
+    }
+    // Batched 2D fBm summation along with its analytic partial derivatives d/dx and d/dy
+    void operator()(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const {
+        mBatch2Derivatives(*this, x, y, out, dx, dy, count);
+    }
+
+    size_t getOctaves() const { return mFrequencies.size(); }
+    const BasicSimplexNoise<Hash>& getNoise() const { return mNoise; }
+
+private:
+    typedef float (*Scalar2Fn)(const BasicPreparedFractal&, float, float);
+    typedef float (*Scalar3Fn)(const BasicPreparedFractal&, float, float, float);
+    typedef void (*Batch2Fn)(const BasicPreparedFractal&, const float*, const float*, float*, size_t);
+    typedef void (*Batch3Fn)(const BasicPreparedFractal&, const float*, const float*, const float*, float*, size_t);
+    typedef void (*Batch2DerivativesFn)(const BasicPreparedFractal&, const float*, const float*, float*, float*, float*, size_t);
+
+    // Octaves == 0 stands for the generic loop over getOctaves()
+    template <size_t Octaves>
+    static float scalar2(const BasicPreparedFractal& self, float x, float y);
+    template <size_t Octaves>
+    static float scalar3(const BasicPreparedFractal& self, float x, float y, float z);
+    template <size_t Octaves>
+    static void batch2(const BasicPreparedFractal& self, const float* x, const float* y, float* out, size_t count);
+    template <size_t Octaves>
+    static void batch3(const BasicPreparedFractal& self, const float* x, const float* y, const float* z, float* out, size_t count);
+    template <size_t Octaves>
+    static void batch2Derivatives(const BasicPreparedFractal& self, const float* x, const float* y,
+                                  float* out, float* dx, float* dy, size_t count);
+
+    BasicSimplexNoise<Hash> mNoise;
+    std::vector<float>      mFrequencies;   ///< Frequency of each octave
+    std::vector<float>      mAmplitudes;    ///< Amplitude of each octave
+    float                   mInvDenom;      ///< Reciprocal of the sum of the amplitudes
+    Scalar2Fn               mScalar2;
+    Scalar3Fn               mScalar3;
+    Batch2Fn                mBatch2;
+    Batch3Fn                mBatch3;
+    Batch2DerivativesFn     mBatch2Derivatives;
+};
+
+/// Prepared fBm of the reference noise
+typedef BasicPreparedFractal<SimplexPermutationHash> PreparedFractal;
+/// Prepared fBm of the seeded noise
+typedef BasicPreparedFractal<SimplexIntegerHash> SeededPreparedFractal;
@@ -0,0 +1,201 @@
+/**
+ * @file    SimplexNoiseSimd.cpp
+ * @brief   SSE4.1 and AVX2 kernels of the batched Perlin simplex noise.
+ *
+ * The same generic kernels (SimplexNoiseSimdKernels.inl) are compiled twice, each time inside its own
+ * namespace and under a target pragma, so that this file needs no special compiler flag:
+ * SimplexNoise.cpp only calls into the AVX2 or SSE4.1 versions after checking that the CPU supports them.
+ */
+
+#include "SimplexNoiseSimd.h"
+#include "SimplexNoise.h"
+
+#if SIMPLEXNOISE_X86_SIMD
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace SimplexNoiseSimd {
+namespace sse41 {
+
+/**
+ * 4 lanes of SSE4.1
+ */
+struct V {
+    typedef __m128  F;
+    typedef __m128i I;
+    static const size_t Width = 4;
+
+    static inline F load(const float* p)        { return _mm_loadu_ps(p); }
+    static inline void store(float* p, F a)     { _mm_storeu_ps(p, a); }
+    static inline F set1(float a)               { return _mm_set1_ps(a); }
+    static inline F zero()                      { return _mm_setzero_ps(); }
+    static inline F add(F a, F b)               { return _mm_add_ps(a, b); }
+    static inline F sub(F a, F b)               { return _mm_sub_ps(a, b); }
+    static inline F mul(F a, F b)               { return _mm_mul_ps(a, b); }
+    static inline F andf(F a, F b)              { return _mm_and_ps(a, b); }
+    static inline F orf(F a, F b)               { return _mm_or_ps(a, b); }
+    static inline F xorf(F a, F b)              { return _mm_xor_ps(a, b); }
+    static inline F andnot(F a, F b)            { return _mm_andnot_ps(a, b); } // ~a & b
+    static inline F blend(F a, F b, F mask)     { return _mm_blendv_ps(a, b, mask); } // mask ? b : a
+    static inline F cmplt(F a, F b)             { return _mm_cmplt_ps(a, b); }
+    static inline F cmpgt(F a, F b)             { return _mm_cmpgt_ps(a, b); }
+    static inline F cmpge(F a, F b)             { return _mm_cmpge_ps(a, b); }
+
+    static inline I set1i(int32_t a)            { return _mm_set1_epi32(a); }
+    static inline I addi(I a, I b)              { return _mm_add_epi32(a, b); }
+    static inline I subi(I a, I b)              { return _mm_sub_epi32(a, b); }
+    static inline I andi(I a, I b)              { return _mm_and_si128(a, b); }
+    static inline I ori(I a, I b)               { return _mm_or_si128(a, b); }
+    static inline I cmplti(I a, I b)            { return _mm_cmplt_epi32(a, b); }
+    static inline I cmpeqi(I a, I b)            { return _mm_cmpeq_epi32(a, b); }
+    static inline I xori(I a, I b)              { return _mm_xor_si128(a, b); }
+    static inline I mullo(I a, I b)             { return _mm_mullo_epi32(a, b); }
+    template <int N>
+    static inline I slli(I a)                   { return _mm_slli_epi32(a, N); }
+    template <int N>
+    static inline I srli(I a)                   { return _mm_srli_epi32(a, N); }
+
+    static inline I cvtt(F a)                   { return _mm_cvttps_epi32(a); }
+    static inline F cvt(I a)                    { return _mm_cvtepi32_ps(a); }
+    static inline I castToI(F a)                { return _mm_castps_si128(a); }
+    static inline F castToF(I a)                { return _mm_castsi128_ps(a); }
+
+    // No gather before AVX2: extract the indices and look them up one by one
+    static inline I lookup(const int32_t* table, I idx) {
+        return _mm_setr_epi32(table[_mm_extract_epi32(idx, 0)], table[_mm_extract_epi32(idx, 1)],
+                              table[_mm_extract_epi32(idx, 2)], table[_mm_extract_epi32(idx, 3)]);
+    }
+};
+
+#include "SimplexNoiseSimdKernels.inl"
+
+} // namespace sse41
+
+template <typename Hash>
+size_t noise2Sse41(const Hash& hash, const float* x, const float* y, float* out, size_t count) {
+    return sse41::noise2(sse41::VectorHash<Hash>(hash), x, y, out, count);
+}
+
+template <typename Hash>
+size_t noise3Sse41(const Hash& hash, const float* x, const float* y, const float* z, float* out, size_t count) {
+    return sse41::noise3(sse41::VectorHash<Hash>(hash), x, y, z, out, count);
+}
+
+template size_t noise2Sse41(const SimplexPermutationHash&, const float*, const float*, float*, size_t);
+template size_t noise2Sse41(const SimplexIntegerHash&, const float*, const float*, float*, size_t);
+template size_t noise3Sse41(const SimplexPermutationHash&, const float*, const float*, const float*, float*, size_t);
+template size_t noise3Sse41(const SimplexIntegerHash&, const float*, const float*, const float*, float*, size_t);
+
+template <typename Hash>
+size_t noise2DerivativesSse41(const Hash& hash, const float* x, const float* y, float* out, float* dx, float* dy, size_t count) {
+    return sse41::noise2Derivatives(sse41::VectorHash<Hash>(hash), x, y, out, dx, dy, count);
+}
+
+template size_t noise2DerivativesSse41(const SimplexPermutationHash&, const float*, const float*, float*, float*, float*, size_t);
+template size_t noise2DerivativesSse41(const SimplexIntegerHash&, const float*, const float*, float*, float*, float*, size_t);
+
+} // namespace SimplexNoiseSimd
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace SimplexNoiseSimd {
+namespace avx2 {
+
+/**
+ * 8 lanes of AVX2
+ */
+struct V {
+    typedef __m256  F;
+    typedef __m256i I;
+    static const size_t Width = 8;
+
+    static inline F load(const float* p)        { return _mm256_loadu_ps(p); }
+    static inline void store(float* p, F a)     { _mm256_storeu_ps(p, a); }
+    static inline F set1(float a)               { return _mm256_set1_ps(a); }
+    static inline F zero()                      { return _mm256_setzero_ps(); }
+    static inline F add(F a, F b)               { return _mm256_add_ps(a, b); }
+    static inline F sub(F a, F b)               { return _mm256_sub_ps(a, b); }
+    static inline F mul(F a, F b)               { return _mm256_mul_ps(a, b); }
+    static inline F andf(F a, F b)              { return _mm256_and_ps(a, b); }
+    static inline F orf(F a, F b)               { return _mm256_or_ps(a, b); }
+    static inline F xorf(F a, F b)              { return _mm256_xor_ps(a, b); }
+    static inline F andnot(F a, F b)            { return _mm256_andnot_ps(a, b); } // ~a & b
+    static inline F blend(F a, F b, F mask)     { return _mm256_blendv_ps(a, b, mask); } // mask ? b : a
+    static inline F cmplt(F a, F b)             { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline F cmpgt(F a, F b)             { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline F cmpge(F a, F b)             { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+
+    static inline I set1i(int32_t a)            { return _mm256_set1_epi32(a); }
+    static inline I addi(I a, I b)              { return _mm256_add_epi32(a, b); }
+    static inline I subi(I a, I b)              { return _mm256_sub_epi32(a, b); }
+    static inline I andi(I a, I b)              { return _mm256_and_si256(a, b); }
+    static inline I ori(I a, I b)               { return _mm256_or_si256(a, b); }
+    static inline I cmplti(I a, I b)            { return _mm256_cmpgt_epi32(b, a); }
+    static inline I cmpeqi(I a, I b)            { return _mm256_cmpeq_epi32(a, b); }
+    static inline I xori(I a, I b)              { return _mm256_xor_si256(a, b); }
+    static inline I mullo(I a, I b)             { return _mm256_mullo_epi32(a, b); }
+    template <int N>
+    static inline I slli(I a)                   { return _mm256_slli_epi32(a, N); }
+    template <int N>
+    static inline I srli(I a)                   { return _mm256_srli_epi32(a, N); }
+
+    static inline I cvtt(F a)                   { return _mm256_cvttps_epi32(a); }
+    static inline F cvt(I a)                    { return _mm256_cvtepi32_ps(a); }
+    static inline I castToI(F a)                { return _mm256_castps_si256(a); }
+    static inline F castToF(I a)                { return _mm256_castsi256_ps(a); }
+
+    static inline I lookup(const int32_t* table, I idx) {
+        return _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), idx, 4);
+    }
+};
+
+#include "SimplexNoiseSimdKernels.inl"
+
+} // namespace avx2
+
+template <typename Hash>
+size_t noise2Avx2(const Hash& hash, const float* x, const float* y, float* out, size_t count) {
+    return avx2::noise2(avx2::VectorHash<Hash>(hash), x, y, out, count);
+}
+
+template <typename Hash>
+size_t noise3Avx2(const Hash& hash, const float* x, const float* y, const float* z, float* out, size_t count) {
+    return avx2::noise3(avx2::VectorHash<Hash>(hash), x, y, z, out, count);
+}
+
+template size_t noise2Avx2(const SimplexPermutationHash&, const float*, const float*, float*, size_t);
+template size_t noise2Avx2(const SimplexIntegerHash&, const float*, const float*, float*, size_t);
+template size_t noise3Avx2(const SimplexPermutationHash&, const float*, const float*, const float*, float*, size_t);
+template size_t noise3Avx2(const SimplexIntegerHash&, const float*, const float*, const float*, float*, size_t);
+
+template <typename Hash>
+size_t noise2DerivativesAvx2(const Hash& hash, const float* x, const float* y, float* out, float* dx, float* dy, size_t count) {
+    return avx2::noise2Derivatives(avx2::VectorHash<Hash>(hash), x, y, out, dx, dy, count);
+}
+
+template size_t noise2DerivativesAvx2(const SimplexPermutationHash&, const float*, const float*, float*, float*, float*, size_t);
+template size_t noise2DerivativesAvx2(const SimplexIntegerHash&, const float*, const float*, float*, float*, float*, size_t);
+
+} // namespace SimplexNoiseSimd
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // SIMPLEXNOISE_X86_SIMD
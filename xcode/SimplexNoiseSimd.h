@@ -0,0 +1,55 @@
+/**
+ * @file    SimplexNoiseSimd.h
+ * @brief   Internal interface between SimplexNoise.cpp and its SSE4.1/AVX2 kernels.
+ *
+ * Not part of the public API: use the batched SimplexNoise::noise() and SimplexNoise::fractal()
+ * entry points, which pick one of these kernels at runtime.
+ */
+#pragma once
+
+#include <cstddef>  // size_t
+#include <cstdint>  // int32_t/uint32_t
+
+#if !defined(SIMPLEXNOISE_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define SIMPLEXNOISE_X86_SIMD 1
+#else
+#define SIMPLEXNOISE_X86_SIMD 0
+#endif
+
+namespace SimplexNoiseSimd {
+
+/// The permutation table of SimplexNoise.cpp widened to 32 bits, so that it can be gathered from
+const int32_t* permutation32();
+
+/**
+ * Constants of SimplexIntegerHash, shared by the scalar and vector versions.
+ * The multipliers spread each integer coordinate over the 32 bits before they are combined
+ * (odd constants with well distributed bits), the mixers are those of the "lowbias32" finalizer.
+ */
+static const uint32_t kHashPrimeX = 0x9E3779B1U;
+static const uint32_t kHashPrimeY = 0x85EBCA77U;
+static const uint32_t kHashPrimeZ = 0xC2B2AE3DU;
+static const uint32_t kHashMix1   = 0x7FEB352DU;
+static const uint32_t kHashMix2   = 0x846CA68BU;
+
+#if SIMPLEXNOISE_X86_SIMD
+// Vector kernels, instantiated for SimplexPermutationHash and SimplexIntegerHash.
+// They process whole registers only and return the number of points done (count rounded down
+// to a multiple of 4 or 8), the caller finishes the remaining points with the scalar noise.
+template <typename Hash>
+size_t noise2Sse41(const Hash& hash, const float* x, const float* y, float* out, size_t count);
+template <typename Hash>
+size_t noise3Sse41(const Hash& hash, const float* x, const float* y, const float* z, float* out, size_t count);
+template <typename Hash>
+size_t noise2Avx2(const Hash& hash, const float* x, const float* y, float* out, size_t count);
+template <typename Hash>
+size_t noise3Avx2(const Hash& hash, const float* x, const float* y, const float* z, float* out, size_t count);
+// 2D noise along with its partial derivatives
+template <typename Hash>
+size_t noise2DerivativesSse41(const Hash& hash, const float* x, const float* y, float* out, float* dx, float* dy, size_t count);
+template <typename Hash>
+size_t noise2DerivativesAvx2(const Hash& hash, const float* x, const float* y, float* out, float* dx, float* dy, size_t count);
+#endif
+
+} // namespace SimplexNoiseSimd
@@ -0,0 +1,297 @@
+/**
+ * @file    SimplexNoiseSimdKernels.inl
+ * @brief   Vector versions of the 2D and 3D Perlin simplex noise, generic over the register width.
+ *
+ * Included by SimplexNoiseSimd.cpp once per instruction set, inside a namespace providing a `V`
+ * traits struct and under the matching target pragma, so that every function defined here is
+ * compiled for that instruction set only.
+ *
+ * Each step mirrors the scalar code of SimplexNoise.cpp operation for operation (same constants,
+ * same evaluation order, no FMA) so that both paths produce bit-identical results.
+ * Branches are replaced by masks: both sides are computed and the relevant one is selected.
+ */
+
+/**
+ * Vector version of fastfloor(): truncate then correct negative non-integer values.
+ */
+static inline V::I fastfloor(V::F fp) {
+    const V::I i = V::cvtt(fp);
+    // the comparison mask is all ones (-1) where fp < i
+    return V::addi(i, V::castToI(V::cmplt(fp, V::cvt(i))));
+}
+
+/**
+ * Vector versions of the hashing backends, built once per batch from the scalar one
+ */
+template <typename Hash>
+struct VectorHash;
+
+/**
+ * SimplexPermutationHash: perm[i + perm[j + perm[k]]], one table lookup per lane and per dimension
+ */
+template <>
+struct VectorHash<SimplexPermutationHash> {
+    explicit VectorHash(const SimplexPermutationHash&) : mPerm(SimplexNoiseSimd::permutation32()) {
+    }
+
+    inline V::I operator()(V::I i) const {
+        return V::lookup(mPerm, V::andi(i, V::set1i(0xFF)));
+    }
+    inline V::I operator()(V::I i, V::I j) const {
+        return (*this)(V::addi(i, (*this)(j)));
+    }
+    inline V::I operator()(V::I i, V::I j, V::I k) const {
+        return (*this)(V::addi(i, (*this)(V::addi(j, (*this)(k)))));
+    }
+
+    const int32_t* mPerm;
+};
+
+/**
+ * SimplexIntegerHash: multiply each coordinate, xor them with the seed, then mix; no memory access at all
+ */
+template <>
+struct VectorHash<SimplexIntegerHash> {
+    explicit VectorHash(const SimplexIntegerHash& hash) : mSeed(V::set1i(static_cast<int32_t>(hash.mSeed))) {
+    }
+
+    static inline V::I spread(V::I i, uint32_t prime) {
+        return V::mullo(i, V::set1i(static_cast<int32_t>(prime)));
+    }
+    static inline V::I mix(V::I h) {
+        h = V::xori(h, V::srli<16>(h));
+        h = V::mullo(h, V::set1i(static_cast<int32_t>(SimplexNoiseSimd::kHashMix1)));
+        h = V::xori(h, V::srli<15>(h));
+        h = V::mullo(h, V::set1i(static_cast<int32_t>(SimplexNoiseSimd::kHashMix2)));
+        return V::xori(h, V::srli<16>(h));
+    }
+    inline V::I operator()(V::I i, V::I j) const {
+        return mix(V::xori(V::xori(mSeed, spread(i, SimplexNoiseSimd::kHashPrimeX)),
+                           spread(j, SimplexNoiseSimd::kHashPrimeY)));
+    }
+    inline V::I operator()(V::I i, V::I j, V::I k) const {
+        return mix(V::xori(V::xori(V::xori(mSeed, spread(i, SimplexNoiseSimd::kHashPrimeX)),
+                                   spread(j, SimplexNoiseSimd::kHashPrimeY)),
+                           spread(k, SimplexNoiseSimd::kHashPrimeZ)));
+    }
+
+    V::I mSeed;
+};
+
+/**
+ * Flip the sign of x where the given bit of h is set, as in "(h & bit) ? -x : x"
+ */
+template <int Bit>
+static inline V::F flipSign(V::I h, V::F x) {
+    const V::I sign = V::slli<31 - Bit>(V::andi(h, V::set1i(1 << Bit)));
+    return V::xorf(x, V::castToF(sign));
+}
+
+/**
+ * Vector version of grad(hash, x, y)
+ */
+static inline V::F grad(V::I hash, V::F x, V::F y) {
+    const V::I h = V::andi(hash, V::set1i(0x3F));
+    const V::F lt4 = V::castToF(V::cmplti(h, V::set1i(4)));
+    const V::F u = V::blend(y, x, lt4);
+    const V::F v = V::blend(x, y, lt4);
+    return V::add(flipSign<0>(h, u), flipSign<1>(h, V::mul(V::set1(2.0f), v)));
+}
+
+/**
+ * Vector version of grad(hash, x, y, z)
+ */
+static inline V::F grad(V::I hash, V::F x, V::F y, V::F z) {
+    const V::I h = V::andi(hash, V::set1i(15));
+    const V::F lt8 = V::castToF(V::cmplti(h, V::set1i(8)));
+    const V::F lt4 = V::castToF(V::cmplti(h, V::set1i(4)));
+    // h == 12 || h == 14  <=>  (h | 2) == 14
+    const V::F is12or14 = V::castToF(V::cmpeqi(V::ori(h, V::set1i(2)), V::set1i(14)));
+    const V::F u = V::blend(y, x, lt8);
+    const V::F v = V::blend(V::blend(z, x, is12or14), y, lt4);
+    return V::add(flipSign<0>(h, u), flipSign<1>(h, v));
+}
+
+/**
+ * Contribution of one 2D corner: "t < 0 ? 0 : t^4 * grad(...)" with t = 0.5 - x*x - y*y
+ */
+static inline V::F corner(V::I gi, V::F x, V::F y) {
+    V::F t = V::sub(V::sub(V::set1(0.5f), V::mul(x, x)), V::mul(y, y));
+    const V::F outside = V::cmplt(t, V::zero());
+    t = V::mul(t, t);
+    return V::andnot(outside, V::mul(V::mul(t, t), grad(gi, x, y)));
+}
+
+/**
+ * Contribution of one 2D corner along with its partial derivatives, see gradCorner() in SimplexNoise.cpp
+ */
+static inline V::F corner(V::I gi, V::F x, V::F y, V::F& dx, V::F& dy) {
+    const V::F t = V::sub(V::sub(V::set1(0.5f), V::mul(x, x)), V::mul(y, y));
+    const V::F outside = V::cmplt(t, V::zero());
+    const V::F t2 = V::mul(t, t);
+    const V::F t4 = V::mul(t2, t2);
+    const V::F g = grad(gi, x, y);
+    // Components of the gradient vector: (+-1, +-2) below 4, (+-2, +-1) above
+    const V::I h = V::andi(gi, V::set1i(0x3F));
+    const V::F lt4 = V::castToF(V::cmplti(h, V::set1i(4)));
+    const V::F a = flipSign<0>(h, V::set1(1.0f));
+    const V::F b = flipSign<1>(h, V::set1(2.0f));
+    const V::F gx = V::blend(b, a, lt4);
+    const V::F gy = V::blend(a, b, lt4);
+    const V::F t3g = V::mul(V::mul(V::mul(V::set1(-8.0f), t), t2), g);
+    dx = V::andnot(outside, V::add(V::mul(t3g, x), V::mul(t4, gx)));
+    dy = V::andnot(outside, V::add(V::mul(t3g, y), V::mul(t4, gy)));
+    return V::andnot(outside, V::mul(t4, g));
+}
+
+/**
+ * Contribution of one 3D corner: "t < 0 ? 0 : t^4 * grad(...)" with t = 0.6 - x*x - y*y - z*z
+ */
+static inline V::F corner(V::I gi, V::F x, V::F y, V::F z) {
+    V::F t = V::sub(V::sub(V::sub(V::set1(0.6f), V::mul(x, x)), V::mul(y, y)), V::mul(z, z));
+    const V::F outside = V::cmplt(t, V::zero());
+    t = V::mul(t, t);
+    return V::andnot(outside, V::mul(V::mul(t, t), grad(gi, x, y, z)));
+}
+
+/**
+ * Batched 2D Perlin simplex noise, V::Width points per iteration, and optionally its partial derivatives
+ *
+ * @return number of points done, the remainder (less than V::Width) is left to the caller
+ */
+template <bool Derivatives, typename Hash>
+static size_t noise2(const VectorHash<Hash>& hash, const float* px, const float* py,
+                     float* out, float* outDx, float* outDy, size_t count) {
+    static const float F2 = 0.366025403f;
+    static const float G2 = 0.211324865f;
+    const V::F one = V::set1(1.0f);
+    const V::I onei = V::set1i(1);
+
+    size_t n = 0;
+    for (; n + V::Width <= count; n += V::Width) {
+        const V::F x = V::load(px + n);
+        const V::F y = V::load(py + n);
+
+        // Skew the input space to determine which simplex cell we're in
+        const V::F s = V::mul(V::add(x, y), V::set1(F2));
+        const V::I i = fastfloor(V::add(x, s));
+        const V::I j = fastfloor(V::add(y, s));
+
+        // Unskew the cell origin back to (x,y) space
+        const V::F t = V::mul(V::cvt(V::addi(i, j)), V::set1(G2));
+        const V::F x0 = V::sub(x, V::sub(V::cvt(i), t));
+        const V::F y0 = V::sub(y, V::sub(V::cvt(j), t));
+
+        // Offsets of the middle corner: (1,0) in the lower triangle, (0,1) in the upper one
+        const V::F lower = V::cmpgt(x0, y0);
+        const V::I i1 = V::andi(V::castToI(lower), onei);
+        const V::I j1 = V::subi(onei, i1);
+
+        const V::F x1 = V::add(V::sub(x0, V::andf(lower, one)), V::set1(G2));
+        const V::F y1 = V::add(V::sub(y0, V::andnot(lower, one)), V::set1(G2));
+        const V::F x2 = V::add(V::sub(x0, one), V::set1(2.0f * G2));
+        const V::F y2 = V::add(V::sub(y0, one), V::set1(2.0f * G2));
+
+        // Work out the hashed gradient indices of the three simplex corners
+        const V::I gi0 = hash(i, j);
+        const V::I gi1 = hash(V::addi(i, i1), V::addi(j, j1));
+        const V::I gi2 = hash(V::addi(i, onei), V::addi(j, onei));
+
+        if (Derivatives) {
+            V::F dx0, dy0, dx1, dy1, dx2, dy2;
+            const V::F n0 = corner(gi0, x0, y0, dx0, dy0);
+            const V::F n1 = corner(gi1, x1, y1, dx1, dy1);
+            const V::F n2 = corner(gi2, x2, y2, dx2, dy2);
+            V::store(out + n, V::mul(V::set1(45.23065f), V::add(V::add(n0, n1), n2)));
+            V::store(outDx + n, V::mul(V::set1(45.23065f), V::add(V::add(dx0, dx1), dx2)));
+            V::store(outDy + n, V::mul(V::set1(45.23065f), V::add(V::add(dy0, dy1), dy2)));
+        } else {
+            const V::F n0 = corner(gi0, x0, y0);
+            const V::F n1 = corner(gi1, x1, y1);
+            const V::F n2 = corner(gi2, x2, y2);
+            V::store(out + n, V::mul(V::set1(45.23065f), V::add(V::add(n0, n1), n2)));
+        }
+    }
+    return n;
+}
+
+template <typename Hash>
+static size_t noise2(const VectorHash<Hash>& hash, const float* px, const float* py, float* out, size_t count) {
+    return noise2<false>(hash, px, py, out, 0, 0, count);
+}
+
+template <typename Hash>
+static size_t noise2Derivatives(const VectorHash<Hash>& hash, const float* px, const float* py,
+                                float* out, float* outDx, float* outDy, size_t count) {
+    return noise2<true>(hash, px, py, out, outDx, outDy, count);
+}
+
+/**
+ * Batched 3D Perlin simplex noise, V::Width points per iteration
+ *
+ * @return number of points done, the remainder (less than V::Width) is left to the caller
+ */
+template <typename Hash>
+static size_t noise3(const VectorHash<Hash>& hash, const float* px, const float* py, const float* pz,
+                     float* out, size_t count) {
+    static const float F3 = 1.0f / 3.0f;
+    static const float G3 = 1.0f / 6.0f;
+    const V::F one = V::set1(1.0f);
+    const V::I onei = V::set1i(1);
+
+    size_t n = 0;
+    for (; n + V::Width <= count; n += V::Width) {
+        const V::F x = V::load(px + n);
+        const V::F y = V::load(py + n);
+        const V::F z = V::load(pz + n);
+
+        // Skew the input space to determine which simplex cell we're in
+        const V::F s = V::mul(V::add(V::add(x, y), z), V::set1(F3));
+        const V::I i = fastfloor(V::add(x, s));
+        const V::I j = fastfloor(V::add(y, s));
+        const V::I k = fastfloor(V::add(z, s));
+        const V::F t = V::mul(V::cvt(V::addi(V::addi(i, j), k)), V::set1(G3));
+        const V::F x0 = V::sub(x, V::sub(V::cvt(i), t));
+        const V::F y0 = V::sub(y, V::sub(V::cvt(j), t));
+        const V::F z0 = V::sub(z, V::sub(V::cvt(k), t));
+
+        // Rank ordering of the six possible tetrahedra, expressed with the three comparisons
+        // of the scalar if/else tree (a: x0>=y0, b: y0>=z0, c: x0>=z0)
+        const V::F a = V::cmpge(x0, y0);
+        const V::F b = V::cmpge(y0, z0);
+        const V::F c = V::cmpge(x0, z0);
+        const V::F i1 = V::andf(a, V::orf(b, c));
+        const V::F j1 = V::andnot(a, b);
+        const V::F k1 = V::andnot(V::orf(i1, j1), V::castToF(V::set1i(-1)));
+        const V::F i2 = V::orf(a, V::andf(b, c));
+        const V::F j2 = V::orf(V::andnot(a, V::castToF(V::set1i(-1))), b);
+        const V::F k2 = V::andnot(V::andf(b, V::orf(a, c)), V::castToF(V::set1i(-1)));
+
+        const V::F x1 = V::add(V::sub(x0, V::andf(i1, one)), V::set1(G3));
+        const V::F y1 = V::add(V::sub(y0, V::andf(j1, one)), V::set1(G3));
+        const V::F z1 = V::add(V::sub(z0, V::andf(k1, one)), V::set1(G3));
+        const V::F x2 = V::add(V::sub(x0, V::andf(i2, one)), V::set1(2.0f * G3));
+        const V::F y2 = V::add(V::sub(y0, V::andf(j2, one)), V::set1(2.0f * G3));
+        const V::F z2 = V::add(V::sub(z0, V::andf(k2, one)), V::set1(2.0f * G3));
+        const V::F x3 = V::add(V::sub(x0, one), V::set1(3.0f * G3));
+        const V::F y3 = V::add(V::sub(y0, one), V::set1(3.0f * G3));
+        const V::F z3 = V::add(V::sub(z0, one), V::set1(3.0f * G3));
+
+        // Work out the hashed gradient indices of the four simplex corners
+        const V::I gi0 = hash(i, j, k);
+        const V::I gi1 = hash(V::addi(i, V::andi(V::castToI(i1), onei)),
+                              V::addi(j, V::andi(V::castToI(j1), onei)),
+                              V::addi(k, V::andi(V::castToI(k1), onei)));
+        const V::I gi2 = hash(V::addi(i, V::andi(V::castToI(i2), onei)),
+                              V::addi(j, V::andi(V::castToI(j2), onei)),
+                              V::addi(k, V::andi(V::castToI(k2), onei)));
+        const V::I gi3 = hash(V::addi(i, onei), V::addi(j, onei), V::addi(k, onei));
+
+        const V::F n0 = corner(gi0, x0, y0, z0);
+        const V::F n1 = corner(gi1, x1, y1, z1);
+        const V::F n2 = corner(gi2, x2, y2, z2);
+        const V::F n3 = corner(gi3, x3, y3, z3);
+        V::store(out + n, V::mul(V::set1(32.0f), V::add(V::add(V::add(n0, n1), n2), n3)));
+    }
+    return n;
+}
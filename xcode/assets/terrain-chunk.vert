@@ -0,0 +1,52 @@
+#version 150
+
+uniform mat4    ciModelViewProjection;
+in float           aHeight;
+in vec4            ciColor;
+
+// Chunk of the chunked terrain, see ChunkedTerrain.h: a grid of uChunkColumns x uChunkColumns vertices,
+// row by row, followed by the skirt vertices of the edges z min, z max, x min and x max. Only the
+// heights are stored, x and z are rebuilt from gl_VertexID.
+uniform vec2    uChunkOrigin;   // x and z of the first grid vertex
+uniform float   uChunkSpacing;
+uniform int     uChunkColumns;
+uniform float   uTerrainSize;
+
+out VertexData {
+    vec4 color;
+    vec2 texcoord;
+} vVertexOut;
+
+// (column, row) of the vertex in the chunk, for the wireframe without geometry shader, see wireframe-grid.frag
+out vec2        vGridCoord;
+
+void main(void) {
+    int gridVertices = uChunkColumns * uChunkColumns;
+    int last = uChunkColumns - 1;
+    int row, column;
+    if( gl_VertexID < gridVertices ) {
+        row = gl_VertexID / uChunkColumns;
+        column = gl_VertexID - row * uChunkColumns;
+        vGridCoord = vec2( float( column ), float( row ) );
+    }
+    else {
+        // skirt vertex k of an edge, under the grid vertex k of that edge
+        int skirt = gl_VertexID - gridVertices;
+        int edge = skirt / uChunkColumns;
+        int k = skirt - edge * uChunkColumns;
+        row = edge == 0 ? 0 : edge == 1 ? last : k;
+        column = edge == 2 ? 0 : edge == 3 ? last : k;
+        // moved by a row on the z edges and by a column on the x edges, so that the skirt quads, split into
+        // { grid k, grid k + 1, skirt k } and { skirt k, grid k + 1, skirt k + 1 }, are split as the grid ones
+        vGridCoord = edge < 2 ? vec2( float( column ), float( row + 1 ) ) : vec2( float( column + 1 ), float( row ) );
+    }
+    
+    vec4 position = vec4( uChunkOrigin.x + float( column ) * uChunkSpacing,
+                          aHeight,
+                          uChunkOrigin.y + float( row ) * uChunkSpacing,
+                          1.0 );
+    
+    vVertexOut.color = ciColor;
+    vVertexOut.texcoord = position.xz / uTerrainSize + vec2( 0.5 );
+    gl_Position = ciModelViewProjection * position;
+}
@@ -0,0 +1,38 @@
+#version 150
+
+uniform sampler2D uTexture;
+
+// Wireframe without geometry shader: instead of the barycentric coordinates emitted by wireframe.geom, the
+// vertex shaders output the position of the vertex in its grid, (column, row). That position is linear over
+// every triangle, and the quads are split along the diagonal from (column + 1, row) to (column, row + 1), so
+// the barycentric coordinates of the fragment follow from its position in its quad.
+in VertexData    {
+    vec4 color;
+    vec2 texcoord;
+} vVertexIn;
+
+in vec2                 vGridCoord;
+
+out vec4                oColor;
+
+float edgeFactor()
+{
+    vec2 f = fract( vGridCoord );
+    bool lower = f.x + f.y < 1.0;   // triangle of the corner (column, row), or of (column + 1, row + 1)
+    vec3 baricentric = lower ? vec3( 1.0 - f.x - f.y, f.x, f.y ) : vec3( f.x + f.y - 1.0, 1.0 - f.y, 1.0 - f.x );
+    // the derivatives of the grid position are continuous across the quads, unlike those of fract()
+    vec2 w = fwidth( vGridCoord );
+    vec3 d = vec3( fwidth( vGridCoord.x + vGridCoord.y ), lower ? w : w.yx );
+    vec3 a3 = smoothstep( vec3(0.0), d * 1.5, baricentric );
+    return min(min(a3.x, a3.y), a3.z);
+}
+
+void main(void) {
+    // determine frag distance to closest edge
+    float fEdgeIntensity = 1.0 - edgeFactor();
+    
+    // blend between edge color and face color
+    vec4 vFaceColor = texture( uTexture, vVertexIn.texcoord ) * vVertexIn.color; vFaceColor.a = 0.85;
+    vec4 vEdgeColor = vec4(0.0, 1.0, 0.0, 0.85);
+    oColor = mix(vFaceColor, vEdgeColor, fEdgeIntensity);
+}
@@ -0,0 +1,174 @@
+#version 150
+
+uniform mat4    ciModelViewProjection;
+in vec4            ciColor;
+in vec2            ciTexCoord0;
+
+// GPU noise mode: the heights (and normals) are evaluated here from the same 2D simplex noise and fBm as
+// SimplexNoise.cpp, so nothing is uploaded per frame. x and z come from gl_VertexID as in wireframe.vert,
+// the rows are not rotated since every frame evaluates all of them.
+uniform vec2    uGridOrigin;    // x of column 0, z of row 0
+uniform float   uGridSpacing;
+uniform int     uNumColumns;
+uniform int     uNumRows;
+uniform float   uNoiseOffsetZ;  // added to z before the noise evaluation, like the rows z of the CPU path
+
+// Noise parameters, same semantics as BasicSimplexNoise
+uniform bool    uFractal;       // fBm of uOctaves octaves, or the plain noise of the simplex height function
+uniform int     uOctaves;
+uniform float   uFrequency;
+uniform float   uAmplitude;
+uniform float   uLacunarity;
+uniform float   uPersistence;
+uniform bool    uSeededHash;    // SimplexIntegerHash, or SimplexPermutationHash
+uniform uint    uSeed;
+uniform float   uHeightMult;
+
+uniform bool    uLighting;
+const vec3      kLightDirection = vec3( 0.37, 0.86, 0.35 );
+
+out VertexData {
+    vec4 color;
+    vec2 texcoord;
+} vVertexOut;
+
+// (column, row) of the vertex, for the wireframe without geometry shader, see wireframe-grid.frag
+out vec2        vGridCoord;
+
+// Height of the vertex, captured by transform feedback to check it against the CPU, see cli/HeightFieldGpuParity.cpp
+out float       vHeight;
+
+// Permutation table of SimplexNoise.cpp
+const int kPerm[256] = int[256](
+    151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+    140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+    247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+    57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+    74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+    60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+    65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+    200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+    52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+    207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+    119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+    129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+    218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+    81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+    184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+    222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
+);
+
+int permutationHash( int i, int j )
+{
+    return kPerm[( i + kPerm[j & 255] ) & 255];
+}
+
+// SimplexIntegerHash, see SimplexNoiseSimd.h for the constants
+int integerHash( int i, int j )
+{
+    uint h = uSeed ^ ( uint( i ) * 0x9E3779B1u ) ^ ( uint( j ) * 0x85EBCA77u );
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return int( h );
+}
+
+// Contribution of a corner at distance (x, y), with its partial derivatives added to d
+float corner( int hash, float x, float y, inout vec2 d )
+{
+    float t = 0.5 - x * x - y * y;
+    if( t < 0.0 )
+        return 0.0;
+    
+    int h = hash & 0x3F;
+    float su = ( h & 1 ) != 0 ? -1.0 : 1.0;
+    float sv = ( h & 2 ) != 0 ? -2.0 : 2.0;
+    vec2 g = h < 4 ? vec2( su, sv ) : vec2( sv, su );   // gradient, dotted with the distance below
+    float dotGrad = g.x * x + g.y * y;
+    float t2 = t * t;
+    float t4 = t2 * t2;
+    float t3g = ( -8.0 * t ) * t2 * dotGrad;
+    d += t3g * vec2( x, y ) + t4 * g;
+    return t4 * dotGrad;
+}
+
+// 2D simplex noise in [-1, 1], along with its gradient
+float simplexNoise( vec2 p, out vec2 d )
+{
+    const float F2 = 0.366025403;
+    const float G2 = 0.211324865;
+    
+    float s = ( p.x + p.y ) * F2;
+    int i = int( floor( p.x + s ) );
+    int j = int( floor( p.y + s ) );
+    float t = float( i + j ) * G2;
+    float x0 = p.x - ( float( i ) - t );
+    float y0 = p.y - ( float( j ) - t );
+    int i1 = x0 > y0 ? 1 : 0;
+    int j1 = 1 - i1;
+    float x1 = x0 - float( i1 ) + G2;
+    float y1 = y0 - float( j1 ) + G2;
+    float x2 = x0 - 1.0 + 2.0 * G2;
+    float y2 = y0 - 1.0 + 2.0 * G2;
+    
+    int gi0, gi1, gi2;
+    if( uSeededHash ) {
+        gi0 = integerHash( i, j );
+        gi1 = integerHash( i + i1, j + j1 );
+        gi2 = integerHash( i + 1, j + 1 );
+    }
+    else {
+        gi0 = permutationHash( i, j );
+        gi1 = permutationHash( i + i1, j + j1 );
+        gi2 = permutationHash( i + 1, j + 1 );
+    }
+    
+    d = vec2( 0.0 );
+    float n = corner( gi0, x0, y0, d ) + corner( gi1, x1, y1, d ) + corner( gi2, x2, y2, d );
+    d *= 45.23065;
+    return 45.23065 * n;
+}
+
+// Fractal/Fractional Brownian Motion (fBm) summation, as BasicSimplexNoise::fractal()
+float simplexFractal( vec2 p, out vec2 d )
+{
+    float sum = 0.0;
+    float denom = 0.0;
+    float frequency = uFrequency;
+    float amplitude = uAmplitude;
+    d = vec2( 0.0 );
+    for( int octave = 0; octave < uOctaves; octave++ ) {
+        vec2 octaveD;
+        sum += amplitude * simplexNoise( p * frequency, octaveD );
+        d += ( amplitude * frequency ) * octaveD;
+        denom += amplitude;
+        frequency *= uLacunarity;
+        amplitude *= uPersistence;
+    }
+    d /= denom;
+    return sum / denom;
+}
+
+void main(void) {
+    int row = gl_VertexID / uNumColumns;
+    int column = gl_VertexID - row * uNumColumns;
+    float x = uGridOrigin.x + float( column ) * uGridSpacing;
+    float z = uGridOrigin.y + float( row ) * uGridSpacing;
+    
+    vec2 d;
+    vec2 p = vec2( x, z + uNoiseOffsetZ );
+    float height = uHeightMult * ( uFractal ? simplexFractal( p, d ) : simplexNoise( p, d ) );
+    vHeight = height;
+    
+    vVertexOut.color = ciColor;
+    if( uLighting ) {
+        vec3 normal = normalize( vec3( -uHeightMult * d.x, 1.0, -uHeightMult * d.y ) );
+        float diffuse = max( dot( normal, kLightDirection ), 0.0 );
+        vVertexOut.color.rgb *= 0.25 + 0.75 * diffuse;
+    }
+    vVertexOut.texcoord = ciTexCoord0;
+    vGridCoord = vec2( float( column ), float( row ) );
+    gl_Position = ciModelViewProjection * vec4( x, height, z, 1.0 );
+}
@@ -1,18 +1,57 @@
 #version 150
 
 uniform mat4    ciModelViewProjection;
-in vec4            ciPosition;
+in float           aHeight;
 in vec4            ciColor;
 in vec2            ciTexCoord0;
+in vec3            ciNormal;
+
+// Height-only vertex stream: the plane is a regular grid, so x and z are rebuilt from the vertex index
+// (row slot gl_VertexID / uNumColumns, column gl_VertexID % uNumColumns) and only the height is stored.
+uniform vec2    uGridOrigin;    // x of column 0, z of row slot 0
+uniform float   uGridSpacing;
+
+// Heights uploaded as half floats can't be a vertex attribute, and streamed ones live in one of the regions
+// of a ring of buffers: those are fetched from a buffer texture, uHeightOffset selecting the region
+uniform bool            uHeightsInTexture;
+uniform samplerBuffer   uHeightTexture;
+uniform int             uHeightOffset;
+
+// Scrolling ring buffer: vertex rows are stored in rotated slots, row slot uRingBaseRow holding the
+// first displayed row. The z (and v) of the slot are moved to those of the displayed row.
+uniform int     uNumColumns;
+uniform int     uNumRows;
+uniform int     uRingBaseRow;
+
+// Diffuse lighting from the NORMAL stream, only present when the app fills it
+uniform bool    uLighting;
+const vec3      kLightDirection = vec3( 0.37, 0.86, 0.35 );
 
 out VertexData {
     vec4 color;
     vec2 texcoord;
 } vVertexOut;
 
+// (column, displayed row) of the vertex, for the wireframe without geometry shader, see wireframe-grid.frag
+out vec2        vGridCoord;
+
 void main(void) {
+    int slot = gl_VertexID / uNumColumns;
+    int column = gl_VertexID - slot * uNumColumns;
+    int rowShift = ( slot - uRingBaseRow + uNumRows ) % uNumRows - slot;
+    
+    float height = uHeightsInTexture ? texelFetch( uHeightTexture, uHeightOffset + gl_VertexID ).r : aHeight;
+    vec4 position = vec4( uGridOrigin.x + float( column ) * uGridSpacing,
+                          height,
+                          uGridOrigin.y + float( slot + rowShift ) * uGridSpacing,
+                          1.0 );
+    
     vVertexOut.color = ciColor;
-    vVertexOut.texcoord = ciTexCoord0;
-    gl_Position = ciModelViewProjection * ciPosition;
+    if( uLighting ) {
+        float diffuse = max( dot( normalize( ciNormal ), kLightDirection ), 0.0 );
+        vVertexOut.color.rgb *= 0.25 + 0.75 * diffuse;
+    }
+    vVertexOut.texcoord = ciTexCoord0 + vec2( 0.0, float( rowShift ) / float( uNumRows - 1 ) );
+    vGridCoord = vec2( float( column ), float( slot + rowShift ) );
+    gl_Position = ciModelViewProjection * position;
 }
-